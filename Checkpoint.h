@@ -0,0 +1,208 @@
+/*******************************************************************************
+Checkpoint.h
+
+State of an spr_supertree search saved between iterations of the global
+rearrangement search so that a long run can be continued with -resume
+after a crash or preemption. A checkpoint holds the current and best
+supertrees, the distances and search parameters that change from one
+iteration to the next, the rooting of each gene tree, the taboo list, a
+seed for the random number generator and the exact distances stored in
+the distance cache. The gene trees themselves are not saved; a resumed
+run must read the same gene trees with the same options.
+
+The file is plain text with one field per line:
+	spr_supertree_checkpoint <version>
+	gene_trees <n>
+	labels <n>              labels of the gene trees
+	iteration <next iteration>
+	...
+	supertree <tree>
+	best_supertree <tree>
+	gene_tree_roots <n>     n x (<k> <leaf label> ...)
+	taboo_trees <n>         n x (<hash> <canonical tree>)
+	distance_cache <n>      n x (<gene tree> <key> <check> <distance>)
+A gene tree rooting is the list of leaves on one side of its root. It is
+only saved by searches that reroot the gene trees.
+
+A checkpoint is written to <file>.tmp and then renamed to <file>, so a
+crash while writing leaves the previous checkpoint intact.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_CHECKPOINT
+
+#define INCLUDE_CHECKPOINT
+
+#include <cstdio>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "Node.h"
+#include "DistanceCache.h"
+#include "TabooList.h"
+
+using namespace std;
+
+#define CHECKPOINT_VERSION 3
+
+class SearchCheckpoint {
+	public:
+	int num_gene_trees;
+	int num_labels;
+	int iteration;
+	unsigned int seed;
+	int best_distance;
+	int best_tie_distance;
+	int best_rooted_distance;
+	int current_distance;
+	int r_distance;
+	int simple_unrooted_num;
+	int num_zeros;
+	int edges_cut;
+	string super_tree;
+	string best_supertree;
+	vector<vector<int> > gene_tree_roots;
+
+	SearchCheckpoint() {
+		num_gene_trees = 0;
+		num_labels = 0;
+		iteration = 0;
+		seed = 0;
+		best_distance = 0;
+		best_tie_distance = 0;
+		best_rooted_distance = 0;
+		current_distance = 0;
+		r_distance = 0;
+		simple_unrooted_num = 0;
+		num_zeros = 0;
+		edges_cut = 0;
+		super_tree = "";
+		best_supertree = "";
+		gene_tree_roots = vector<vector<int> >();
+	}
+};
+
+bool read_checkpoint_field(istream &in, const char *name, int *x) {
+	string field;
+	return (in >> field >> *x) && field == name;
+}
+
+bool read_checkpoint_field(istream &in, const char *name, unsigned int *x) {
+	string field;
+	return (in >> field >> *x) && field == name;
+}
+
+// a tree is the rest of the line after its field name
+bool read_checkpoint_field(istream &in, const char *name, string *s) {
+	string field;
+	if (!(in >> field) || field != name)
+		return false;
+	in >> ws;
+	return getline(in, *s) && !s->empty();
+}
+
+// write c, the taboo trees and the distances in cache for gene_trees
+// to filename
+bool write_checkpoint(string filename, SearchCheckpoint &c, TabooList *taboo,
+		DistanceCache *cache, vector<Node *> &gene_trees) {
+	string temp_filename = filename + ".tmp";
+	ofstream out(temp_filename.c_str(), ios::out | ios::trunc);
+	if (!out.is_open())
+		return false;
+	out << "spr_supertree_checkpoint " << CHECKPOINT_VERSION << endl;
+	out << "gene_trees " << c.num_gene_trees << endl;
+	out << "labels " << c.num_labels << endl;
+	out << "iteration " << c.iteration << endl;
+	out << "seed " << c.seed << endl;
+	out << "best_distance " << c.best_distance << endl;
+	out << "best_tie_distance " << c.best_tie_distance << endl;
+	out << "best_rooted_distance " << c.best_rooted_distance << endl;
+	out << "current_distance " << c.current_distance << endl;
+	out << "r_distance " << c.r_distance << endl;
+	out << "simple_unrooted_num " << c.simple_unrooted_num << endl;
+	out << "num_zeros " << c.num_zeros << endl;
+	out << "edges_cut " << c.edges_cut << endl;
+	out << "supertree " << c.super_tree << endl;
+	out << "best_supertree " << c.best_supertree << endl;
+	out << "gene_tree_roots " << c.gene_tree_roots.size() << endl;
+	for(int i = 0; i < c.gene_tree_roots.size(); i++) {
+		out << c.gene_tree_roots[i].size();
+		for(int j = 0; j < c.gene_tree_roots[i].size(); j++)
+			out << " " << c.gene_tree_roots[i][j];
+		out << endl;
+	}
+	taboo->write(out);
+	cache->write(out, gene_trees);
+	out.close();
+	if (out.fail())
+		return false;
+	return rename(temp_filename.c_str(), filename.c_str()) == 0;
+}
+
+// read a checkpoint written by write_checkpoint and add its taboo trees
+// to taboo and its distances to cache. returns false if the file is
+// missing or malformed or was written for a different number of gene
+// trees or gene tree labels
+bool read_checkpoint(string filename, SearchCheckpoint *c, TabooList *taboo,
+		DistanceCache *cache, vector<Node *> &gene_trees, int num_labels) {
+	ifstream in(filename.c_str());
+	if (!in.is_open())
+		return false;
+	int version;
+	int num_roots;
+	if (!read_checkpoint_field(in, "spr_supertree_checkpoint", &version)
+			|| version != CHECKPOINT_VERSION
+			|| !read_checkpoint_field(in, "gene_trees", &c->num_gene_trees)
+			|| c->num_gene_trees != gene_trees.size()
+			|| !read_checkpoint_field(in, "labels", &c->num_labels)
+			|| c->num_labels != num_labels
+			|| !read_checkpoint_field(in, "iteration", &c->iteration)
+			|| !read_checkpoint_field(in, "seed", &c->seed)
+			|| !read_checkpoint_field(in, "best_distance", &c->best_distance)
+			|| !read_checkpoint_field(in, "best_tie_distance",
+					&c->best_tie_distance)
+			|| !read_checkpoint_field(in, "best_rooted_distance",
+					&c->best_rooted_distance)
+			|| !read_checkpoint_field(in, "current_distance",
+					&c->current_distance)
+			|| !read_checkpoint_field(in, "r_distance", &c->r_distance)
+			|| !read_checkpoint_field(in, "simple_unrooted_num",
+					&c->simple_unrooted_num)
+			|| !read_checkpoint_field(in, "num_zeros", &c->num_zeros)
+			|| !read_checkpoint_field(in, "edges_cut", &c->edges_cut)
+			|| !read_checkpoint_field(in, "supertree", &c->super_tree)
+			|| !read_checkpoint_field(in, "best_supertree",
+					&c->best_supertree)
+			|| !read_checkpoint_field(in, "gene_tree_roots", &num_roots)
+			|| (num_roots != 0 && num_roots != gene_trees.size()))
+		return false;
+	c->gene_tree_roots = vector<vector<int> >(num_roots);
+	for(int i = 0; i < num_roots; i++) {
+		int size;
+		if (!(in >> size) || size < 0)
+			return false;
+		c->gene_tree_roots[i] = vector<int>(size);
+		for(int j = 0; j < size; j++) {
+			if (!(in >> c->gene_tree_roots[i][j]))
+				return false;
+		}
+	}
+	return taboo->read(in) && cache->read(in, gene_trees);
+}
+
+#endif
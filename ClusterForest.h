@@ -128,7 +128,7 @@ class ClusterForest: public Forest {
 		}
 		// should we add these to a finished_components or something?
 		for(int i = start; i < solved_cluster->num_components(); i++) {
-			if (solved_cluster->get_component(i)->str() != "p")
+			if (!solved_cluster->get_component(i)->is_rho())
 				add_component(solved_cluster->get_component(i));
 				//add_component(new Node(*(solved_cluster->get_component(i))));
 			else
@@ -150,7 +150,7 @@ class ClusterForest: public Forest {
 		}
 		// should we add these to a finished_components or something?
 		for(int i = start; i < solved_cluster->num_components(); i++) {
-			if (solved_cluster->get_component(i)->str() != "p")
+			if (!solved_cluster->get_component(i)->is_rho())
 				//add_component(new Node(*(solved_cluster->get_component(i))));
 				add_component(solved_cluster->get_component(i));
 			else
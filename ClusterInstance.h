@@ -147,7 +147,7 @@ class ClusterInstance {
 		}
 		// should we add these to a finished_components or something?
 		for(int i = start; i < F1->num_components(); i++) {
-			if (F1->get_component(i)->str() != "p")
+			if (!F1->get_component(i)->is_rho())
 				original_F1->add_component(F1->get_component(i));
 			else {
 				rho_1 = i;
@@ -232,14 +232,14 @@ class ClusterInstance {
 		for(int i = 0; i < F2->num_components(); i++) {
 			if (F2->get_component(i) == F2_cluster) {
 				if (!skip) {
-					if (F2->get_component(i)->str() != "p")
+					if (!F2->get_component(i)->is_rho())
 						F1_cluster_node_forest->get_twin()->add_component(F2->get_component(i));
 					else
 						rho_2 = i;
 				}
 			}
 			else {
-				if (F2->get_component(i)->str() != "p")
+				if (!F2->get_component(i)->is_rho())
 					original_F2->add_component(F2->get_component(i));
 				else
 					rho_2 = i;
@@ -0,0 +1,226 @@
+/*******************************************************************************
+ClusterTable.h
+
+Robinson-Foulds distances in linear time with Day's algorithm. A
+ClusterTable holds a tree as the leaf labels and numbers of children of
+its nodes in postorder, so it can be built once and compared with many
+other trees. A comparison restricts both trees to their shared leaves,
+numbers the shared leaves in the postorder of the first tree so that
+each of its clusters is an interval, and stores the intervals in two
+arrays indexed by their endpoints. A cluster of the second tree is then
+shared exactly when its leaves span an interval of the right size that
+is in the arrays.
+
+The distances are the same as rf_distance on FlatForests: the number of
+clusters of the restricted trees that are not in the other tree.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_CLUSTERTABLE
+
+#define INCLUDE_CLUSTERTABLE
+
+#include <cstdio>
+#include <climits>
+#include <list>
+#include <vector>
+#include "Node.h"
+
+using namespace std;
+
+class ClusterTable {
+	public:
+	// node attributes in postorder
+	vector<int> labels;			// leaf labels, -1 for other nodes
+	vector<int> num_children;
+	int max_label;
+
+	ClusterTable() {
+		max_label = -1;
+	}
+
+	ClusterTable(Node *T) {
+		max_label = -1;
+		add_subtree(T);
+	}
+
+	int size() {
+		return labels.size();
+	}
+
+	private:
+	void add_subtree(Node *n) {
+		list<Node *>::iterator c;
+		for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
+			add_subtree(*c);
+		}
+		int label = -1;
+		if (n->is_leaf()) {
+			label = n->get_min_label();
+			if (label == INT_MAX)
+				label = -1;
+		}
+		if (label > max_label)
+			max_label = label;
+		labels.push_back(label);
+		num_children.push_back(n->get_children().size());
+	}
+};
+
+// a cluster while a ClusterTable is evaluated: the interval of shared
+// leaves below a node and whether it is a cluster of the restricted tree
+class ClusterInterval {
+	public:
+	int lo;
+	int hi;
+	int num_leaves;
+	bool interior;
+
+	ClusterInterval() {
+		lo = INT_MAX;
+		hi = -1;
+		num_leaves = 0;
+		interior = false;
+	}
+};
+
+/* replace the intervals of the children of a node, the last
+ * num_children entries of stack, with the interval of the node
+ * RETURN the number of children with shared leaves
+ */
+int merge_cluster_intervals(vector<ClusterInterval> &stack, int &top,
+		int num_children) {
+	ClusterInterval merged = ClusterInterval();
+	int nonempty = 0;
+	for(int i = top - num_children; i < top; i++) {
+		ClusterInterval &child = stack[i];
+		if (child.num_leaves == 0)
+			continue;
+		nonempty++;
+		if (child.lo < merged.lo)
+			merged.lo = child.lo;
+		if (child.hi > merged.hi)
+			merged.hi = child.hi;
+		merged.num_leaves += child.num_leaves;
+		merged.interior = child.interior;
+	}
+	// a node with one nonempty child is contracted by the restriction
+	if (nonempty > 1)
+		merged.interior = true;
+	top -= num_children;
+	stack[top++] = merged;
+	return nonempty;
+}
+
+// the interval of a leaf
+ClusterInterval leaf_interval(vector<int> &rank, int label) {
+	ClusterInterval leaf = ClusterInterval();
+	if (label >= 0 && rank[label] >= 0) {
+		leaf.lo = rank[label];
+		leaf.hi = rank[label];
+		leaf.num_leaves = 1;
+	}
+	return leaf;
+}
+
+// Robinson-Foulds distance of the trees restricted to their shared leaves
+int rf_distance(ClusterTable *T1, ClusterTable *T2) {
+	int num_labels = max(T1->max_label, T2->max_label) + 1;
+	vector<bool> in_T2 = vector<bool>(num_labels, false);
+	for(int i = 0; i < T2->size(); i++) {
+		if (T2->labels[i] >= 0)
+			in_T2[T2->labels[i]] = true;
+	}
+	// rank of each shared leaf in the postorder of T1, -1 if not shared
+	vector<int> rank = vector<int>(num_labels, -1);
+	int num_shared = 0;
+	for(int i = 0; i < T1->size(); i++) {
+		int label = T1->labels[i];
+		if (label >= 0 && in_T2[label])
+			rank[label] = num_shared++;
+	}
+	// two shared leaves only have the trivial clusters
+	if (num_shared < 3)
+		return 0;
+
+	/* Day's table of T1: a cluster [lo, hi] that is the leftmost child
+	 * of its parent, or the root, is stored as left_end[hi] = lo and any
+	 * other as right_end[lo] = hi. No two clusters share a slot
+	 */
+	vector<int> left_end = vector<int>(num_shared, -1);
+	vector<int> right_end = vector<int>(num_shared, -1);
+	int num_clusters_1 = 0;
+	vector<ClusterInterval> stack = vector<ClusterInterval>(T1->size());
+	int top = 0;
+	for(int i = 0; i < T1->size(); i++) {
+		int num_children = T1->num_children[i];
+		if (num_children == 0) {
+			stack[top++] = leaf_interval(rank, T1->labels[i]);
+			continue;
+		}
+		int nonempty = 0;
+		int lo = INT_MAX;
+		for(int j = top - num_children; j < top; j++) {
+			if (stack[j].num_leaves > 0) {
+				nonempty++;
+				if (stack[j].lo < lo)
+					lo = stack[j].lo;
+			}
+		}
+		if (nonempty > 1) {
+			num_clusters_1++;
+			for(int j = top - num_children; j < top; j++) {
+				ClusterInterval &child = stack[j];
+				if (!child.interior)
+					continue;
+				if (child.lo == lo)
+					left_end[child.hi] = child.lo;
+				else
+					right_end[child.lo] = child.hi;
+			}
+		}
+		merge_cluster_intervals(stack, top, num_children);
+	}
+	left_end[num_shared - 1] = 0;
+
+	int num_clusters_2 = 0;
+	int num_common = 0;
+	stack = vector<ClusterInterval>(T2->size());
+	top = 0;
+	for(int i = 0; i < T2->size(); i++) {
+		int num_children = T2->num_children[i];
+		if (num_children == 0) {
+			stack[top++] = leaf_interval(rank, T2->labels[i]);
+			continue;
+		}
+		if (merge_cluster_intervals(stack, top, num_children) < 2)
+			continue;
+		ClusterInterval &c = stack[top - 1];
+		num_clusters_2++;
+		if (c.hi - c.lo + 1 == c.num_leaves
+				&& (left_end[c.hi] == c.lo || right_end[c.lo] == c.hi))
+			num_common++;
+	}
+	return (num_clusters_1 - num_common) + (num_clusters_2 - num_common);
+}
+
+int rf_distance(ClusterTable *T1, Node *T2) {
+	ClusterTable T2_table = ClusterTable(T2);
+	return rf_distance(T1, &T2_table);
+}
+
+#endif
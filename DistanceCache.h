@@ -0,0 +1,224 @@
+/*******************************************************************************
+DistanceCache.h
+
+Exact rSPR distances of gene trees to restrictions of a supertree. A
+supertree search evaluates many SPR moves and most of them either leave
+the restriction of the supertree to a gene tree's leaves unchanged or
+produce a restriction that was already evaluated. Each gene tree added
+with add_tree keeps a table from the hash of the canonical_str of a
+restriction to its exact distance, so the branch and bound only runs on
+a miss. Each entry also stores a second, independent hash of the
+canonical_str that must match on a hit, so a collision of the table
+hashes is a miss rather than a wrong distance.
+
+The number of entries is bounded; once the bound is reached new
+distances are no longer stored. A gene tree that is modified (e.g.
+rerooted) must be cleared. The stored distances are saved in search
+checkpoints with write and restored with read.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_DISTANCECACHE
+
+#define INCLUDE_DISTANCECACHE
+
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Node.h"
+
+using namespace std;
+
+// a restriction of the supertree, see DistanceCache::restriction_key
+class RestrictionKey {
+	public:
+	size_t hash;
+	unsigned long long check;
+	RestrictionKey() {
+		hash = 0;
+		check = 0;
+	}
+};
+
+class CachedDistance {
+	public:
+	unsigned long long check;
+	int k;
+	CachedDistance(unsigned long long c, int d) {
+		check = c;
+		k = d;
+	}
+};
+
+class DistanceCache {
+	private:
+	// the outer map is only changed by add_tree, so lookups of the
+	// per-tree table do not need to lock
+	map<Node *, unordered_map<size_t, CachedDistance> > distances;
+	long long max_entries;
+	long long entries;
+	long long hits;
+	long long misses;
+
+	public:
+	DistanceCache() {
+		max_entries = 0;
+		entries = 0;
+		hits = 0;
+		misses = 0;
+	}
+
+	void set_max_entries(long long max) {
+		max_entries = max;
+	}
+
+	void add_tree(Node *T) {
+		distances[T];
+	}
+
+	void add_trees(vector<Node *> &trees) {
+		for(int i = 0; i < trees.size(); i++) {
+			add_tree(trees[i]);
+		}
+	}
+
+	bool is_cached(Node *T) {
+		return max_entries > 0 && distances.find(T) != distances.end();
+	}
+
+	// the key of a restriction with the given canonical_str
+	static RestrictionKey restriction_key(const string &canonical) {
+		RestrictionKey key = RestrictionKey();
+		key.hash = hash<string>()(canonical);
+		// 64 bit FNV-1a, unrelated to hash<string>
+		key.check = 14695981039346656037ULL;
+		for(int i = 0; i < canonical.size(); i++) {
+			key.check ^= (unsigned char)canonical[i];
+			key.check *= 1099511628211ULL;
+		}
+		return key;
+	}
+
+	// set k and return true if a distance is stored for this restriction
+	bool lookup(Node *T, RestrictionKey &key, int *k) {
+		unordered_map<size_t, CachedDistance> &table =
+				distances.find(T)->second;
+		bool found = false;
+		#pragma omp critical (distance_cache)
+		{
+			unordered_map<size_t, CachedDistance>::iterator d =
+					table.find(key.hash);
+			if (d != table.end() && d->second.check == key.check) {
+				*k = d->second.k;
+				found = true;
+				hits++;
+			}
+			else
+				misses++;
+		}
+		return found;
+	}
+
+	// a restriction whose hash is already stored for another is not kept
+	void insert(Node *T, RestrictionKey &key, int k) {
+		unordered_map<size_t, CachedDistance> &table =
+				distances.find(T)->second;
+		#pragma omp critical (distance_cache)
+		{
+			if (entries < max_entries && table.insert(make_pair(key.hash,
+					CachedDistance(key.check, k))).second)
+				entries++;
+		}
+	}
+
+	void clear(Node *T) {
+		map<Node *, unordered_map<size_t, CachedDistance> >::iterator t =
+				distances.find(T);
+		if (t == distances.end())
+			return;
+		#pragma omp critical (distance_cache)
+		{
+			entries -= t->second.size();
+			unordered_map<size_t, CachedDistance>().swap(t->second);
+		}
+	}
+
+	// write the stored distances as lines of tree index, key, check and
+	// distance where the index is the position of the tree in trees
+	void write(ostream &out, vector<Node *> &trees) {
+		out << "distance_cache " << entries << endl;
+		for(int i = 0; i < trees.size(); i++) {
+			map<Node *, unordered_map<size_t, CachedDistance> >::iterator t =
+					distances.find(trees[i]);
+			if (t == distances.end())
+				continue;
+			unordered_map<size_t, CachedDistance>::iterator d;
+			for(d = t->second.begin(); d != t->second.end(); d++)
+				out << i << " " << d->first << " " << d->second.check << " "
+						<< d->second.k << endl;
+		}
+	}
+
+	// read distances written by write for the same trees
+	// returns false if the input is malformed
+	bool read(istream &in, vector<Node *> &trees) {
+		string field;
+		long long num_entries;
+		if (!(in >> field >> num_entries) || field != "distance_cache")
+			return false;
+		for(long long j = 0; j < num_entries; j++) {
+			int i;
+			RestrictionKey key;
+			int k;
+			if (!(in >> i >> key.hash >> key.check >> k)
+					|| i < 0 || i >= trees.size())
+				return false;
+			if (is_cached(trees[i]))
+				insert(trees[i], key, k);
+		}
+		return true;
+	}
+
+	// approximate memory used by the stored distances in bytes
+	long long memory() {
+		long long bytes = distances.size()
+				* sizeof(pair<Node *const, unordered_map<size_t, CachedDistance> >);
+		map<Node *, unordered_map<size_t, CachedDistance> >::iterator t;
+		for(t = distances.begin(); t != distances.end(); t++) {
+			bytes += t->second.bucket_count() * sizeof(void *);
+		}
+		// each entry is a list node holding the key, value and next pointer
+		bytes += entries * (sizeof(pair<const size_t, CachedDistance>)
+				+ 2 * sizeof(void *));
+		return bytes;
+	}
+
+	void print_stats() {
+		long long lookups = hits + misses;
+		cout << "distance cache: " << hits << " hits / " << lookups
+				<< " lookups";
+		if (lookups > 0)
+			cout << " (" << (100.0 * hits / lookups) << "%)";
+		cout << ", " << entries << " entries, "
+				<< (memory() / (1024.0 * 1024.0)) << " MB" << endl;
+	}
+};
+
+#endif
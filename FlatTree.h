@@ -0,0 +1,769 @@
+/*******************************************************************************
+FlatTree.h
+
+Compact index-based forest for the comparison kernels. Nodes are numbered
+0..n-1 in preorder when converted and each attribute is stored in its own
+contiguous array (parent, first/last child, next/previous sibling, ...)
+so that traversals walk a few small arrays instead of chasing list nodes
+and Node objects around the heap. -1 means "no node".
+
+Leaves carry their numbered labels (see labels_to_numbers); the rho leaf
+has label FLAT_RHO. Converters to and from Node and Forest are provided.
+The operations mirror those of Node and Forest with the same child order
+and depth bookkeeping, so the algorithms ported to FlatForest give the
+same answers as their Node based versions.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_FLATTREE
+
+#define INCLUDE_FLATTREE
+
+#include <cstdio>
+#include <climits>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <utility>
+#include "Forest.h"
+#include "LCA.h"
+
+using namespace std;
+
+// label of unlabelled nodes
+#define FLAT_NO_LABEL -1
+// label of the rho leaf
+#define FLAT_RHO -2
+
+// node flags
+#define FLAT_PROTECTED 1
+#define FLAT_NO_SIBLING 2
+
+class FlatForest {
+	public:
+	// node attributes, indexed by node number
+	vector<int> parents;
+	vector<int> first_child;
+	vector<int> last_child;
+	vector<int> next_sibling;
+	vector<int> prev_sibling;
+	vector<int> num_children;
+	vector<int> labels;
+	vector<int> twins;			// node number in twin_forest
+	vector<int> depths;
+	vector<int> preorder;
+	vector<unsigned char> flags;
+	// component roots
+	vector<int> components;
+	bool rho;
+	FlatForest *twin_forest;
+
+	FlatForest() {
+		rho = false;
+		twin_forest = NULL;
+	}
+
+	FlatForest(Node *head) {
+		rho = false;
+		twin_forest = NULL;
+		components.push_back(add_subtree(head));
+	}
+
+	FlatForest(Forest *F) {
+		rho = F->contains_rho();
+		twin_forest = NULL;
+		for(int i = 0; i < F->num_components(); i++)
+			components.push_back(add_subtree(F->get_component(i)));
+	}
+
+	// copy the subtree of head, numbering its nodes in preorder
+	int add_subtree(Node *head) {
+		int root = -1;
+		vector<pair<Node *, int> > stack = vector<pair<Node *, int> >();
+		stack.push_back(make_pair(head, -1));
+		while(!stack.empty()) {
+			Node *n = stack.back().first;
+			int p = stack.back().second;
+			stack.pop_back();
+			int label = n->get_label();
+			if (n->is_leaf()) {
+				label = n->get_min_label();
+				if (label == INT_MAX)
+					label = n->is_rho() ? FLAT_RHO : FLAT_NO_LABEL;
+			}
+			int x = add_node(label);
+			preorder[x] = n->get_preorder_number();
+			if (n->is_protected())
+				flags[x] |= FLAT_PROTECTED;
+			if (!n->can_be_sibling())
+				flags[x] |= FLAT_NO_SIBLING;
+			if (p == -1) {
+				root = x;
+				depths[x] = n->get_depth();
+			}
+			else
+				add_child(p, x);
+			list<Node *>::reverse_iterator c;
+			for(c = n->get_children().rbegin(); c != n->get_children().rend();
+					c++) {
+				stack.push_back(make_pair(*c, x));
+			}
+		}
+		return root;
+	}
+
+	// build a Node tree for the subtree of n
+	Node *to_node(int n) {
+		Node *node = new_node(n);
+		node->set_depth(depths[n]);
+		node->set_preorder_number(preorder[n]);
+		if (flags[n] & FLAT_PROTECTED)
+			node->protect_edge();
+		if (flags[n] & FLAT_NO_SIBLING)
+			node->disallow_siblings();
+		for(int c = first_child[n]; c != -1; c = next_sibling[c])
+			node->add_child(to_node(c));
+		return node;
+	}
+
+	// build a Forest with a Node tree for each component
+	Forest *to_forest() {
+		vector<Node *> roots = vector<Node *>();
+		for(int i = 0; i < components.size(); i++)
+			roots.push_back(to_node(components[i]));
+		Forest *F = new Forest(roots);
+		F->set_rho(rho);
+		return F;
+	}
+
+	// a Node labelled like n
+	Node *new_node(int n) {
+		Node *node = new Node();
+		if (labels[n] >= 0)
+			node->set_label(labels[n]);
+		else if (labels[n] == FLAT_RHO)
+			node->set_name("p");
+		return node;
+	}
+
+	string label_str(int n) {
+		if (labels[n] == FLAT_RHO)
+			return "p";
+		if (labels[n] < 0)
+			return "";
+		stringstream ss;
+		ss << labels[n];
+		return ss.str();
+	}
+
+	int add_node(int label) {
+		int x = parents.size();
+		parents.push_back(-1);
+		first_child.push_back(-1);
+		last_child.push_back(-1);
+		next_sibling.push_back(-1);
+		prev_sibling.push_back(-1);
+		num_children.push_back(0);
+		labels.push_back(label);
+		twins.push_back(-1);
+		depths.push_back(0);
+		preorder.push_back(-1);
+		flags.push_back(0);
+		return x;
+	}
+
+	inline int size() {
+		return parents.size();
+	}
+	inline int num_components() {
+		return components.size();
+	}
+	inline int get_component(int i) {
+		return components[i];
+	}
+	inline void add_component(int n) {
+		components.push_back(n);
+	}
+	inline bool contains_rho() {
+		return rho;
+	}
+	inline bool is_leaf(int n) {
+		return num_children[n] == 0;
+	}
+	inline int lchild(int n) {
+		return first_child[n];
+	}
+	inline int rchild(int n) {
+		int lc = first_child[n];
+		if (lc == -1)
+			return -1;
+		return next_sibling[lc];
+	}
+	inline bool is_sibling_pair(int n) {
+		int lc = lchild(n);
+		int rc = rchild(n);
+		return (lc != -1 && is_leaf(lc) && rc != -1 && is_leaf(rc));
+	}
+	inline bool is_singleton(int n) {
+		return (parents[n] == -1 && is_leaf(n));
+	}
+	inline bool is_protected(int n) {
+		return flags[n] & FLAT_PROTECTED;
+	}
+	inline bool can_be_sibling(int n) {
+		return !(flags[n] & FLAT_NO_SIBLING);
+	}
+
+	int get_sibling(int n) {
+		int p = parents[n];
+		if (p == -1 || num_children[p] < 2)
+			return -1;
+		if (first_child[p] == n)
+			return next_sibling[n];
+		return prev_sibling[n];
+	}
+
+	int find_root(int n) {
+		while(parents[n] != -1)
+			n = parents[n];
+		return n;
+	}
+
+	// cut the edge between n and its parent
+	void cut_parent(int n) {
+		int p = parents[n];
+		if (p == -1)
+			return;
+		int prev = prev_sibling[n];
+		int next = next_sibling[n];
+		if (prev != -1)
+			next_sibling[prev] = next;
+		else
+			first_child[p] = next;
+		if (next != -1)
+			prev_sibling[next] = prev;
+		else
+			last_child[p] = prev;
+		num_children[p]--;
+		parents[n] = -1;
+		prev_sibling[n] = -1;
+		next_sibling[n] = -1;
+	}
+
+	// make n the last child of p
+	void add_child_keep_depth(int p, int n) {
+		cut_parent(n);
+		int last = last_child[p];
+		prev_sibling[n] = last;
+		next_sibling[n] = -1;
+		if (last != -1)
+			next_sibling[last] = n;
+		else
+			first_child[p] = n;
+		last_child[p] = n;
+		parents[n] = p;
+		num_children[p]++;
+	}
+
+	void add_child(int p, int n) {
+		add_child_keep_depth(p, n);
+		depths[n] = depths[p] + 1;
+	}
+
+	// insert n before sibling
+	void insert_child_keep_depth(int sibling, int n) {
+		cut_parent(n);
+		int p = parents[sibling];
+		int prev = prev_sibling[sibling];
+		prev_sibling[n] = prev;
+		next_sibling[n] = sibling;
+		prev_sibling[sibling] = n;
+		if (prev != -1)
+			next_sibling[prev] = n;
+		else
+			first_child[p] = n;
+		parents[n] = p;
+		num_children[p]++;
+	}
+
+	/* contract n as Node::contract does
+	 * returns the first degree two parent found or -1 if there
+	 * was no contraction
+	 */
+	int contract(int n) {
+		int parent = parents[n];
+		if (parent != -1) {
+			if (num_children[n] == 1) {
+				int child = first_child[n];
+				if (n == last_child[parent])
+					add_child_keep_depth(parent, child);
+				else
+					insert_child_keep_depth(next_sibling[n], child);
+				depths[child] = depths[n];
+				if (flags[n] & FLAT_PROTECTED)
+					flags[child] |= FLAT_PROTECTED;
+				cut_parent(n);
+				return parent;
+			}
+			else if (num_children[n] == 0) {
+				cut_parent(n);
+				return contract(parent);
+			}
+			return n;
+		}
+		// if no parent then take the children of a single child
+		if (num_children[n] != 1)
+			return -1;
+		int child = first_child[n];
+		cut_parent(child);
+		if (is_leaf(child)) {
+			int twin = twins[child];
+			if (twin != -1) {
+				twins[n] = twin;
+				if (twin_forest != NULL)
+					twin_forest->twins[twin] = n;
+			}
+			labels[n] = labels[child];
+		}
+		while(first_child[child] != -1)
+			add_child(n, first_child[child]);
+		preorder[n] = preorder[child];
+		return n;
+	}
+
+	// contract a sibling pair of leaves below n into n
+	bool contract_sibling_pair(int n) {
+		if (!is_sibling_pair(n))
+			return false;
+		int lc = lchild(n);
+		int rc = rchild(n);
+		cut_parent(rc);
+		cut_parent(lc);
+		flags[n] &= ~FLAT_PROTECTED;
+		return true;
+	}
+
+	/* contract the children child1 and child2 of n
+	 * works with multifurcating trees by first joining them below
+	 * a new child of n
+	 * returns -1 for no contract, otherwise the contracted parent
+	 */
+	int contract_sibling_pair(int n, int child1, int child2) {
+		if (parents[child1] != n || parents[child2] != n)
+			return -1;
+		if (num_children[n] == 2) {
+			contract_sibling_pair(n);
+			return n;
+		}
+		int new_child = add_node(FLAT_NO_LABEL);
+		if (preorder[child1] < preorder[child2])
+			preorder[new_child] = preorder[child1];
+		else
+			preorder[new_child] = preorder[child2];
+		add_child(n, new_child);
+		add_child(new_child, child1);
+		add_child(new_child, child2);
+		flags[n] &= ~FLAT_PROTECTED;
+		return new_child;
+	}
+
+	// nodes of the subtree of n in preorder
+	void find_subtree(int n, vector<int> &nodes) {
+		vector<int> stack = vector<int>();
+		stack.push_back(n);
+		while(!stack.empty()) {
+			n = stack.back();
+			stack.pop_back();
+			nodes.push_back(n);
+			for(int c = last_child[n]; c != -1; c = prev_sibling[c])
+				stack.push_back(c);
+		}
+	}
+
+	// leaves of the subtree of n in preorder
+	void find_leaves(int n, vector<int> &leaves) {
+		vector<int> nodes = vector<int>();
+		find_subtree(n, nodes);
+		for(int i = 0; i < nodes.size(); i++) {
+			if (is_leaf(nodes[i]))
+				leaves.push_back(nodes[i]);
+		}
+	}
+
+	// sibling pairs in the same order as Node::append_sibling_pairs
+	void append_sibling_pairs(int n, deque<int> &sibling_pairs) {
+		int lc = lchild(n);
+		int rc = rchild(n);
+		bool lc_leaf = false;
+		bool rc_leaf = false;
+		if (lc != -1) {
+			if (is_leaf(lc))
+				lc_leaf = true;
+			else
+				append_sibling_pairs(lc, sibling_pairs);
+		}
+		if (rc != -1) {
+			if (is_leaf(rc))
+				rc_leaf = true;
+			else
+				append_sibling_pairs(rc, sibling_pairs);
+		}
+		if (lc_leaf && rc_leaf) {
+			sibling_pairs.push_back(lc);
+			sibling_pairs.push_back(rc);
+		}
+	}
+
+	void find_sibling_pairs(deque<int> &sibling_pairs) {
+		for(int i = 0; i < components.size(); i++)
+			append_sibling_pairs(components[i], sibling_pairs);
+	}
+
+	// singleton leaves, ignoring the first component
+	void find_singletons(vector<int> &singletons) {
+		for(int i = 1; i < components.size(); i++) {
+			if (is_leaf(components[i]))
+				singletons.push_back(components[i]);
+		}
+	}
+
+	void add_rho() {
+		int p = add_node(FLAT_RHO);
+		components.push_back(p);
+		rho = true;
+	}
+
+	// renumber the nodes of each component in preorder
+	void preorder_number() {
+		int next = 0;
+		for(int i = 0; i < components.size(); i++) {
+			vector<int> nodes = vector<int>();
+			find_subtree(components[i], nodes);
+			for(int j = 0; j < nodes.size(); j++)
+				preorder[nodes[j]] = next++;
+		}
+	}
+
+	/* remove a leaf that has no twin and contract its parent
+	 * returns false if that would leave a one leaf component
+	 */
+	bool remove_leaf(int leaf) {
+		int node = parents[leaf];
+		if (node == -1)
+			return false;
+		int numc = num_children[node];
+		if (parents[node] == -1 && is_leaf(lchild(node)) &&
+				(numc == 1 || (numc == 2 && is_leaf(rchild(node)))))
+			return false;
+		cut_parent(leaf);
+		if (num_children[node] < 2)
+			contract(node);
+		return true;
+	}
+
+	// index the leaves by label, the rho leaf is stored separately
+	void find_labelled_leaves(vector<int> &leaves, int *rho_leaf) {
+		for(int i = 0; i < components.size(); i++) {
+			vector<int> component_leaves = vector<int>();
+			find_leaves(components[i], component_leaves);
+			for(int j = 0; j < component_leaves.size(); j++) {
+				int leaf = component_leaves[j];
+				int label = labels[leaf];
+				if (label == FLAT_RHO)
+					*rho_leaf = leaf;
+				else if (label >= 0) {
+					if (label >= leaves.size())
+						leaves.resize(label+1, -1);
+					leaves[label] = leaf;
+				}
+			}
+		}
+	}
+};
+
+// Make the leaves of two forests point to their twin in the other forest
+// Note: removes unique leaves, exactly as sync_twins(Forest *, Forest *)
+bool sync_twins(FlatForest *T1, FlatForest *T2) {
+	T1->twin_forest = T2;
+	T2->twin_forest = T1;
+	vector<int> T1_labels = vector<int>();
+	vector<int> T2_labels = vector<int>();
+	int T1_rho = -1;
+	int T2_rho = -1;
+	T1->find_labelled_leaves(T1_labels, &T1_rho);
+	T2->find_labelled_leaves(T2_labels, &T2_rho);
+	T1_labels.push_back(T1_rho);
+	T2_labels.push_back(T2_rho);
+
+	int size = T1_labels.size();
+	if (size > T2_labels.size())
+		size = T2_labels.size();
+	for(int i = 0; i < size; i++) {
+		int T1_a = T1_labels[i];
+		int T2_a = T2_labels[i];
+		if (T1_a == -1 && T2_a != -1) {
+			if (!T2->remove_leaf(T2_a))
+				return false;
+		}
+		else if (T2_a == -1 && T1_a != -1) {
+			if (!T1->remove_leaf(T1_a))
+				return false;
+		}
+		if (T1_a != -1 && T2_a != -1) {
+			T1->twins[T1_a] = T2_a;
+			T2->twins[T2_a] = T1_a;
+		}
+	}
+	for(int i = size; i < T1_labels.size(); i++) {
+		if (T1_labels[i] != -1 && !T1->remove_leaf(T1_labels[i]))
+			return false;
+	}
+	for(int i = size; i < T2_labels.size(); i++) {
+		if (T2_labels[i] != -1 && !T2->remove_leaf(T2_labels[i]))
+			return false;
+	}
+	return true;
+}
+
+// LCA queries on one component of a FlatForest
+// an euler tour with a sparse table over all of its positions
+class FlatLCA {
+	private:
+	vector<int> E;		// preorder numbers of euler tour
+	vector<int> H;		// first occurence of a node in E
+	vector<int> N;		// preorder to node mapping
+	vector<vector<int> > RMQ;	// precomputed RMQ values
+
+	public:
+	FlatLCA(FlatForest *F, int root) {
+		H = vector<int>(F->size(), -1);
+		euler_tour(F, root);
+		precompute_rmq();
+	}
+
+	void euler_tour(FlatForest *F, int root) {
+		vector<int> stack = vector<int>();
+		vector<int> next_child = vector<int>();
+		visit(root);
+		stack.push_back(root);
+		next_child.push_back(F->first_child[root]);
+		while(!stack.empty()) {
+			int c = next_child.back();
+			if (c == -1) {
+				stack.pop_back();
+				next_child.pop_back();
+				// Middle/Last visit
+				if (!stack.empty())
+					E.push_back(E[H[stack.back()]]);
+			}
+			else {
+				next_child.back() = F->next_sibling[c];
+				visit(c);
+				stack.push_back(c);
+				next_child.push_back(F->first_child[c]);
+			}
+		}
+	}
+
+	void visit(int n) {
+		H[n] = E.size();
+		E.push_back(N.size());
+		N.push_back(n);
+	}
+
+	void precompute_rmq() {
+		RMQ.push_back(E);
+		for(int k = 1; (1 << k) <= E.size(); k++) {
+			vector<int> &prev = RMQ[k-1];
+			int half = 1 << (k-1);
+			vector<int> V = vector<int>(E.size() - (1 << k) + 1);
+			for(int i = 0; i < V.size(); i++)
+				V[i] = min(prev[i], prev[i + half]);
+			RMQ.push_back(V);
+		}
+	}
+
+	int get_lca(int a, int b) {
+		int i = H[a];
+		int j = H[b];
+		if (i > j)
+			swap(i, j);
+		int k = mylog2(j - i + 1);
+		return N[min(RMQ[k][i], RMQ[k][j - (1 << k) + 1])];
+	}
+};
+
+/* restrictions of a tree to the leaf sets of other trees
+ * The tree is flattened and preprocessed for LCA queries once. Each
+ * restriction is then built from the shared leaves and the LCAs of
+ * consecutive shared leaves in preorder, in O(m log m) time for m
+ * shared leaves, instead of copying the whole tree and pruning it
+ * with sync_twins.
+ */
+class FlatProjection {
+	private:
+	FlatForest T;
+	FlatLCA T_LCA;
+	vector<int> subtree_end;	// last node in the subtree of each node
+	vector<int> leaf_by_label;	// leaf with each label, -1 if none
+	bool exact;
+
+	public:
+	FlatProjection(Node *tree) : T(tree), T_LCA(&T, T.get_component(0)) {
+		// node numbers are preorder positions so subtrees are intervals
+		subtree_end = vector<int>(T.size());
+		for(int n = T.size() - 1; n >= 0; n--) {
+			int last = T.last_child[n];
+			subtree_end[n] = (last == -1) ? n : subtree_end[last];
+		}
+		/* pruning would carry protected edges, sibling restrictions,
+		 * unlabelled leaves and the rho leaf differently, so only
+		 * handle trees without them
+		 */
+		exact = true;
+		for(int n = 0; n < T.size(); n++) {
+			if (T.flags[n] != 0)
+				exact = false;
+			if (!T.is_leaf(n))
+				continue;
+			int label = T.labels[n];
+			if (label < 0) {
+				exact = false;
+				continue;
+			}
+			if (label >= leaf_by_label.size())
+				leaf_by_label.resize(label + 1, -1);
+			if (leaf_by_label[label] != -1)
+				exact = false;
+			leaf_by_label[label] = n;
+		}
+	}
+
+	// true if project gives the same tree as sync_twins would
+	bool is_exact() {
+		return exact;
+	}
+
+	/* build the tree restricted to the leaves it shares with other
+	 * Nodes keep the preorder numbers they have in the tree. Returns
+	 * NULL if there are fewer than two shared leaves.
+	 */
+	Node *project(Node *other) {
+		vector<Node *> other_leaves = other->find_leaves();
+		vector<int> nodes = vector<int>();
+		for(int i = 0; i < other_leaves.size(); i++) {
+			int label = other_leaves[i]->get_min_label();
+			if (label < leaf_by_label.size() && leaf_by_label[label] != -1)
+				nodes.push_back(leaf_by_label[label]);
+		}
+		sort(nodes.begin(), nodes.end());
+		nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+		int num_leaves = nodes.size();
+		if (num_leaves < 2)
+			return NULL;
+		for(int i = 1; i < num_leaves; i++)
+			nodes.push_back(T_LCA.get_lca(nodes[i-1], nodes[i]));
+		sort(nodes.begin(), nodes.end());
+		nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+
+		// the first node is the root, attach the rest in preorder
+		vector<int> path = vector<int>();
+		vector<Node *> path_nodes = vector<Node *>();
+		Node *root = NULL;
+		for(int i = 0; i < nodes.size(); i++) {
+			int n = nodes[i];
+			Node *node = T.new_node(n);
+			node->set_preorder_number(T.preorder[n]);
+			while (!path.empty() && subtree_end[path.back()] < n) {
+				path.pop_back();
+				path_nodes.pop_back();
+			}
+			if (path.empty()) {
+				root = node;
+				node->set_depth(0);
+			}
+			else {
+				path_nodes.back()->add_child(node);
+				node->set_depth(path_nodes.back()->get_depth() + 1);
+			}
+			path.push_back(n);
+			path_nodes.push_back(node);
+		}
+		return root;
+	}
+};
+
+/* make interior nodes of the first components point to the lca of
+ * their descendants in the other forest
+ * assumes that sync_twins has already been called
+ */
+void sync_interior_twins(FlatForest *T1, FlatForest *T2) {
+	FlatForest *forests[2] = {T1, T2};
+	FlatLCA T1_LCA = FlatLCA(T1, T1->get_component(0));
+	FlatLCA T2_LCA = FlatLCA(T2, T2->get_component(0));
+	FlatLCA *twin_LCAs[2] = {&T2_LCA, &T1_LCA};
+	for(int f = 0; f < 2; f++) {
+		FlatForest *F = forests[f];
+		vector<int> nodes = vector<int>();
+		F->find_subtree(F->get_component(0), nodes);
+		// children before parents
+		for(int i = nodes.size() - 1; i >= 0; i--) {
+			int n = nodes[i];
+			int c = F->first_child[n];
+			if (c == -1)
+				continue;
+			int twin = F->twins[c];
+			for(c = F->next_sibling[c]; c != -1; c = F->next_sibling[c]) {
+				if (twin == -1)
+					twin = F->twins[c];
+				else if (F->twins[c] != -1)
+					twin = twin_LCAs[f]->get_lca(twin, F->twins[c]);
+			}
+			F->twins[n] = twin;
+		}
+	}
+}
+
+// count the nodes below n whose cluster is not in the other forest
+int count_differing_bipartitions(FlatForest *F, int n) {
+	vector<int> nodes = vector<int>();
+	F->find_subtree(n, nodes);
+	int count = 0;
+	for(int i = 0; i < nodes.size(); i++) {
+		int twin = F->twins[nodes[i]];
+		if (twin == -1 || F->twin_forest->twins[twin] != nodes[i])
+			count++;
+	}
+	return count;
+}
+
+// Robinson-Foulds distance, destructive
+int rf_distance(FlatForest *F1, FlatForest *F2) {
+	if (!sync_twins(F1, F2))
+		return 0;
+	if (F1->is_leaf(F1->get_component(0)))
+		return 0;
+	sync_interior_twins(F1, F2);
+	int rf_d = 0;
+	rf_d += count_differing_bipartitions(F1, F1->get_component(0));
+	rf_d += count_differing_bipartitions(F2, F2->get_component(0));
+	return rf_d;
+}
+
+#endif
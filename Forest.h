@@ -32,12 +32,15 @@ along with rspr.  If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
 #include <string>
 #include <cstring>
+#include <climits>
 #include <iostream>
 #include <sstream>
 #include <math.h>
 #include <vector>
 #include <list>
 #include <deque>
+#include <algorithm>
+#include "NodeArena.h"
 #include "Node.h"
 #include "LCA.h"
 #include <map>
@@ -58,8 +61,20 @@ class Forest {
 		bool rho;
 		Forest *twin;
 		ClusterInstance *cluster;
+		/* positions of the labelled leaves in increasing order of label,
+		 * in the order find_leaves lists the leaves, and their labels.
+		 * Kept by copies and checked before each use
+		 */
+		vector<int> sorted_leaf_positions;
+		vector<int> sorted_leaf_labels;
 
 	public:
+	static void *operator new(size_t size) {
+		return NodeArena::allocate(size);
+	}
+	static void operator delete(void *p) {
+		NodeArena::release(p);
+	}
 	Forest() {
 		init(vector<Node *>());
 	}
@@ -84,6 +99,8 @@ class Forest {
 		rho = f.rho;
 		twin = NULL;
 		cluster = f.cluster;
+		sorted_leaf_positions = f.sorted_leaf_positions;
+		sorted_leaf_labels = f.sorted_leaf_labels;
 		//label_nodes_with_forest();
 	}
 
@@ -97,6 +114,8 @@ class Forest {
 		rho = f->rho;
 		twin = NULL;
 		cluster = f->cluster;
+		sorted_leaf_positions = f->sorted_leaf_positions;
+		sorted_leaf_labels = f->sorted_leaf_labels;
 		//label_nodes_with_forest();
 	}
 
@@ -110,6 +129,8 @@ class Forest {
 		rho = f->rho;
 		twin = NULL;
 		cluster = f->cluster;
+		sorted_leaf_positions = f->sorted_leaf_positions;
+		sorted_leaf_labels = f->sorted_leaf_labels;
 		//label_nodes_with_forest();
 	}
 
@@ -119,7 +140,7 @@ class Forest {
 		deleted_nodes = vector<Node *>();
 		rho = false;
 		for(int i = 0; i < components.size(); i++) {
-				if (components[i]->str() == "p")
+				if (components[i]->is_rho())
 					rho = true;
 		}
 		twin = NULL;
@@ -159,6 +180,9 @@ class Forest {
 		ClusterInstance *c_temp = this->cluster;
 		this->cluster = f->cluster;
 		f->cluster = c_temp;
+
+		this->sorted_leaf_positions.swap(f->sorted_leaf_positions);
+		this->sorted_leaf_labels.swap(f->sorted_leaf_labels);
 	}
 
 	// print the forest
@@ -371,6 +395,103 @@ bool contains_rho() {
 	return rho;
 }
 
+// add the leaves of the forest to leaves, component by component
+void find_leaves(vector<Node *> &leaves) {
+	for(int i = 0; i < components.size(); i++) {
+		if (components[i]->is_leaf())
+			leaves.push_back(components[i]);
+		else
+			components[i]->find_leaves_hlpr(leaves);
+	}
+}
+
+/* set leaves to the labelled leaves in increasing order of label,
+ * labels to their labels and positions to where they are in the order
+ * of find_leaves. Of leaves with the same label only the last is used.
+ * The leaves are only sorted again if they no longer have the labels of
+ * sorted_leaf_labels
+ * RETURN the rho leaf or NULL and set rho_position to its position
+ */
+Node *find_sorted_leaves(vector<Node *> &leaves, vector<int> &labels,
+		vector<int> &positions, int &rho_position) {
+	vector<Node *> all_leaves = vector<Node *>();
+	find_leaves(all_leaves);
+	vector<int> leaf_labels = vector<int>(all_leaves.size());
+	Node *rho_leaf = NULL;
+	rho_position = -1;
+	int num_labelled = 0;
+	for(int i = 0; i < all_leaves.size(); i++) {
+		leaf_labels[i] = INT_MAX;
+		if (all_leaves[i]->is_rho()) {
+			rho_leaf = all_leaves[i];
+			rho_position = i;
+		}
+		else
+			leaf_labels[i] = all_leaves[i]->get_min_label();
+		if (leaf_labels[i] < INT_MAX)
+			num_labelled++;
+	}
+	bool sorted = (sorted_leaf_positions.size() == num_labelled);
+	for(int i = 0; sorted && i < sorted_leaf_positions.size(); i++) {
+		int p = sorted_leaf_positions[i];
+		if (p >= leaf_labels.size() || leaf_labels[p] != sorted_leaf_labels[i])
+			sorted = false;
+	}
+	if (!sorted) {
+		vector<pair<int, int> > order = vector<pair<int, int> >();
+		for(int i = 0; i < all_leaves.size(); i++) {
+			if (leaf_labels[i] < INT_MAX)
+				order.push_back(make_pair(leaf_labels[i], i));
+		}
+		sort(order.begin(), order.end());
+		sorted_leaf_positions.clear();
+		sorted_leaf_labels.clear();
+		for(int i = 0; i < order.size(); i++) {
+			if (i + 1 < order.size() && order[i+1].first == order[i].first)
+				continue;
+			sorted_leaf_labels.push_back(order[i].first);
+			sorted_leaf_positions.push_back(order[i].second);
+		}
+	}
+	labels = sorted_leaf_labels;
+	positions = sorted_leaf_positions;
+	leaves.resize(positions.size());
+	for(int i = 0; i < positions.size(); i++) {
+		leaves[i] = all_leaves[positions[i]];
+	}
+	return rho_leaf;
+}
+
+/* update the sorted leaves after sync_twins removed some of them.
+ * labels and positions are from find_sorted_leaves, kept marks the
+ * leaves that were not removed and removed_rho is the position of a
+ * removed rho leaf or -1. Removing leaves and contracting nodes keeps
+ * the order of the other leaves so only their positions change
+ */
+void keep_sorted_leaves(vector<int> &labels, vector<int> &positions,
+		vector<bool> &kept, int removed_rho) {
+	vector<int> removed = vector<int>();
+	for(int i = 0; i < positions.size(); i++) {
+		if (!kept[i])
+			removed.push_back(positions[i]);
+	}
+	if (removed_rho >= 0)
+		removed.push_back(removed_rho);
+	if (removed.empty())
+		return;
+	sort(removed.begin(), removed.end());
+	sorted_leaf_positions.clear();
+	sorted_leaf_labels.clear();
+	for(int i = 0; i < positions.size(); i++) {
+		if (!kept[i])
+			continue;
+		int num_before = lower_bound(removed.begin(), removed.end(),
+				positions[i]) - removed.begin();
+		sorted_leaf_positions.push_back(positions[i] - num_before);
+		sorted_leaf_labels.push_back(labels[i]);
+	}
+}
+
 void erase_components(int start, int end) {
 	components.erase(components.begin()+start, components.begin()+end);
 }
@@ -398,194 +519,169 @@ void unprotect_edges() {
 
 };
 
+/* per-node lists used by sync_interior_twins_real, kept outside of
+	 the nodes and only allocated while it runs
+	 * T1 nodes are indexed by their preorder position in T1_LCA and
+	 	 F2 nodes by component and preorder position in F2_LCAs
+	 * nodes that are not in those trees get a list from a map
+	 */
+class SyncInteriorState {
+	private:
+	LCA *T1_LCA;
+	vector<LCA> *F2_LCAs;
+	// active descendants of each T1 node
+	vector<list<Node *> > active_descendants;
+	// roots of F2 that map to each T1 node
+	vector<list<Node *> > root_lcas;
+	// removable descendants of each F2 node by component
+	vector<vector<list<list<Node *>::iterator> > > removable_descendants;
+	map<Node *, list<Node *> > other_active_descendants;
+	map<Node *, list<Node *> > other_root_lcas;
+	map<Node *, list<list<Node *>::iterator> > other_removable_descendants;
+
+	public:
+	SyncInteriorState(LCA *T1_LCA, vector<LCA> *F2_LCAs) {
+		this->T1_LCA = T1_LCA;
+		this->F2_LCAs = F2_LCAs;
+		active_descendants.resize(T1_LCA->size());
+		root_lcas.resize(T1_LCA->size());
+	}
+
+	// make room for the component most recently added to F2_LCAs
+	void add_component() {
+		removable_descendants.resize(F2_LCAs->size());
+		removable_descendants.back().resize(F2_LCAs->back().size());
+	}
+
+	list<Node *> *get_active_descendants(Node *n) {
+		int i = T1_LCA->get_index(n);
+		if (i == -1)
+			return &other_active_descendants[n];
+		return &active_descendants[i];
+	}
+
+	list<Node *> *get_root_lcas(Node *n) {
+		int i = T1_LCA->get_index(n);
+		if (i == -1)
+			return &other_root_lcas[n];
+		return &root_lcas[i];
+	}
+
+	list<list<Node *>::iterator> *get_removable_descendants(Node *n) {
+		int c = n->get_component_number();
+		if (c >= 0 && c < removable_descendants.size()) {
+			int i = (*F2_LCAs)[c].get_index(n);
+			if (i != -1 && i < removable_descendants[c].size())
+				return &removable_descendants[c][i];
+		}
+		return &other_removable_descendants[n];
+	}
+};
+
 // Functions
 
 vector<Node *> find_labels(vector<Node *> components);
 bool sync_twins(Forest *T1, Forest *T2);
+bool remove_unsynced_leaf(Node *leaf);
 void sync_interior_twins(Forest *T1, Forest *T2);
+void sync_interior_twins(Forest *T1, Forest *T2, LCA *T2_tree_LCA);
 void sync_interior_twins(Node *n, LCA *twin_LCA);
-void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs);
+void find_twin_intervals(Node *n, LCA *twin_LCA, vector<Node *> &interior,
+		vector<int> &from, vector<int> &to, int &lo, int &hi);
+void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs,
+		SyncInteriorState *state);
 list<Node *> *find_cluster_points(Forest *F1, Forest *F2);
 void find_cluster_points(Node *n, list<Node *> *cluster_points,
 		vector<int> *leaf_counts_F1, vector<int> *leaf_counts_F2);
 void delete_and_merge_LCAs(list<Node *> *active_descendants,
 		vector<LCA> *F2_LCAs, list<Node *>:: iterator node1_location,
-		list<Node *>:: iterator node2_location);
+		list<Node *>:: iterator node2_location, SyncInteriorState *state);
 void delete_and_merge_LCAs(Node *n, list<Node *> *active_descendants,
-		vector<LCA> *F2_LCAs);
+		vector<LCA> *F2_LCAs, SyncInteriorState *state);
 
 
 
 // Make the leaves of two forests point to their twin in the other tree
 // Note: removes unique leaves
 bool sync_twins(Forest *T1, Forest *T2) {
-	vector<Node *> T1_labels = vector<Node *>();
-	vector<Node *> T2_labels = vector<Node *>();
-	vector<Node *> T1_components = T1->components;
-	vector<Node *> T2_components = T2->components;
-	vector<Node *>::iterator i;
-	Node *T1_rho = NULL;
-	Node *T2_rho = NULL;
-	for(i = T1_components.begin(); i != T1_components.end(); i++) {
-		Node *component = *i;
-		vector<Node *> unsorted_labels = component->find_leaves();
-		vector<Node *>::iterator j;
-		for(j = unsorted_labels.begin(); j != unsorted_labels.end(); j++) {
-			Node *leaf = *j;
-//			cout << "T1: " << leaf->str() << endl;
-			if (leaf->str() == "p") {
-				T1_rho = leaf;
-			}
-			else {
-				// find smallest number contained in the label
-				int number = stomini(leaf->str());
-//				cout << "\t" << number << endl;
-				if (number < INT_MAX) {
-					if (number >= T1_labels.size())
-						T1_labels.resize(number+1, 0);
-					T1_labels[number] = leaf;
-				}
-			}
-		}
-	}
-	for(i = T2_components.begin(); i != T2_components.end(); i++) {
-		Node *component = *i;
-		vector<Node *> unsorted_labels = component->find_leaves();
-		vector<Node *>::iterator j;
-		for(j = unsorted_labels.begin(); j != unsorted_labels.end(); j++) {
-			Node *leaf = *j;
-//			cout << "T2: " << leaf->str() << endl;
-			if (leaf->str() == "p") {
-				T2_rho = leaf;
-			}
-			else {
-				// find smallest number contained in the label
-				int number = stomini(leaf->str());
-//				cout << "\t" << number << endl;
-				if (number < INT_MAX) {
-					if (number >= T2_labels.size())
-						T2_labels.resize(number+1, 0);
-					T2_labels[number] = leaf;
-				}
-			}
-		}
-	}
-	T1_labels.resize(T1_labels.size()+1);
-	T1_labels[T1_labels.size()-1]=T1_rho;
-	T2_labels.resize(T2_labels.size()+1);
-	T2_labels[T2_labels.size()-1]=T2_rho;
-
-	int size = T1_labels.size();
-	if (size > T2_labels.size())
-		size = T2_labels.size();
-//	cout << "Syncing Twins" << endl;
-	for(int i = 0; i < size; i++) {
-		Node *T1_a = T1_labels[i];
-		Node *T2_a = T2_labels[i];
-		if (T1_a == NULL && T2_a != NULL) {
-			Node *node = T2_a->parent();
-			if (node == NULL)
+	vector<Node *> T1_leaves = vector<Node *>();
+	vector<Node *> T2_leaves = vector<Node *>();
+	vector<int> T1_labels = vector<int>();
+	vector<int> T2_labels = vector<int>();
+	vector<int> T1_positions = vector<int>();
+	vector<int> T2_positions = vector<int>();
+	int T1_rho_position;
+	int T2_rho_position;
+	Node *T1_rho = T1->find_sorted_leaves(T1_leaves, T1_labels,
+			T1_positions, T1_rho_position);
+	Node *T2_rho = T2->find_sorted_leaves(T2_leaves, T2_labels,
+			T2_positions, T2_rho_position);
+	// the leaves that are kept, to update the sorted leaves
+	vector<bool> T1_kept = vector<bool>(T1_leaves.size(), false);
+	vector<bool> T2_kept = vector<bool>(T2_leaves.size(), false);
+
+	// both lists are in increasing order of label so merge them
+	int i = 0;
+	int j = 0;
+	while (i < T1_leaves.size() || j < T2_leaves.size()) {
+		if (j == T2_leaves.size()
+				|| (i < T1_leaves.size() && T1_labels[i] < T2_labels[j])) {
+			if (!remove_unsynced_leaf(T1_leaves[i]))
 				return false;
-			int numc = node->get_children().size();
-			if (node->parent() == NULL && node->lchild()->is_leaf() &&
-					(numc == 1 || (numc == 2 && node->rchild()->is_leaf()))) {
-				return false;
-				Node *sibling = node->lchild();
-				if (sibling == T2_a)
-						sibling = node->rchild();
-				T2_labels[stomini(sibling->str())] = sibling;
-			}
-			delete T2_a;
-			if (node->get_children().size() < 2) {
-				if (node->get_children().size() == 1)
-					node->lchild()->lost_child();
-				node = node->contract(true);
-			}
+			i++;
 		}
-		else if (T2_a == NULL && T1_a != NULL) {
-			Node *node = T1_a->parent();
-			if (node == NULL)
+		else if (i == T1_leaves.size() || T2_labels[j] < T1_labels[i]) {
+			if (!remove_unsynced_leaf(T2_leaves[j]))
 				return false;
-			int numc = node->get_children().size();
-			if (node->parent() == NULL && node->lchild()->is_leaf() &&
-					(numc == 1 || (numc == 2 && node->rchild()->is_leaf()))) {
-				return false;
-				Node *sibling = node->lchild();
-				if (sibling == T1_a)
-						sibling = node->rchild();
-				T1_labels[stomini(sibling->str())] = sibling;
-			}
-			delete T1_a;
-			if (node->get_children().size() < 2) {
-				if (node->get_children().size() == 1)
-					node->lchild()->lost_child();
-				node = node->contract(true);
-			}
-			
+			j++;
 		}
-		if (T1_a != NULL && T2_a != NULL) {
-			T1_a->set_twin(T2_a);
-			T2_a->set_twin(T1_a);
-//			cout << T1_a->str() << endl;
+		else {
+			T1_leaves[i]->set_twin(T2_leaves[j]);
+			T2_leaves[j]->set_twin(T1_leaves[i]);
+			T1_kept[i++] = true;
+			T2_kept[j++] = true;
 		}
 	}
-	for(int i = size; i < T1_labels.size(); i++) {
-		Node *T1_a = T1_labels[i];
-		if (T1_a != NULL) {
-			Node *node = T1_a->parent();
-			if (node == NULL)
-				return false;
-			int numc = node->get_children().size();
-			if (node->parent() == NULL && node->lchild()->is_leaf() &&
-					(numc == 1 || (numc == 2 && node->rchild()->is_leaf()))) {
-				return false;
-				Node *sibling = node->lchild();
-				if (sibling == T1_a)
-						sibling = node->rchild();
-				T1_labels[stomini(sibling->str())] = sibling;
-			}
-			delete T1_a;
-			if (node->get_children().size() < 2) {
-				if (node->get_children().size() == 1)
-					node->lchild()->lost_child();
-				node = node->contract(true);
-			}
-			
-		}
+	// rho comes after every label
+	if (T1_rho != NULL && T2_rho != NULL) {
+		T1_rho->set_twin(T2_rho);
+		T2_rho->set_twin(T1_rho);
 	}
-	for(int i = size; i < T2_labels.size(); i++) {
-		Node *T2_a = T2_labels[i];
-		if (T2_a != NULL) {
-			Node *node = T2_a->parent();
-			if (node == NULL)
-				return false;
-			int numc = node->get_children().size();
-			if (node->parent() == NULL && node->lchild()->is_leaf() &&
-					(numc == 1 || (numc == 2 && node->rchild()->is_leaf()))) {
-				return false;
-				Node *sibling = node->lchild();
-				if (sibling == T2_a)
-						sibling = node->rchild();
-				T2_labels[stomini(sibling->str())] = sibling;
-			}
-			delete T2_a;
-			if (node->get_children().size() < 2) {
-				if (node->get_children().size() == 1)
-					node->lchild()->lost_child();
-				node = node->contract(true);
-			}
-		}
+	else if (T1_rho != NULL) {
+		if (!remove_unsynced_leaf(T1_rho))
+			return false;
+		T1_rho = NULL;
 	}
-//	if (T1_loss != NULL)
-//		*T1_loss = T1->get_component(0)->count_lost_children_subtree();
-//		- T1->get_component(0)->num_lost_children();;
-//	cout << "T1_lost = " << T1_lost << endl;
-//	if (T2_loss != NULL)
-//		*T2_loss = T2->get_component(0)->count_lost_children_subtree();
-//		- T2->get_component(0)->num_lost_children();;
-//	cout << "T2_lost = " << T2_lost << endl;
+	else if (T2_rho != NULL) {
+		if (!remove_unsynced_leaf(T2_rho))
+			return false;
+		T2_rho = NULL;
+	}
+	T1->keep_sorted_leaves(T1_labels, T1_positions, T1_kept,
+			T1_rho == NULL ? T1_rho_position : -1);
+	T2->keep_sorted_leaves(T2_labels, T2_positions, T2_kept,
+			T2_rho == NULL ? T2_rho_position : -1);
+	return true;
+}
 
-//	cout << "Finished Syncing Twins" << endl;
+/* remove a leaf that is not in the other forest and contract its parent
+ * returns false, without removing it, if its component would be left
+ * with fewer than two leaves
+ */
+bool remove_unsynced_leaf(Node *leaf) {
+	Node *node = leaf->parent();
+	if (node == NULL)
+		return false;
+	int numc = node->get_children().size();
+	if (node->parent() == NULL && node->lchild()->is_leaf() &&
+			(numc == 1 || (numc == 2 && node->rchild()->is_leaf())))
+		return false;
+	delete leaf;
+	if (node->get_children().size() < 2) {
+		if (node->get_children().size() == 1)
+			node->lchild()->lost_child();
+		node = node->contract(true);
+	}
 	return true;
 }
 
@@ -597,10 +693,19 @@ bool sync_twins(Forest *T1, Forest *T2) {
 	  matching multiple components of T2 (The first several components?)
    */
 void sync_interior_twins(Forest *T1, Forest *T2) {
+	sync_interior_twins(T1, T2, NULL);
+}
+
+/* T2_tree_LCA, if not NULL, is the LCA of the tree T2 was copied from
+ * and is used instead of building one for T2 when T2 still matches it
+ */
+void sync_interior_twins(Forest *T1, Forest *T2, LCA *T2_tree_LCA) {
 	Node  *root1 = T1->get_component(0);
 	Node  *root2 = T2->get_component(0);
 	LCA T1_LCA = LCA(root1);
-	LCA T2_LCA = LCA(root2);
+	LCA T2_LCA = LCA();
+	if (T2_tree_LCA == NULL || !T2_LCA.bind(T2_tree_LCA, root2))
+		T2_LCA = LCA(root2);
 	sync_interior_twins(root1, &T2_LCA);
 	sync_interior_twins(root2, &T1_LCA);
 }
@@ -622,10 +727,9 @@ void sync_interior_twins_real(Forest *T1, Forest *F2) {
 	vector<Node *> F2_roots = vector<Node *>();
 	// LCA queries for F2
 	vector<LCA> F2_LCAs = vector<LCA>();
-	// lists of root nodes that map to a given T1 node
-	T1_root->initialize_root_lcas(list<Node *>());
-	// list of active descendants
-	T1_root->initialize_active_descendants(list<Node *>());
+	// lists of active descendants and of root nodes that map to a
+	// given T1 node, and removable descendants of F2 nodes
+	SyncInteriorState state = SyncInteriorState(&T1_LCA, &F2_LCAs);
 
 	// should be fine.
 	for(int i = 0; i < F2->num_components(); i++) {
@@ -655,20 +759,21 @@ void sync_interior_twins_real(Forest *T1, Forest *F2) {
 //		}
 //		cout << "foo" << endl;
 		// ignore rho components
-		if (F2_roots[i]->str() == "p") {
+		if (F2_roots[i]->is_rho()) {
 		//	F2_LCAs.push_back(LCA());
 		F2_LCAs.push_back(F2_roots[i]);
 		//F2_LCAs.push_back(NULL);//LCA(F2_roots[i]));
+		state.add_component();
 			continue;
 		}
 //		cout << "aa" << endl;
 		F2_LCAs.push_back(LCA(F2_roots[i]));
+		// list of nodes that get deleted when a component is finished
+		state.add_component();
 		// number the component
 		F2_roots[i]->initialize_component_number(i);
-		// list of nodes that get deleted when a component is finished
-		F2_roots[i]->initialize_removable_descendants(list<list<Node *>::iterator>());
 		// sync the component with T1
-		if (F2_roots[i]->str() != "p" &&
+		if (!F2_roots[i]->is_rho() &&
 				!(F2_roots[i]->get_twin() != NULL && F2_roots[i]->get_twin()->parent() == NULL)) {
 			sync_interior_twins(F2_roots[i], &T1_LCA);
 		}
@@ -684,13 +789,13 @@ void sync_interior_twins_real(Forest *T1, Forest *F2) {
 		cout << boost::any_cast<list<Node *> >(F2_roots[i]->get_twin()->get_parameter_ref(ROOT_LCAS))->size() << endl;
 		*/
 		if (i > 0 || T1->contains_rho())
-			F2_roots[i]->get_twin()->get_root_lcas()->push_back(F2_roots[i]);
+			state.get_root_lcas(F2_roots[i]->get_twin())->push_back(F2_roots[i]);
 		else
-			T1_root->get_root_lcas()->push_back(F2_roots[i]);
+			state.get_root_lcas(T1_root)->push_back(F2_roots[i]);
 //		cout << "b" << endl;
 	}
 //	cout << "syncing" << endl;
-	sync_interior_twins(T1_root, &F2_LCAs); 
+	sync_interior_twins(T1_root, &F2_LCAs, &state);
 }
 
 /* make interior nodes point to the lca of their descendants in the other
@@ -698,28 +803,65 @@ void sync_interior_twins_real(Forest *T1, Forest *F2) {
  * assumes that sync_twins has already been called
  */
 void sync_interior_twins(Node *n, LCA *twin_LCA) {
-	list<Node *>::iterator c = n->get_children().begin();
-	if (c == n->get_children().end())
+	if (n->is_leaf())
 		return;
-	sync_interior_twins(*c, twin_LCA);
-	n->set_twin((*c)->get_twin());
-	c++;
-	while(c != n->get_children().end()) {
-		sync_interior_twins(*c, twin_LCA);
-		Node *twin = twin_LCA->get_lca(n->get_twin(), (*c)->get_twin());
-		n->set_twin(twin);
-		c++;
+	/* the lca of the twins of the leaves below a node spans the tour
+	 * from the first of them to the last, so the queries for all nodes
+	 * are independent and can be made at once
+	 */
+	vector<Node *> interior = vector<Node *>();
+	vector<int> from = vector<int>();
+	vector<int> to = vector<int>();
+	int lo, hi;
+	find_twin_intervals(n, twin_LCA, interior, from, to, lo, hi);
+	vector<Node *> twins = vector<Node *>();
+	twin_LCA->get_lcas(from, to, twins);
+	for(int i = 0; i < interior.size(); i++) {
+		interior[i]->set_twin(twins[i]);
+	}
+}
+
+/* add each interior node below n and the tour positions of the first
+ * and last twin of its leaves in twin_LCA to interior, from and to.
+ * lo and hi are set to the positions for n
+ */
+void find_twin_intervals(Node *n, LCA *twin_LCA, vector<Node *> &interior,
+		vector<int> &from, vector<int> &to, int &lo, int &hi) {
+	lo = INT_MAX;
+	hi = -1;
+	if (n->is_leaf()) {
+		if (n->get_twin() != NULL) {
+			lo = twin_LCA->tour_position(n->get_twin());
+			hi = lo;
+		}
+		return;
+	}
+	int i = interior.size();
+	interior.push_back(n);
+	from.push_back(0);
+	to.push_back(0);
+	list<Node *>::iterator c;
+	for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
+		int c_lo, c_hi;
+		find_twin_intervals(*c, twin_LCA, interior, from, to, c_lo, c_hi);
+		if (c_lo < lo)
+			lo = c_lo;
+		if (c_hi > hi)
+			hi = c_hi;
 	}
+	from[i] = lo;
+	to[i] = hi;
 }
 
-void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs) {
+void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs,
+		SyncInteriorState *state) {
 	Node *lc = n->lchild();
 	Node *rc = n->rchild();
-	list<Node *> *active_descendants = n->get_active_descendants();
+	list<Node *> *active_descendants = state->get_active_descendants(n);
 	// visit children first
 	list<Node *>::iterator c;
 	for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
-		sync_interior_twins(*c, F2_LCAs);
+		sync_interior_twins(*c, F2_LCAs, state);
 	}
 	#ifdef DEBUG_SYNC
 	cout << "SYNC_INTERIOR_TWINS()" << endl;
@@ -730,22 +872,22 @@ void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs) {
 		active_descendants->push_back(n->get_twin());
 		list<Node *>::iterator node_location = active_descendants->end();
 		node_location--;
-			n->get_twin()->get_removable_descendants()->push_back(node_location);
+			state->get_removable_descendants(n->get_twin())->push_back(node_location);
 	}
 	// no rc so propogate up
 	if (n->get_children().size() == 1) {
 		Node *lc = n->get_children().front();
 //		cout << "no rc" << endl;
 		n->set_twin(lc->get_twin());
-		list<Node *> *lc_active_descendants = lc->get_active_descendants();
+		list<Node *> *lc_active_descendants = state->get_active_descendants(lc);
 		active_descendants->splice(active_descendants->end(),*lc_active_descendants);
 	}
 	// TODO: generalize from here for 2 or more children
 	// two children so put their info together
 	else if (lc != NULL && rc != NULL) {
 //		cout << "two children" << endl;
-		list<Node *> *lc_active_descendants = lc->get_active_descendants();
-		list<Node *> *rc_active_descendants = rc->get_active_descendants();
+		list<Node *> *lc_active_descendants = state->get_active_descendants(lc);
+		list<Node *> *rc_active_descendants = state->get_active_descendants(rc);
 
 /*	#ifdef DEBUG_SYNC
 	cout << "active_descendants lc" << endl;
@@ -766,7 +908,7 @@ void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs) {
 		list<Node *>::iterator node1_location;
 		int nonempty_active_descendants_count = 0;
 		for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
-			if (!(*c)->get_active_descendants()->empty()) {
+			if (!state->get_active_descendants(*c)->empty()) {
 				nonempty_active_descendants_count++;
 				if (nonempty_active_descendants_count > 1) {
 					node1_location = active_descendants->end();
@@ -775,7 +917,7 @@ void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs) {
 				}
 //		cout << active_descendants->size() << endl;
 				active_descendants->splice(active_descendants->end(),
-						*((*c)->get_active_descendants()));
+						*(state->get_active_descendants(*c)));
 //		cout << active_descendants->size() << endl;
 			}
 		}
@@ -792,7 +934,7 @@ void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs) {
 			list<Node *>::iterator node2_location = node1_location;
 			node2_location++;
 			delete_and_merge_LCAs(active_descendants, F2_LCAs, node1_location,
-					node2_location);
+					node2_location, state);
 		}
 		#ifdef DEBUG_SYNC
 		cout << "done first merge" << endl;
@@ -802,7 +944,7 @@ void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs) {
 			 if so, then remove each leaf twinned by that component
 			 and check each of the new intersection points
 		*/
-		list<Node *> *root_lcas = n->get_root_lcas();
+		list<Node *> *root_lcas = state->get_root_lcas(n);
 		while(!root_lcas->empty()) {
 
 			Node *root_lca = root_lcas->front();
@@ -815,7 +957,8 @@ void sync_interior_twins(Node *n, vector<LCA> *F2_LCAs) {
 			#ifdef DEBUG_SYNC
 			cout << "deleting from component " << endl;
 			#endif
-				delete_and_merge_LCAs(root_lca, active_descendants, F2_LCAs);
+				delete_and_merge_LCAs(root_lca, active_descendants, F2_LCAs,
+						state);
 			}
 		}
 		#ifdef DEBUG_SYNC
@@ -858,7 +1001,7 @@ void sync_af_twins(Forest *F1, Forest *F2) {
 	 */
 void delete_and_merge_LCAs(list<Node *> *active_descendants,
 		vector<LCA> *F2_LCAs, list<Node *>:: iterator node1_location,
-		list<Node *>:: iterator node2_location) {
+		list<Node *>:: iterator node2_location, SyncInteriorState *state) {
 #ifdef DEBUG_SYNC
 	cout << "DELETE_AND_MERGE FIRST" << endl;
 	cout << "active_descendants before" << endl;
@@ -905,8 +1048,12 @@ void delete_and_merge_LCAs(list<Node *> *active_descendants,
 
 // TODO: could this be faster?
 		bool remove = false;
+		list<list<Node *>::iterator> *n1_removable_descendants =
+				state->get_removable_descendants(n1);
+		list<list<Node *>::iterator> *n2_removable_descendants =
+				state->get_removable_descendants(n2);
 		list<list<Node *>::iterator>::iterator i;
-		for(i = n1->get_removable_descendants()->begin(); i != n1->get_removable_descendants()->end(); i++) {
+		for(i = n1_removable_descendants->begin(); i != n1_removable_descendants->end(); i++) {
 			if (*i == node1_location) {
 				//active_descendants->erase(*i);
 				remove = true;
@@ -915,7 +1062,7 @@ void delete_and_merge_LCAs(list<Node *> *active_descendants,
 		}
 		if (remove) {
 			active_descendants->erase(*i);
-			n1->get_removable_descendants()->erase(i);
+			n1_removable_descendants->erase(i);
 		}
 //		n1->get_removable_descendants()->clear();
 		// TODO: delete each when clearing?
@@ -923,7 +1070,7 @@ void delete_and_merge_LCAs(list<Node *> *active_descendants,
 //		active_descendants->erase(node2_location);
 //		cout << "xe" << endl;
 		remove = false;
-		for(i = n2->get_removable_descendants()->begin(); i != n2->get_removable_descendants()->end(); i++) {
+		for(i = n2_removable_descendants->begin(); i != n2_removable_descendants->end(); i++) {
 			if (*i == node2_location) {
 				//active_descendants->erase(*i);
 				remove = true;
@@ -932,11 +1079,11 @@ void delete_and_merge_LCAs(list<Node *> *active_descendants,
 		}
 		if (remove) {
 			active_descendants->erase(*i);
-			n2->get_removable_descendants()->erase(i);
+			n2_removable_descendants->erase(i);
 		}
 //		n2->get_removable_descendants()->clear();
 //		cout << "xf" << endl;
-		lca->get_removable_descendants()->push_back(lca_location);
+		state->get_removable_descendants(lca)->push_back(lca_location);
 //		cout << "xg" << endl;
 	}
 //		else {
@@ -957,15 +1104,15 @@ void delete_and_merge_LCAs(list<Node *> *active_descendants,
 	 the same component (other than n's component)
 	 */
 void delete_and_merge_LCAs(Node *n, list<Node *>
-		*active_descendants, vector<LCA> *F2_LCAs) {
+		*active_descendants, vector<LCA> *F2_LCAs, SyncInteriorState *state) {
 	int component = n->get_component_number();
 	list<list<Node *>::iterator> *removable_descendants	=
-			n->get_removable_descendants();
+			state->get_removable_descendants(n);
 
 	if (n->lchild() != NULL)
-		delete_and_merge_LCAs(n->lchild(), active_descendants, F2_LCAs);
+		delete_and_merge_LCAs(n->lchild(), active_descendants, F2_LCAs, state);
 	if (n->rchild() != NULL)
-		delete_and_merge_LCAs(n->rchild(), active_descendants, F2_LCAs);
+		delete_and_merge_LCAs(n->rchild(), active_descendants, F2_LCAs, state);
 	#ifdef DEBUG_SYNC
 
 	cout << n->str_subtree() << endl;
@@ -1005,7 +1152,7 @@ void delete_and_merge_LCAs(Node *n, list<Node *>
 //		cout << "fooj" << endl;
 			if (component != node1_component)
 				delete_and_merge_LCAs(active_descendants, F2_LCAs, node1_location,
-						node2_location);
+						node2_location, state);
 //		cout << "fook" << endl;
 		}
 		else {//if (active_descendants->size() > 1){
@@ -0,0 +1,184 @@
+/*******************************************************************************
+InputBuffer.h
+
+Read-only view of an entire input stream for the tree parsers. Regular
+files (including a redirected STDIN) are memory-mapped so that lines can
+be handed to build_tree without copying; anything else (pipes, terminals)
+is read once into a single buffer.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_INPUTBUFFER
+
+#define INCLUDE_INPUTBUFFER
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <utility>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// lines handed to the tree building threads at a time
+#define INPUT_BATCH_LINES 16384
+
+class InputBuffer {
+	private:
+	const char *data;
+	size_t size;
+	size_t pos;
+	size_t mapped_size;
+	void *mapped;
+	string contents;
+
+	public:
+	// map file descriptor fd if possible, otherwise read all of in
+	InputBuffer(int fd, istream &in) {
+		init();
+		if (map_fd(fd))
+			return;
+		read_stream(in);
+	}
+
+	// map or read the named file
+	// is_open() is false if it could not be opened
+	InputBuffer(const char *filename) {
+		init();
+#ifndef _WIN32
+		int fd = open(filename, O_RDONLY);
+		if (fd >= 0) {
+			bool ok = map_fd(fd);
+			close(fd);
+			if (ok)
+				return;
+		}
+#endif
+		ifstream in(filename, ios::in | ios::binary);
+		if (!in.is_open())
+			return;
+		read_stream(in);
+	}
+
+	~InputBuffer() {
+#ifndef _WIN32
+		if (mapped != NULL)
+			munmap(mapped, mapped_size);
+#endif
+	}
+
+	bool is_open() {
+		return data != NULL;
+	}
+
+	const char *get_data() {
+		return data;
+	}
+
+	size_t get_size() {
+		return size;
+	}
+
+	// get the next line as [start, end) without its newline
+	// returns false at the end of the input, like getline
+	bool next_line(const char *&start, const char *&end) {
+		if (pos >= size)
+			return false;
+		start = data + pos;
+		const char *newline =
+				(const char *)memchr(start, '\n', size - pos);
+		if (newline == NULL) {
+			end = data + size;
+			pos = size;
+		}
+		else {
+			end = newline;
+			pos = newline - data + 1;
+		}
+		return true;
+	}
+
+	// get the next line as a string
+	bool next_line(string &line) {
+		const char *start, *end;
+		if (!next_line(start, end))
+			return false;
+		line.assign(start, end - start);
+		return true;
+	}
+
+	// replace lines with up to max_lines next lines
+	// returns false if there are none left
+	bool next_lines(vector<pair<const char *, const char *> > &lines,
+			size_t max_lines) {
+		lines.clear();
+		const char *start, *end;
+		while (lines.size() < max_lines && next_line(start, end))
+			lines.push_back(make_pair(start, end));
+		return !lines.empty();
+	}
+
+	private:
+	void init() {
+		data = NULL;
+		size = 0;
+		pos = 0;
+		mapped_size = 0;
+		mapped = NULL;
+	}
+
+	bool map_fd(int fd) {
+#ifndef _WIN32
+		struct stat st;
+		off_t offset = lseek(fd, 0, SEEK_CUR);
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0
+				&& st.st_size > offset) {
+			void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m != MAP_FAILED) {
+				madvise(m, st.st_size, MADV_SEQUENTIAL);
+				mapped = m;
+				mapped_size = st.st_size;
+				data = (const char *)m + offset;
+				size = st.st_size - offset;
+				return true;
+			}
+		}
+#endif
+		return false;
+	}
+
+	void read_stream(istream &in) {
+		contents = string(istreambuf_iterator<char>(in),
+				istreambuf_iterator<char>());
+		data = contents.c_str();
+		size = contents.size();
+	}
+
+	InputBuffer(const InputBuffer &);
+	InputBuffer &operator=(const InputBuffer &);
+};
+
+#endif
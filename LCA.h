@@ -4,6 +4,13 @@ LCA.h
 Data structure for LCA computations on a binary tree
 Implementation of the RMQ-based methods of Bender and Farach-Colton
 
+The euler tour is split into blocks of LCA_BLOCK positions. A query
+within a block is answered from a bitmask, kept for each position, of
+the positions before it in the block that are the minimum up to it, and
+the rest of a query from a sparse table of the block minima. Building
+takes O(n) time and space and each query O(1) time. All tables are
+flat vectors.
+
 Copyright 2010-2014 Chris Whidden
 cwhidden@dal.ca
 http://kiwi.cs.dal.ca/Software/RSPR
@@ -35,6 +42,8 @@ along with rspr.  If not, see <http://www.gnu.org/licenses/>.
 #include "Node.h"
 #include <vector>
 #include <cmath>
+#include <list>
+#include <map>
 using namespace std;
 
 int mylog2 (int val) {
@@ -54,30 +63,45 @@ int mylog2 (int val) {
     return ret;
 }
 
+// positions of the euler tour in a block, one bit of a mask each
+#define LCA_BLOCK 64
+
 class LCA {
 	private:
 	Node *tree;
+	// the LCA whose tables a bound copy uses, NULL if they are its own
+	LCA *shape;
 	vector<int> E;		// preorder numbers of euler tour
-	vector<int> L;		// levels of euler tour
 	vector<int> H;		// first occurence of a preorder number in E
 	vector<int> T;    // real preorder to internal preorder mapping
+	vector<int> P;		// parent of each preorder number, -1 for the root
+	vector<int> subtree_end;	// last preorder number in each subtree
 	vector<Node *> N;	// preorder to node mapping
-	vector<vector<int> > RMQ;	// precomputed RMQ values
+	/* bit i of in_block[j] is set if position i of the block of j is
+	 * the smallest in E from there to j
+	 */
+	vector<unsigned long long> in_block;
+	// minima of 2^k blocks starting at each block, k rows of num_blocks
+	vector<int> block_min;
+	int num_blocks;
 
 	public:
 	LCA(Node *tree) {
 		this->tree = tree;
-		T = vector<int>();
+		this->shape = NULL;
 		if (tree->get_preorder_number() == -1)
 			tree->preorder_number();
-		euler_tour(tree, 0);
+		euler_tour(tree, -1);
 		precompute_rmq();
 	}
 
 	LCA() {
 		this->tree = NULL;
+		this->shape = NULL;
+		num_blocks = 0;
 	}
-	void euler_tour(Node *node, int depth) {
+
+	void euler_tour(Node *node, int parent) {
 		// First visit
 		int preorder_number = N.size();
 		int euler_number = E.size();
@@ -86,103 +110,259 @@ class LCA {
 			T.resize(node->get_preorder_number()+1,-1);
 		T[node->get_preorder_number()] = preorder_number;
 
-		//cout << preorder_number << "\t";
-		//node->print_subtree();
 		H.push_back(euler_number);
-		L.push_back(depth);
+		P.push_back(parent);
+		subtree_end.push_back(preorder_number);
 		E.push_back(preorder_number);
 
-		// TODO: check that this is correct for multifurcating trees
-		
 		list<Node *>::const_iterator c;
 		for(c = node->get_children().begin(); c != node->get_children().end();
 				c++) {
-			euler_tour(*c, depth+1);
+			euler_tour(*c, preorder_number);
 			// Middle/Last visit
-			L.push_back(depth);
 			E.push_back(preorder_number);
 		}
-
+		subtree_end[preorder_number] = N.size() - 1;
 	}
 
 	void precompute_rmq() {
-		// E gives queries of length 1
-		RMQ.push_back(E);
-		for(int length = 1; length < E.size(); length *= 2) {
-			vector<int> V = vector<int>();
-			for(int start = 0; start < E.size() - length; start++) {
-				V.push_back(rmq(start, start + length));
+		num_blocks = (E.size() + LCA_BLOCK - 1) / LCA_BLOCK;
+		in_block = vector<unsigned long long>(E.size());
+		block_min = vector<int>((mylog2(num_blocks) + 1) * num_blocks);
+		// positions of the block that are the minimum up to j
+		int stack[LCA_BLOCK];
+		for(int b = 0; b < num_blocks; b++) {
+			int start = b * LCA_BLOCK;
+			int end = min((int)E.size(), start + LCA_BLOCK);
+			unsigned long long minima = 0;
+			int top = 0;
+			for(int j = start; j < end; j++) {
+				while (top > 0 && E[start + stack[top-1]] > E[j]) {
+					top--;
+					minima &= ~(1ULL << stack[top]);
+				}
+				stack[top++] = j - start;
+				minima |= 1ULL << (j - start);
+				in_block[j] = minima;
 			}
-			RMQ.push_back(V);
+			block_min[b] = E[start + __builtin_ctzll(minima)];
 		}
+		for(int k = 1; (1 << k) <= num_blocks; k++) {
+			int *prev = &block_min[(k-1) * num_blocks];
+			int *row = &block_min[k * num_blocks];
+			int half = 1 << (k-1);
+			for(int i = 0; i + (1 << k) <= num_blocks; i++)
+				row[i] = min(prev[i], prev[i + half]);
+		}
+	}
+
+	// the rmq between indices i <= j of E in the same block
+	int block_rmq(int i, int j) {
+		unsigned long long minima =
+				in_block[j] & (~0ULL << (i % LCA_BLOCK));
+		return E[j - j % LCA_BLOCK + __builtin_ctzll(minima)];
 	}
-	//vector<vector<int> > RMQ;	// precomputed RMQ values
 
-	// find the index of the rmq between indices i and j of E
+	// find the index of the rmq between indices i <= j of E
 	int rmq(int i, int j) {
-		if (i == j)
-			return E[i];
-		int length = j - i - 1;
-		//cout << "  " << i << " " << j << endl;
-		//cout << "  " << length << endl;
-		//cout << "  " << mylog2(length) << endl;
-		length = (mylog2(length));
-		//cout << "  " << length << endl;
-		//cout << "  " << j - (1 << (length)) << endl;
-		int rmq1 = RMQ[length+1][i];
-		int rmq2;
-		if (length >= 0)
-			rmq2 = RMQ[length+1][j - (1 << (length))];
-		else
-			rmq2 = RMQ[length+1][j];
-		if (rmq1 < rmq2)
-			return rmq1;
-		return rmq2;
+		int block_i = i / LCA_BLOCK;
+		int block_j = j / LCA_BLOCK;
+		if (block_i == block_j)
+			return block_rmq(i, j);
+		int m = min(block_rmq(i, block_i * LCA_BLOCK + LCA_BLOCK - 1),
+				block_rmq(block_j * LCA_BLOCK, j));
+		if (block_j - block_i > 1) {
+			int k = mylog2(block_j - block_i - 1);
+			int *row = &block_min[k * num_blocks];
+			m = min(m, min(row[block_i + 1], row[block_j - (1 << k)]));
+		}
+		return m;
 	}
+
 	Node *get_lca(Node *a, Node *b) {
-		int preorder_a = T[a->get_preorder_number()];
-		int preorder_b = T[b->get_preorder_number()];
-		int lca_index;
-		if (preorder_a <= preorder_b)
-			lca_index = rmq(H[preorder_a], H[preorder_b]);
-		else
-			lca_index = rmq(H[preorder_b], H[preorder_a]);
-		return N[lca_index];
+		int i = tour_position(a);
+		int j = tour_position(b);
+		if (i > j)
+			swap(i, j);
+		return get_node(tables()->rmq(i, j));
+	}
+
+	/* the LCAs of many sets of nodes. Set i is given by the smallest and
+	 * largest tour_position of its nodes, from[i] and to[i]. lcas[i] is
+	 * NULL if from[i] > to[i]
+	 */
+	void get_lcas(vector<int> &from, vector<int> &to, vector<Node *> &lcas) {
+		LCA *t = tables();
+		lcas.resize(from.size());
+		for(int i = 0; i < from.size(); i++) {
+			if (from[i] > to[i])
+				lcas[i] = NULL;
+			else
+				lcas[i] = get_node(t->rmq(from[i], to[i]));
+		}
+	}
+
+	// position of the first visit to n in the euler tour
+	int tour_position(Node *n) {
+		LCA *t = tables();
+		return t->H[t->T[n->get_preorder_number()]];
+	}
+
+	/* answer queries on copy, a copy of the tree of tree_LCA whose
+	 * nodes kept their preorder numbers and that may have lost leaves
+	 * and contracted nodes since. The tables of tree_LCA are shared, not
+	 * copied. Returns false if copy does not match the tree
+	 */
+	bool bind(LCA *tree_LCA, Node *copy) {
+		shape = tree_LCA->tables();
+		tree = copy;
+		N = vector<Node *>(shape->N.size(), NULL);
+		return bind_subtree(copy, -1);
+	}
+
+	bool bind_subtree(Node *n, int parent) {
+		int p = n->get_preorder_number();
+		if (p < 0 || p >= shape->T.size() || shape->T[p] == -1)
+			return false;
+		int i = shape->T[p];
+		if (N[i] != NULL)
+			return false;
+		// each edge of the copy must be a path of the tree
+		if (parent != -1 && (i <= parent || i > shape->subtree_end[parent]))
+			return false;
+		Node *original = shape->N[i];
+		if (n->is_leaf() && original->is_leaf()
+				&& n->get_label() != original->get_label())
+			return false;
+		N[i] = n;
+		list<Node *>::iterator c;
+		for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
+			if (!bind_subtree(*c, i))
+				return false;
+		}
+		return true;
 	}
 
 	Node *get_tree() {
 		return tree;
 	}
 
+	// number of nodes in the tree
+	int size() {
+		return N.size();
+	}
+
+	// position of n in the preorder of the tree, -1 if n is not in it
+	int get_index(Node *n) {
+		LCA *t = tables();
+		int p = n->get_preorder_number();
+		if (p < 0 || p >= t->T.size() || t->T[p] == -1 || N[t->T[p]] != n)
+			return -1;
+		return t->T[p];
+	}
+
 	/* copy constructor
 	LCA(const LCA &n) {
 	}
 	*/
 	void debug() {
-		for(int i = 0; i < E.size(); i++) {
-			cout << " " << E[i];
-		}
-		cout << endl;
-		cout << endl;
-		for(int i = 0; i < L.size(); i++) {
-			cout << " " << L[i];
+		LCA *t = tables();
+		for(int i = 0; i < t->E.size(); i++) {
+			cout << " " << t->E[i];
 		}
 		cout << endl;
 		cout << endl;
-		for(int i = 0; i < H.size(); i++) {
-			cout << " " << H[i];
+		for(int i = 0; i < t->H.size(); i++) {
+			cout << " " << t->H[i];
 		}
 		cout << endl;
 		cout << endl;
 		cout << endl;
-		for(int i = 0; i < RMQ.size(); i++) {
-			for(int j = 0; j < RMQ[i].size(); j++) {
-			cout << " " << RMQ[i][j];
+		for(int k = 0; k * t->num_blocks < t->block_min.size(); k++) {
+			for(int i = 0; i + (1 << k) <= t->num_blocks; i++) {
+			cout << " " << t->block_min[k * t->num_blocks + i];
 			}
 			cout << endl;
 			cout << endl;
 		}
 	}
+
+	private:
+	LCA *tables() {
+		if (shape == NULL)
+			return this;
+		return shape;
+	}
+
+	// the node at preorder position i or, if a bound copy contracted
+	// it, its closest ancestor in the copy
+	Node *get_node(int i) {
+		LCA *t = tables();
+		while (N[i] == NULL)
+			i = t->P[i];
+		return N[i];
+	}
+};
+
+/* LCAs of trees that are compared many times without changing, e.g. the
+ * gene trees of a supertree search, built once. A tree that is changed
+ * (e.g. rerooted) must be updated and one that is deleted removed. The
+ * map is only changed by add_tree and remove, so lookups and updates of
+ * different trees do not need to lock
+ */
+class LCACache {
+	private:
+	map<Node *, LCA *> lcas;
+
+	public:
+	LCACache() {
+		lcas = map<Node *, LCA *>();
+	}
+
+	~LCACache() {
+		map<Node *, LCA *>::iterator i;
+		for(i = lcas.begin(); i != lcas.end(); i++) {
+			delete i->second;
+		}
+	}
+
+	void add_tree(Node *T) {
+		LCA *&lca = lcas[T];
+		if (lca != NULL)
+			delete lca;
+		lca = new LCA(T);
+	}
+
+	void add_trees(vector<Node *> &trees) {
+		for(int i = 0; i < trees.size(); i++) {
+			add_tree(trees[i]);
+		}
+	}
+
+	// rebuild the LCA of T if it has one
+	void update(Node *T) {
+		map<Node *, LCA *>::iterator i = lcas.find(T);
+		if (i == lcas.end())
+			return;
+		delete i->second;
+		i->second = new LCA(T);
+	}
+
+	void remove(Node *T) {
+		map<Node *, LCA *>::iterator i = lcas.find(T);
+		if (i == lcas.end())
+			return;
+		delete i->second;
+		lcas.erase(i);
+	}
+
+	// the LCA of T or NULL
+	LCA *lookup(Node *T) {
+		map<Node *, LCA *>::iterator i = lcas.find(T);
+		if (i == lcas.end())
+			return NULL;
+		return i->second;
+	}
 };
 
 #endif
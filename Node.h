@@ -39,6 +39,10 @@ along with rspr.  If not, see <http://www.gnu.org/licenses/>.
 #include <sstream>
 #include <map>
 #include <set>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "NodeArena.h"
 #include "Forest.h"
 
 using namespace std;
@@ -75,15 +79,14 @@ class Node {
 	list<Node *>:: iterator p_link;		// location in parents list
 	Node *twin;			// counterpart in another tree
 	string name;		// label
+	int label;			// number of a numbered label, -1 otherwise
+	bool rho;			// the rho leaf that stands for the root of the other tree
 	int depth;			//distance from root
 	int pre_num;	// preorder number
 	int edge_pre_start;
 	int edge_pre_end;
 
 	int component_number;
-	list <Node *> active_descendants;
-	list <Node *> root_lcas;
-	list<list <Node *>::iterator> removable_descendants;
 	list <Node *>::iterator sibling_pair_loc;
 	int sibling_pair_status;
 	int num_clustered_children;
@@ -96,10 +99,17 @@ class Node {
 	int max_merge_depth;
 	bool allow_sibling;
 	int lost_children;
+	int weight;		// copies of the tree merged into this root by dedup_trees
 	double support;
 	double support_normalization;
 
 	public:
+	static void *operator new(size_t size) {
+		return NodeArena::allocate(size);
+	}
+	static void operator delete(void *p) {
+		NodeArena::release(p);
+	}
 	Node() {
 		init(NULL, NULL, NULL, "", 0);
 	}
@@ -117,15 +127,13 @@ class Node {
 //		this->rc = rc;
 		this->p = p;
 		this->name = string(n);
+		update_label();
 		this->twin = NULL;
 		this->depth = d;
 		this->pre_num = -1;
 		this->edge_pre_start = -1;
 		this->edge_pre_end = -1;
 		this->component_number = -2;
-		this->active_descendants = list <Node *>();
-		this->root_lcas = list <Node *>();
-		this->removable_descendants = list< list<Node *>::iterator>();
 		this->sibling_pair_loc = list<Node *>::iterator(); 
 		this->sibling_pair_status = 0;
 		this->num_clustered_children = 0;
@@ -136,6 +144,7 @@ class Node {
 		this->edge_protected = false;
 		this->allow_sibling = true;
 		this->lost_children = 0;
+		this->weight = 1;
 		this->max_merge_depth = -1;
 		this->support = -1;
 		this->support_normalization = -1;
@@ -148,7 +157,9 @@ class Node {
 	// copy constructor
 	Node(const Node &n) {
 		p = NULL;
-		name = n.name.c_str();
+		name = n.name;
+		label = n.label;
+		rho = n.rho;
 		twin = n.twin;
 		depth = n.depth;
 //		depth = 0;
@@ -156,9 +167,6 @@ class Node {
 		edge_pre_start = n.edge_pre_start;
 		edge_pre_end = n.edge_pre_end;
 		component_number = n.component_number;
-		this->active_descendants = list <Node *>();
-		this->removable_descendants = list< list<Node *>::iterator>();
-		this->root_lcas = list <Node *>();
 		//sibling_pair_loc = n.sibling_pair_loc;
 		//sibling_pair_status = n.sibling_pair_status;
 		this->sibling_pair_loc = list<Node *>::iterator(); 
@@ -188,6 +196,7 @@ class Node {
 		this->edge_protected = n.edge_protected;
 		this->allow_sibling = n.allow_sibling;
 		this->lost_children = n.lost_children;
+		this->weight = n.weight;
 		this->max_merge_depth = n.max_merge_depth;
 		this->support = n.support;
 		this->support_normalization = n.support_normalization;
@@ -195,7 +204,9 @@ class Node {
 
 	Node(const Node &n, Node *parent) {
 		p = parent;
-		name = n.name.c_str();
+		name = n.name;
+		label = n.label;
+		rho = n.rho;
 		twin = n.twin;
 		if (p != NULL)
 			depth = p->depth+1;
@@ -205,9 +216,6 @@ class Node {
 		edge_pre_start = n.edge_pre_start;
 		edge_pre_end = n.edge_pre_end;
 		component_number = n.component_number;
-		this->active_descendants = list <Node *>();
-		this->removable_descendants = list< list<Node *>::iterator>();
-		this->root_lcas = list <Node *>();
 		//sibling_pair_loc = n.sibling_pair_loc;
 		//sibling_pair_status = n.sibling_pair_status;
 		this->sibling_pair_loc = list<Node *>::iterator(); 
@@ -237,6 +245,7 @@ class Node {
 		this->edge_protected = n.edge_protected;
 		this->allow_sibling = n.allow_sibling;
 		this->lost_children = n.lost_children;
+		this->weight = n.weight;
 		this->max_merge_depth = n.max_merge_depth;
 		this->support = n.support;
 		this->support_normalization = n.support_normalization;
@@ -250,9 +259,6 @@ class Node {
 			n->cut_parent();
 		}
 		cut_parent();
-		active_descendants.clear();
-		root_lcas.clear();
-		removable_descendants.clear();
 #ifdef COPY_CONTRACTED
 		if (contracted_lc != NULL) {
 			contracted_lc->delete_tree();
@@ -279,9 +285,6 @@ class Node {
 			p->delete_child(this);
 			//p = NULL;
 		}
-		active_descendants.clear();
-		root_lcas.clear();
-		removable_descendants.clear();
 	}
 	*/
 
@@ -409,6 +412,37 @@ class Node {
 	}
 	Node *set_name(string n) {
 		name = string(n);
+		update_label();
+		return this;
+	}
+	// set the name and its label as saved from get_name and get_label
+	Node *set_name(string n, int l) {
+		name = n;
+		label = l;
+		rho = (l < 0 && name.size() == 1 && name[0] == 'p');
+		return this;
+	}
+	// name this node with the numbered label l without parsing the name
+	Node *set_label(int l) {
+		name = to_string(l);
+		label = l;
+		rho = false;
+		return this;
+	}
+	// cache the number of a name written by labels_to_numbers and
+	// whether it is the rho leaf "p"
+	void update_label() {
+		label = -1;
+		rho = (name.size() == 1 && name[0] == 'p');
+		if (name.empty() || name.size() > 9)
+			return;
+		int l = 0;
+		for(int i = 0; i < name.size(); i++) {
+			if (name[i] < '0' || name[i] > '9')
+				return;
+			l = 10 * l + (name[i] - '0');
+		}
+		label = l;
 	}
 	int set_depth(int d) {
 		depth = d;
@@ -447,6 +481,7 @@ class Node {
 
 	int set_component_number(int c) {
 		component_number = c;
+		return component_number;
 	}
 	list<Node *>& get_children() {
 		return children;
@@ -460,9 +495,11 @@ class Node {
 
 	Node *set_contracted_lc(Node *n) {
 		contracted_lc = n;
+		return contracted_lc;
 	}
 	Node *set_contracted_rc(Node *n) {
 		contracted_rc = n;
+		return contracted_rc;
 	}
 
 
@@ -573,33 +610,46 @@ class Node {
 		}
 	}
 
+	int get_weight() {
+		return weight;
+	}
+	void set_weight(int w) {
+		weight = w;
+	}
+
 	double get_support() {
 		return support;
 	}
 	double set_support(double s) {
 		support = s;
+		return support;
 	}
 	double a_inc_support() {
 #pragma omp atomic
 		support += 1;
+		return support;
 	}
 	double a_dec_support() {
 #pragma omp atomic
 		support -= 1;
+		return support;
 	}
 	double get_support_normalization() {
 		return support_normalization;
 	}
 	double set_support_normalization(double s) {
 		support_normalization = s;
+		return support_normalization;
 	}
 	double a_inc_support_normalization() {
 #pragma omp atomic
 		support_normalization += 1;
+		return support_normalization;
 	}
 	double a_dec_support_normalization() {
 #pragma omp atomic
 		support_normalization -= 1;
+		return support_normalization;
 	}
 
 	void normalize_support() {
@@ -622,21 +672,17 @@ class Node {
 	}
 	int set_num_clustered_children(int c) {
 		num_clustered_children = c;
+		return num_clustered_children;
 	}
 	int get_num_clustered_children() {
 		return num_clustered_children;
 	}
-	list <Node *> *get_active_descendants() {
-		return &active_descendants;
-	}
-	list <Node *> *get_root_lcas(){
-		return &root_lcas;
-	}
 	int get_sibling_pair_status(){
 		return sibling_pair_status;
 	}
 	int set_sibling_pair_status(int s){
 		sibling_pair_status = s;
+		return sibling_pair_status;
 	}
 	void set_forest(Forest *f) {
 		forest = f;
@@ -651,9 +697,6 @@ class Node {
 	Forest *get_forest() {
 		return forest;
 	}
-	list<list <Node *>::iterator> *get_removable_descendants() {
-		return &removable_descendants;
-	}
 	void initialize_component_number(int value) {
 		component_number = value;
 		list<Node *>::iterator c;
@@ -661,27 +704,6 @@ class Node {
 			(*c)->initialize_component_number(value);
 		}
 	}
-	void initialize_active_descendants(list <Node *> value) {
-		active_descendants = value;
-		list<Node *>::iterator c;
-		for(c = children.begin(); c != children.end(); c++) {
-			(*c)->initialize_active_descendants(value);
-		}
-	}
-	void initialize_root_lcas(list <Node *> value) {
-		root_lcas = value;
-		list<Node *>::iterator c;
-		for(c = children.begin(); c != children.end(); c++) {
-			(*c)->initialize_root_lcas(value);
-		}
-	}
-	void initialize_removable_descendants(list<list <Node *>::iterator> value) {
-		removable_descendants = value;
-		list<Node *>::iterator c;
-		for(c = children.begin(); c != children.end(); c++) {
-			(*c)->initialize_removable_descendants(value);
-		}
-	}
 
 
 	/* contract:
@@ -738,8 +760,10 @@ class Node {
 
 			// dead component or singleton, will be cleaned up by the forest
 			if (children.empty()) {
-				if (str() == "")
+				if (str() == "") {
 					name = DEAD_COMPONENT;
+					label = -1;
+				}
 			}
 			if (children.size() == 1) {
 					child = children.front();
@@ -770,7 +794,9 @@ class Node {
 							set_twin(child->get_twin());
 							child->get_twin()->set_twin(this);
 						}
-						name = child->get_name().c_str();
+						name = child->name;
+						label = child->label;
+						rho = child->rho;
 //						name = child->str();
 					}
 					child->cut_parent();
@@ -979,17 +1005,36 @@ class Node {
 		return edge_pre_end;
 	}
 	string str() {
+		return str(NULL);
+	}
+	// labels numbered by labels_to_numbers are printed from reverse_label_map
+	// if it is not NULL
+	string str(map<int, string> *reverse_label_map) {
 		string s = "";
-		str_hlpr(&s);
+		str_hlpr(&s, reverse_label_map);
 		return s;
 	}
 	string get_name() {
 		return name;
 	}
+	int get_label() {
+		return label;
+	}
+	bool is_rho() {
+		return rho;
+	}
 
 	void str_hlpr(string *s) {
-		if (!name.empty())
-			*s += name.c_str();
+		str_hlpr(s, NULL);
+	}
+
+	void str_hlpr(string *s, map<int, string> *reverse_label_map) {
+		if (!name.empty()) {
+			if (reverse_label_map == NULL)
+				*s += name;
+			else
+				*s += label_name(reverse_label_map);
+		}
 		if (contracted_lc != NULL || contracted_rc != NULL) {
 			#ifdef DEBUG_CONTRACTED
 				*s += "<";
@@ -997,11 +1042,11 @@ class Node {
 				*s += "(";
 			#endif
 			if (contracted_lc != NULL) {
-				contracted_lc->str_c_subtree_hlpr(s);
+				contracted_lc->str_c_subtree_hlpr(s, reverse_label_map);
 			}
 			*s += ",";
 			if (contracted_rc != NULL) {
-				contracted_rc->str_c_subtree_hlpr(s);
+				contracted_rc->str_c_subtree_hlpr(s, reverse_label_map);
 			}
 			#ifdef DEBUG_CONTRACTED
 				*s += ">";
@@ -1012,20 +1057,28 @@ class Node {
 	}
 
 	string str_subtree() {
+		return str_subtree(NULL);
+	}
+
+	string str_subtree(map<int, string> *reverse_label_map) {
 		string s = "";
-		str_subtree_hlpr(&s);
+		str_subtree_hlpr(&s, reverse_label_map);
 		return s;
 	}
 
 	void str_subtree_hlpr(string *s) {
-		str_hlpr(s);
+		str_subtree_hlpr(s, NULL);
+	}
+
+	void str_subtree_hlpr(string *s, map<int, string> *reverse_label_map) {
+		str_hlpr(s, reverse_label_map);
 		if (!is_leaf()) {
 			*s += "(";
 			list<Node *>::iterator c;
 			for(c = children.begin(); c != children.end(); c++) {
 				if (c != children.begin())
 					*s += ",";
-				(*c)->str_subtree_hlpr(s);
+				(*c)->str_subtree_hlpr(s, reverse_label_map);
 				if ((*c)->parent() != this)
 					cout << "#";
 			}
@@ -1046,8 +1099,13 @@ class Node {
 	}
 
 	string str_support_subtree(bool allow_negative) {
+		return str_support_subtree(allow_negative, NULL);
+	}
+
+	string str_support_subtree(bool allow_negative,
+			map<int, string> *reverse_label_map) {
 		string s = "";
-		str_support_subtree_hlpr(&s, allow_negative);
+		str_support_subtree_hlpr(&s, allow_negative, reverse_label_map);
 		return s;
 	}
 
@@ -1055,15 +1113,17 @@ class Node {
 		return str_support_subtree(false);
 	}
 
-	void str_support_subtree_hlpr(string *s, bool allow_negative) {
-		str_hlpr(s);
+	void str_support_subtree_hlpr(string *s, bool allow_negative,
+			map<int, string> *reverse_label_map) {
+		str_hlpr(s, reverse_label_map);
 		if (!is_leaf()) {
 			*s += "(";
 			list<Node *>::iterator c;
 			for(c = children.begin(); c != children.end(); c++) {
 				if (c != children.begin())
 					*s += ",";
-				(*c)->str_support_subtree_hlpr(s, allow_negative);
+				(*c)->str_support_subtree_hlpr(s, allow_negative,
+						reverse_label_map);
 				if ((*c)->parent() != this)
 					cout << "#";
 			}
@@ -1119,7 +1179,11 @@ class Node {
 	}
 
 	void str_c_subtree_hlpr(string *s) {
-		str_hlpr(s);
+		str_c_subtree_hlpr(s, NULL);
+	}
+
+	void str_c_subtree_hlpr(string *s, map<int, string> *reverse_label_map) {
+		str_hlpr(s, reverse_label_map);
 		if (!is_leaf()) {
 			#ifdef DEBUG_CONTRACTED
 				*s += "<";
@@ -1130,7 +1194,7 @@ class Node {
 			for(c = children.begin(); c != children.end(); c++) {
 				if (c != children.begin())
 					*s += ",";
-				(*c)->str_c_subtree_hlpr(s);
+				(*c)->str_c_subtree_hlpr(s, reverse_label_map);
 				if ((*c)->parent() != this)
 					cout << "#";
 			}
@@ -1177,6 +1241,10 @@ class Node {
 		cout << str_subtree();
 		cout << endl;
 	}
+	void print_subtree(map<int, string> *reverse_label_map) {
+		cout << str_subtree(reverse_label_map);
+		cout << endl;
+	}
 	void print_subtree_hlpr() {
 		cout << str_subtree();
 	}
@@ -1298,7 +1366,7 @@ class Node {
 	}
 
 	bool contains_leaf(int number) {
-		if (stomini(get_name()) == number)
+		if (label == number || (label < 0 && stomini(name) == number))
 			return true;
 		list<Node *>::iterator c;
 		for(c = children.begin(); c != children.end(); c++) {
@@ -1391,17 +1459,13 @@ class Node {
 	void labels_to_numbers(map<string, int> *label_map, map<int, string> *reverse_label_map) {
 		if (name != "") {
 			map<string, int>::iterator i = label_map->find(name);
-			stringstream ss;
-			if (i != label_map->end()) {
-				ss << i->second;
-				name = ss.str();
-			}
+			if (i != label_map->end())
+				set_label(i->second);
 			else {
 				int num = label_map->size();
-				ss << num;
 				label_map->insert(make_pair(name, num));
 				reverse_label_map->insert(make_pair(num, name));
-				name = ss.str();
+				set_label(num);
 			}
 		}
 		list<Node *>::iterator c;
@@ -1414,35 +1478,39 @@ class Node {
 			contracted_rc->labels_to_numbers(label_map, reverse_label_map);
 	}
 	
+	// the name with each number replaced by its label
+	string label_name(map<int, string> *reverse_label_map) {
+		if (label >= 0) {
+			map<int, string>::iterator j = reverse_label_map->find(label);
+			if (j != reverse_label_map->end())
+				return j->second;
+			return name;
+		}
+		string converted_name = "";
+		size_t old_loc = 0;
+		size_t loc = 0;
+		while ((loc = name.find_first_of("0123456789", old_loc)) != string::npos) {
+			converted_name.append(name.substr(old_loc, loc - old_loc)); 
+			old_loc = loc;
+			loc = name.find_first_not_of("0123456789", old_loc);
+			if (loc == string::npos)
+				loc = name.size();
+			string number = name.substr(old_loc, loc - old_loc);
+			map<int, string>::iterator j = reverse_label_map->find(atoi(number.c_str()));
+			if (j != reverse_label_map->end())
+				converted_name.append(j->second);
+			else
+				converted_name.append(number);
+			old_loc = loc;
+		}
+		converted_name.append(name.substr(old_loc, name.size() - old_loc)); 
+		return converted_name;
+	}
+	
 	void numbers_to_labels(map<int, string> *reverse_label_map) {
 		if (name != "") {
-			string converted_name = "";
-			string current_num = "";
-			string::iterator i = name.begin();
-			size_t old_loc = 0;
-			size_t loc = 0;
-			while ((loc = name.find_first_of("0123456789", old_loc)) != string::npos) {
-				converted_name.append(name.substr(old_loc, loc - old_loc)); 
-				old_loc = loc;
-				loc = name.find_first_not_of("0123456789", old_loc);
-				string label = "";
-				if (loc == string::npos)
-					loc = name.size();
-				label = name.substr(old_loc, loc - old_loc);
-				map<int, string>::iterator j = reverse_label_map->find(atoi(label.c_str()));
-				if (j != reverse_label_map->end()) {
-					stringstream ss;
-					ss << j->second;
-					label = ss.str();
-				}
-				converted_name.append(label);
-				old_loc = loc;
-			}
-			converted_name.append(name.substr(old_loc, name.size() - old_loc)); 
-			name = converted_name;
-
-
-
+			name = label_name(reverse_label_map);
+			update_label();
 		}
 		list<Node *>::iterator c;
 		for(c = children.begin(); c != children.end(); c++) {
@@ -1455,17 +1523,30 @@ class Node {
 	}
 
 	void build_name_to_pre_map(map<string, int> *name_to_pre) {
+		build_name_to_pre_map(name_to_pre, NULL);
+	}
+
+	// key leaves by their label in reverse_label_map if it is not NULL
+	void build_name_to_pre_map(map<string, int> *name_to_pre,
+			map<int, string> *reverse_label_map) {
 		list<Node *>::iterator c;
 		for(c = children.begin(); c != children.end(); c++) {
-			(*c)->build_name_to_pre_map(name_to_pre);
+			(*c)->build_name_to_pre_map(name_to_pre, reverse_label_map);
+		}
+		if (is_leaf()) {
+			if (reverse_label_map == NULL)
+				name_to_pre->insert(make_pair(get_name(), get_preorder_number()));
+			else
+				name_to_pre->insert(make_pair(label_name(reverse_label_map),
+						get_preorder_number()));
 		}
-		if (is_leaf())
-			name_to_pre->insert(make_pair(get_name(), get_preorder_number()));
 	}
 
 	void count_numbered_labels(vector<int> *label_counts) {
 		if (name != "") {
-			int label = stomini(name);
+			int label = this->label;
+			if (label < 0)
+				label = stomini(name);
 			if (label_counts->size() <= label)
 				label_counts->resize(label+1,0);
 			(*label_counts)[label]++;
@@ -1496,16 +1577,13 @@ class Node {
 
 	void edge_preorder_interval() {
 		edge_pre_start = pre_num;
-		if (is_leaf()) {
-			edge_pre_end = pre_num;
-		}
-		else {
-			list<Node *>::iterator c;
-			for(c = children.begin(); c != children.end(); c++) {
-				(*c)->edge_preorder_interval();
-				if (edge_pre_end == -1 || (*c)->edge_pre_end > edge_pre_end)
-					edge_pre_end = (*c)->edge_pre_end;
-			}
+		// intervals from before the tree was changed must not be kept
+		edge_pre_end = pre_num;
+		list<Node *>::iterator c;
+		for(c = children.begin(); c != children.end(); c++) {
+			(*c)->edge_preorder_interval();
+			if ((*c)->edge_pre_end > edge_pre_end)
+				edge_pre_end = (*c)->edge_pre_end;
 		}
 	}
 
@@ -1547,6 +1625,93 @@ class Node {
 		return d;
 	}
 
+	/* canonical_str
+	 * a string that is equal for two trees exactly when they have the
+	 * same rooted topology on the same leaves, regardless of child order.
+	 * Leaves numbered by labels_to_numbers are written as their number.
+	 */
+	string canonical_str() {
+		if (is_leaf())
+			return canonical_leaf_str();
+		vector<string> child_strs = vector<string>();
+		list<Node *>::iterator c;
+		for(c = children.begin(); c != children.end(); c++) {
+			child_strs.push_back((*c)->canonical_str());
+		}
+		return canonical_join(child_strs);
+	}
+
+	/* canonical_unrooted_str
+	 * as canonical_str, but equal for any two rootings of the same
+	 * unrooted tree. The tree is read from its smallest leaf and a root
+	 * of degree two is suppressed.
+	 */
+	string canonical_unrooted_str() {
+		vector<Node *> leaves = find_leaves();
+		Node *first = leaves[0];
+		string first_str = first->canonical_leaf_str();
+		for(int i = 1; i < leaves.size(); i++) {
+			string s = leaves[i]->canonical_leaf_str();
+			if (s < first_str) {
+				first = leaves[i];
+				first_str = s;
+			}
+		}
+		vector<Node *> neighbours = vector<Node *>();
+		first->unrooted_neighbours(&neighbours);
+		if (neighbours.empty())
+			return first_str;
+		return "(" + first_str + ","
+				+ neighbours[0]->canonical_unrooted_str(first) + ")";
+	}
+
+	string canonical_unrooted_str(Node *from) {
+		if (is_leaf())
+			return canonical_leaf_str();
+		vector<Node *> neighbours = vector<Node *>();
+		unrooted_neighbours(&neighbours);
+		vector<string> neighbour_strs = vector<string>();
+		for(int i = 0; i < neighbours.size(); i++) {
+			if (neighbours[i] != from)
+				neighbour_strs.push_back(
+						neighbours[i]->canonical_unrooted_str(this));
+		}
+		return canonical_join(neighbour_strs);
+	}
+
+	string canonical_leaf_str() {
+		if (label >= 0)
+			return to_string(label);
+		return name;
+	}
+
+	static string canonical_join(vector<string> &strs) {
+		sort(strs.begin(), strs.end());
+		string s = "(";
+		for(int i = 0; i < strs.size(); i++) {
+			if (i > 0)
+				s += ",";
+			s += strs[i];
+		}
+		s += ")";
+		return s;
+	}
+
+	// adjacent nodes in the unrooted tree, skipping a root of degree two
+	void unrooted_neighbours(vector<Node *> *neighbours) {
+		list<Node *>::iterator c;
+		for(c = children.begin(); c != children.end(); c++) {
+			neighbours->push_back(*c);
+		}
+		if (p != NULL) {
+			if (p->p == NULL && p->children.size() == 2)
+				neighbours->push_back(p->lchild() == this ? p->rchild()
+						: p->lchild());
+			else
+				neighbours->push_back(p);
+		}
+	}
+
 	// TODO: binary only
 	// these will potentially be removed
 
@@ -1797,6 +1962,8 @@ Node *expand_parent_edge(Node *n) {
 		if (contracted_rc != NULL)
 		contracted_rc->p = new_child;
 		name = "";
+		label = -1;
+		rho = false;
 		contracted_lc = NULL;
 		contracted_rc = NULL;
 		add_child(new_child);
@@ -1816,6 +1983,8 @@ Node *undo_expand_parent_edge() {
 	else {
 		Node *child = children.front();
 		name = child->name;
+		label = child->label;
+		rho = child->rho;
 		Node *new_lc = child->lchild();
 		Node *new_rc = child->rchild();
 		new_lc->cut_parent();
@@ -1829,6 +1998,8 @@ Node *undo_expand_parent_edge() {
 		child->contracted_lc = NULL;
 		child->contracted_rc = NULL;
 		child->name = "";
+		child->label = -1;
+		child->rho = false;
 		add_child(new_lc);
 		add_child(new_rc);
 		return child;
@@ -1964,7 +2135,48 @@ Node *spr(Node *new_sibling, int &which_child) {
 
 Node *spr(Node *new_sibling) {
 	int na = 0;
-	spr(new_sibling, na);
+	return spr(new_sibling, na);
+}
+
+/* find the smallest subtree that contains every node whose depth or
+ * preorder number changes if spr(new_sibling) is applied to this node
+ * Its root keeps its own depth and preorder number.
+ * Assumes that depths are current
+ */
+Node *spr_region(Node *new_sibling) {
+	if (p == NULL || new_sibling == NULL)
+		return NULL;
+	// moves involving the root rearrange the root's children
+	if (p->p == NULL)
+		return p;
+	if (new_sibling->p == NULL)
+		return new_sibling;
+	Node *a = p->p;
+	Node *b = new_sibling->p;
+	while (a->depth > b->depth)
+		a = a->p;
+	while (b->depth > a->depth)
+		b = b->p;
+	while (a != b) {
+		a = a->p;
+		b = b->p;
+	}
+	return a;
+}
+
+/* spr that also updates depths and preorder numbers, only
+ * renumbering the subtree found by spr_region
+ * Assumes that depths and preorder numbers are current
+ * Note: does not update edge preorder intervals
+ */
+Node *spr_renumber(Node *new_sibling, int &which_child) {
+	Node *region = spr_region(new_sibling);
+	Node *reverse = spr(new_sibling, which_child);
+	if (region != NULL) {
+		region->fix_depths();
+		region->preorder_number(region->pre_num);
+	}
+	return reverse;
 }
 
 void find_descendant_counts_hlpr(vector<int> *dc) {
@@ -2097,8 +2309,17 @@ void expand_contracted_nodes() {
 	}
 }
 
+// stomini(str()) without building the string for numbered leaves
+int get_min_label() {
+	if (label >= 0 && contracted_lc == NULL && contracted_rc == NULL)
+		return label;
+	return stomini(str());
+}
+
 int get_name_num() {
-	return atoi(get_name().c_str());
+	if (label >= 0)
+		return label;
+	return atoi(name.c_str());
 }
 
 
@@ -2109,8 +2330,10 @@ Node *build_tree(string s);
 Node *build_tree(string s, set<string, StringCompare> *include_only);
 Node *build_tree(string s, int start_depth);
 Node *build_tree(string s, int start_depth, set<string, StringCompare> *include_only);
-int build_tree_helper(int start, const string& s, Node *parent,
-		bool &valid, set<string, StringCompare> *include_only);
+Node *build_tree(const char *s, size_t len, int start_depth,
+		set<string, StringCompare> *include_only);
+const char *build_tree_helper(const char *start, const char *end,
+		Node *parent, bool &valid, set<string, StringCompare> *include_only);
 //void preorder_number(Node *node);
 //int preorder_number(Node *node, int next);
 string strip_newick_name(string &T);
@@ -2127,11 +2350,19 @@ Node *build_tree(string s, set<string, StringCompare> *include_only) {
 	return build_tree(s, 0, include_only);
 }
 Node *build_tree(string s, int start_depth, set<string, StringCompare> *include_only) {
-	if (s == "")
+	return build_tree(s.c_str(), s.size(), start_depth, include_only);
+}
+
+// build a tree from the newick string in [s, s + len) without copying it
+// labels are left as names, as trees are parsed in parallel and numbered
+// afterwards in input order with labels_to_numbers
+Node *build_tree(const char *s, size_t len, int start_depth,
+		set<string, StringCompare> *include_only) {
+	if (len == 0)
 		return new Node();
 	Node *dummy_head = new Node("p", start_depth-1);
 	bool valid = true;
-	build_tree_helper(0, s, dummy_head, valid, include_only);
+	build_tree_helper(s, s + len, dummy_head, valid, include_only);
 	Node *head = dummy_head->lchild();
 	if (valid && head != NULL) {
 		delete dummy_head;
@@ -2142,87 +2373,77 @@ Node *build_tree(string s, int start_depth, set<string, StringCompare> *include_
 			head->delete_tree();
 		return dummy_head;
 	}
+}
 
+// create a node named by [start, end) up to any branch length
+Node *build_tree_node(const char *start, const char *end, Node *parent,
+		set<string, StringCompare> *include_only) {
+	const char *name_end = (const char *)memchr(start, ':', end - start);
+	if (name_end == NULL)
+		name_end = end;
+	string name = string(start, name_end - start);
+	if (include_only != NULL &&
+			include_only->find(name) == include_only->end())
+		return NULL;
+	Node *node = new Node(name);
+	parent->add_child(node);
+	return node;
 }
 
 // build_tree recursive helper function
-int build_tree_helper(int start, const string& s, Node *parent,
-		bool &valid, set<string, StringCompare> *include_only) {
-	int loc = s.find_first_of("(,)", start);
-	if (loc == string::npos) {
-		string name = s.substr(start, s.size() - start);
-		int name_end = name.find(':');
-		if (name_end != string::npos)
-			name = name.substr(0, name_end);
-		if (include_only == NULL ||
-				include_only->find(name) != include_only->end()) {
-			Node *node = new Node(name);
-			parent->add_child(node);
-		}
-		loc = s.size()-1;
-		return loc;
-	}
-	while(s[start] == ' ' || s[start] == '\t')
+// returns the location of the delimiter that ended this subtree
+const char *build_tree_helper(const char *start, const char *end,
+		Node *parent, bool &valid, set<string, StringCompare> *include_only) {
+	const char *loc = start;
+	while (loc < end && *loc != '(' && *loc != ',' && *loc != ')')
+		loc++;
+	if (loc == end) {
+		build_tree_node(start, end, parent, include_only);
+		return end - 1;
+	}
+	while(*start == ' ' || *start == '\t')
 		start++;
-	int end = loc;
-	while(s[end] == ' ' || s[end] == '\t')
-		end--;
-	string name = s.substr(start, end - start);
-	int name_end = name.find(':');
-	if (name_end != string::npos)
-		name = name.substr(0, name_end);
-	Node *node = NULL;
-	if (include_only == NULL ||
-			include_only->find(name) != include_only->end()) {
-		node = new Node(name);
-		parent->add_child(node);
-	}
+	Node *node = build_tree_node(start, loc, parent, include_only);
+	if (*loc != '(')
+		return loc;
 
 	int count = 1;
-	if (s[loc] == '(') {
-			loc = build_tree_helper(loc + 1, s, node, valid, include_only);
-			while(s[loc] == ',') {
-				loc = build_tree_helper(loc + 1, s, node, valid, include_only);
-				count++;
-			}
-//			int loc_check = s.find_first_of("(,)", loc);
-//			if (loc_check != string::npos &&
-//					s[loc_check] == ','
-			if (s[loc] != ')'
-					|| IGNORE_MULTI && count > 2) {
-				valid = false;
-					return s.size()-1;
-			}
-			// TODO: get the support values here (and branch lengths?)
-			// contract_node() if support is less than a threshold
-			loc++;
-			if (s[loc-1] == ')') {
-				int numc = node->get_children().size();
-				bool contracted = false;
-				int next = s.find_first_of(",)", loc);
-				if (next != string::npos) {
-					if (next > loc && REQUIRED_SUPPORT > 0) {
-						string info = s.substr(loc, next - loc);
-						if (info[0] != ':') {
-							double support = atof(info.c_str());
-//							cout << "support=" << support << endl;
-							if (support < REQUIRED_SUPPORT && numc > 0) {
-								node->contract_node();
-								contracted = true;
-							}
-						}
-					}
-					loc=next;
-				}
-				if (!contracted) {
-					if (numc == 1)
-						node->contract_node();
-					else if (numc == 0 && name == "") {
-						node->cut_parent();
-						delete node;
-					}
-				}
+	loc = build_tree_helper(loc + 1, end, node, valid, include_only);
+	while(valid && loc < end && *loc == ',') {
+		loc = build_tree_helper(loc + 1, end, node, valid, include_only);
+		count++;
+	}
+	if (!valid || loc == end || *loc != ')'
+			|| IGNORE_MULTI && count > 2) {
+		valid = false;
+		return end - 1;
+	}
+	loc++;
+	int numc = node->get_children().size();
+	bool contracted = false;
+	const char *next = loc;
+	while (next < end && *next != ',' && *next != ')')
+		next++;
+	if (next < end) {
+		if (next > loc && REQUIRED_SUPPORT > 0 && *loc != ':') {
+			double support = atof(string(loc, next - loc).c_str());
+			if (support < REQUIRED_SUPPORT && numc > 0) {
+				node->contract_node();
+				contracted = true;
 			}
+		}
+		loc = next;
+	}
+	if (!contracted) {
+		if (numc == 1)
+			node->contract_node();
+		else if (numc == 0 && node->get_name() == "") {
+			node->cut_parent();
+			delete node;
+			return loc;
+		}
+		else
+			return loc;
 	}
 	return loc;
 }
@@ -0,0 +1,195 @@
+/*******************************************************************************
+NodeArena.h
+
+Per-thread arena for Node and Forest allocations. While a NodeArenaScope
+is alive on a thread, nodes allocated on that thread are carved out of
+large chunks instead of individual mallocs; deleting them recycles them
+within the arena and leaving the outermost scope releases everything at
+once. Outside a scope allocations go to the heap as usual, so trees that
+must outlive a comparison are unaffected.
+
+Only wrap code in a scope if none of the nodes or forests it creates
+escape it.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_NODEARENA
+
+#define INCLUDE_NODEARENA
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+// bytes per arena chunk
+#define NODE_ARENA_CHUNK (1 << 20)
+// space before each object for its owning arena and size class,
+// keeps 16 byte alignment
+#define NODE_ARENA_HEADER 16
+// allocations are rounded up to this
+#define NODE_ARENA_ALIGN 16
+
+bool USE_NODE_ARENA = true;
+
+class NodeArena {
+	private:
+	vector<char *> chunks;
+	size_t chunk;		// chunk currently being filled
+	size_t used;		// bytes used in that chunk
+	vector<void *> free_lists;	// recycled blocks by size class
+	int depth;			// number of open scopes
+
+	NodeArena() {
+		chunk = 0;
+		used = 0;
+		depth = 0;
+	}
+
+	~NodeArena() {
+		for(int i = 0; i < chunks.size(); i++)
+			free(chunks[i]);
+	}
+
+	static NodeArena *&thread_arena() {
+		static __thread NodeArena *arena = NULL;
+		return arena;
+	}
+
+	static NodeArena *&active() {
+		static __thread NodeArena *arena = NULL;
+		return arena;
+	}
+
+	static size_t block_size(size_t size) {
+		return NODE_ARENA_HEADER + (size + NODE_ARENA_ALIGN - 1)
+				/ NODE_ARENA_ALIGN * NODE_ARENA_ALIGN;
+	}
+
+	void *arena_allocate(size_t size) {
+		size_t block = block_size(size);
+		size_t size_class = block / NODE_ARENA_ALIGN;
+		char *base;
+		if (size_class < free_lists.size() && free_lists[size_class] != NULL) {
+			base = (char *)free_lists[size_class];
+			free_lists[size_class] = *(void **)(base + NODE_ARENA_HEADER);
+		}
+		else {
+			if (used + block > NODE_ARENA_CHUNK) {
+				chunk++;
+				used = 0;
+			}
+			if (chunk == chunks.size()) {
+				char *c = (char *)malloc(NODE_ARENA_CHUNK);
+				if (c == NULL)
+					throw bad_alloc();
+				chunks.push_back(c);
+			}
+			base = chunks[chunk] + used;
+			used += block;
+		}
+		*(NodeArena **)base = this;
+		*(size_t *)(base + sizeof(NodeArena *)) = size_class;
+		return base + NODE_ARENA_HEADER;
+	}
+
+	void recycle(char *base) {
+		size_t size_class = *(size_t *)(base + sizeof(NodeArena *));
+		if (size_class >= free_lists.size())
+			free_lists.resize(size_class + 1, NULL);
+		*(void **)(base + NODE_ARENA_HEADER) = free_lists[size_class];
+		free_lists[size_class] = base;
+	}
+
+	// forget every allocation, keeping the chunks for reuse
+	void reset() {
+		chunk = 0;
+		used = 0;
+		free_lists.clear();
+	}
+
+	public:
+	// open a scope on this thread's arena
+	static void enter() {
+		if (!USE_NODE_ARENA)
+			return;
+		NodeArena *&arena = thread_arena();
+		if (arena == NULL)
+			arena = new NodeArena();
+		arena->depth++;
+		active() = arena;
+	}
+
+	// close a scope, releasing the arena when it is the outermost
+	static void leave() {
+		NodeArena *arena = active();
+		if (arena == NULL)
+			return;
+		arena->depth--;
+		if (arena->depth == 0) {
+			arena->reset();
+			active() = NULL;
+		}
+	}
+
+	static void *allocate(size_t size) {
+		NodeArena *arena = active();
+		if (arena != NULL && block_size(size) <= NODE_ARENA_CHUNK)
+			return arena->arena_allocate(size);
+		char *base = (char *)::operator new(size + NODE_ARENA_HEADER);
+		*(NodeArena **)base = NULL;
+		return base + NODE_ARENA_HEADER;
+	}
+
+	static void release(void *p) {
+		if (p == NULL)
+			return;
+		char *base = (char *)p - NODE_ARENA_HEADER;
+		NodeArena *owner = *(NodeArena **)base;
+		if (owner == NULL)
+			::operator delete(base);
+		else if (owner == active())
+			owner->recycle(base);
+		// blocks of another thread's arena are released by its reset
+	}
+};
+
+// allocate nodes and forests on this thread from its arena while alive
+class NodeArenaScope {
+	bool entered;
+	public:
+	NodeArenaScope() {
+		entered = true;
+		NodeArena::enter();
+	}
+	// only use the arena if enable is true
+	NodeArenaScope(bool enable) {
+		entered = enable;
+		if (enable)
+			NodeArena::enter();
+	}
+	~NodeArenaScope() {
+		if (entered)
+			NodeArena::leave();
+	}
+	private:
+	NodeArenaScope(const NodeArenaScope &);
+	NodeArenaScope &operator=(const NodeArenaScope &);
+};
+
+#endif
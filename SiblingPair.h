@@ -33,7 +33,7 @@ along with rspr.  If not, see <http://www.gnu.org/licenses/>.
 #include <string>
 #include <iostream>
 #include <sstream>
-#include <set>
+#include <vector>
 #include "Node.h"
 
 using namespace std;
@@ -66,9 +66,161 @@ class SiblingPair {
 	}
 };
 
+/* the pending sibling pairs of the branch and bound, at most one per key,
+ * taken in increasing order of key. Pairs are kept in a flat array indexed
+ * by key with a bitset of the occupied keys so adding, removing and finding
+ * the first pair do not allocate. Every change is recorded in a log and
+ * undo_to(mark) restores the pairs by truncating the log back to a mark
+ * taken with mark()
+ */
+class SiblingPairWorklist {
+	private:
+	struct Change {
+		int slot;
+		bool was_present;
+		SiblingPair old;
+	};
+	// pairs[key + 1], as unnumbered nodes have key -1
+	vector<SiblingPair> pairs;
+	vector<unsigned long long> present;
+	vector<Change> log;
+	int num_pairs;
+
+	void grow(int slot) {
+		if (slot >= pairs.size()) {
+			pairs.resize(slot + 1);
+			present.resize(slot / 64 + 1, 0);
+		}
+	}
+
+	bool is_present(int slot) {
+		return (present[slot / 64] >> (slot % 64)) & 1;
+	}
+
+	void set_present(int slot, bool p) {
+		unsigned long long bit = 1ULL << (slot % 64);
+		if (p) {
+			present[slot / 64] |= bit;
+			num_pairs++;
+		}
+		else {
+			present[slot / 64] &= ~bit;
+			num_pairs--;
+		}
+	}
+
+	// the first occupied slot at or after slot, or -1
+	int find_from(int slot) {
+		int w = slot / 64;
+		if (w >= present.size())
+			return -1;
+		unsigned long long bits = present[w] & (~0ULL << (slot % 64));
+		while (bits == 0) {
+			if (++w >= present.size())
+				return -1;
+			bits = present[w];
+		}
+		return w * 64 + __builtin_ctzll(bits);
+	}
+
+	public:
+	SiblingPairWorklist() {
+		num_pairs = 0;
+	}
+
+	// room for keys up to max_key without growing
+	SiblingPairWorklist(int max_key) {
+		num_pairs = 0;
+		grow(max_key + 1);
+		log.reserve(4 * pairs.size());
+	}
+
+	bool empty() {
+		return num_pairs == 0;
+	}
+
+	int size() {
+		return num_pairs;
+	}
+
+	/* positions of the pairs in increasing order of key, for walking
+	 * the worklist with begin(), next(i) and end()
+	 */
+	int begin() {
+		return find_from(0);
+	}
+
+	int next(int i) {
+		return find_from(i + 1);
+	}
+
+	int end() {
+		return -1;
+	}
+
+	SiblingPair &get(int i) {
+		return pairs[i];
+	}
+
+	// add p, replacing the pair with the same key
+	void insert(SiblingPair p) {
+		int slot = p.key + 1;
+		grow(slot);
+		Change c;
+		c.slot = slot;
+		c.was_present = is_present(slot);
+		c.old = pairs[slot];
+		log.push_back(c);
+		pairs[slot] = p;
+		if (!c.was_present)
+			set_present(slot, true);
+	}
+
+	SiblingPair remove(int i) {
+		Change c;
+		c.slot = i;
+		c.was_present = true;
+		c.old = pairs[i];
+		log.push_back(c);
+		set_present(i, false);
+		return c.old;
+	}
+
+	// remove the pair with the smallest key
+	SiblingPair pop() {
+		return remove(begin());
+	}
+
+	void clear() {
+		for(int i = begin(); i != end(); i = next(i)) {
+			remove(i);
+		}
+	}
+
+	int mark() {
+		return log.size();
+	}
+
+	// keep the current pairs when undoing
+	void forget() {
+		log.clear();
+	}
+
+	// undo the changes made since mark was taken
+	void undo_to(int mark) {
+		while (log.size() > mark) {
+			Change &c = log.back();
+			if (is_present(c.slot) != c.was_present)
+				set_present(c.slot, c.was_present);
+			pairs[c.slot] = c.old;
+			log.pop_back();
+		}
+	}
+};
+
 	// TODO: binary only
-	void find_sibling_pairs_set_hlpr(Node *n,
-			set<SiblingPair> *sibling_pairs) {
+	void find_sibling_pairs_hlpr(Node *n,
+			SiblingPairWorklist *sibling_pairs) {
 		Node *lchild = n->lchild();
 		Node *rchild = n->rchild();
 		bool lchild_leaf = false;
@@ -77,40 +229,47 @@ class SiblingPair {
 			if (lchild->is_leaf())
 				lchild_leaf = true;
 			else
-				find_sibling_pairs_set_hlpr(lchild,sibling_pairs);
+				find_sibling_pairs_hlpr(lchild,sibling_pairs);
 		}
 		if (rchild != NULL) {
 			if (rchild->is_leaf())
 				rchild_leaf = true;
 			else
-				find_sibling_pairs_set_hlpr(rchild,sibling_pairs);
+				find_sibling_pairs_hlpr(rchild,sibling_pairs);
 		}
 		if (lchild_leaf && rchild_leaf) {
 			sibling_pairs->insert(SiblingPair(lchild,rchild));
-			//lchild->add_to_sibling_pairs(sibling_pairs, 1);
-			//rchild->add_to_sibling_pairs(sibling_pairs, 2);
 		}
 	}
-	
-	// find the sibling pairs in this node's subtree
-	void append_sibling_pairs_set(Node *n,set<SiblingPair> *sibling_pairs) {
-		find_sibling_pairs_set_hlpr(n,sibling_pairs);
+
+	// the largest key of a sibling pair in n's subtree, if it is numbered
+	int max_sibling_pair_key(Node *n) {
+		return n->get_preorder_number() + n->size();
 	}
 
 	// find the sibling pairs in this node's subtree
-	set<SiblingPair> *find_sibling_pairs_set(Node *n) {
-		set<SiblingPair> *sibling_pairs = new set<SiblingPair>();
-		find_sibling_pairs_set_hlpr(n,sibling_pairs);
+	SiblingPairWorklist *find_sibling_pairs_worklist(Node *n) {
+		SiblingPairWorklist *sibling_pairs =
+				new SiblingPairWorklist(max_sibling_pair_key(n));
+		find_sibling_pairs_hlpr(n, sibling_pairs);
+		// the initial pairs are never undone
+		sibling_pairs->forget();
 		return sibling_pairs;
 	}
 
-	// return a set of the sibling pairs
-	set<SiblingPair> *find_sibling_pairs_set(Forest *f) {
-		set<SiblingPair> *sibling_pairs = new set<SiblingPair>();
+	// return a worklist of the sibling pairs
+	SiblingPairWorklist *find_sibling_pairs_worklist(Forest *f) {
+		int max_key = 0;
+		for(int i = 0; i < f->num_components(); i++) {
+			int key = max_sibling_pair_key(f->get_component(i));
+			if (key > max_key)
+				max_key = key;
+		}
+		SiblingPairWorklist *sibling_pairs = new SiblingPairWorklist(max_key);
 		for(int i = 0; i < f->num_components(); i++) {
-			Node *component = f->get_component(i);
-			append_sibling_pairs_set(component,sibling_pairs);
+			find_sibling_pairs_hlpr(f->get_component(i), sibling_pairs);
 		}
+		sibling_pairs->forget();
 		return sibling_pairs;
 	}
 #endif
@@ -0,0 +1,129 @@
+/*******************************************************************************
+TabooList.h
+
+Supertrees visited by a -taboo_search. A tree is stored by the hash of
+its canonical_str, so adding a tree and checking whether a tree was
+visited take expected constant time after the canonical string is
+built, however long the search runs. Two rooted trees on the same
+leaves have the same canonical_str exactly when their rSPR distance is
+0. The canonical strings are also kept to verify a matching hash unless
+the list is hash only, which saves memory but lets a hash collision
+mark an unvisited tree as taboo.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_TABOOLIST
+
+#define INCLUDE_TABOOLIST
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Node.h"
+
+using namespace std;
+
+class TabooList {
+	private:
+	// canonical strings with each hash, empty if hash only
+	unordered_map<size_t, vector<string> > trees;
+	bool hash_only;
+
+	bool contains(size_t key, const string &canonical) {
+		unordered_map<size_t, vector<string> >::iterator t = trees.find(key);
+		if (t == trees.end())
+			return false;
+		if (hash_only)
+			return true;
+		for(int i = 0; i < t->second.size(); i++) {
+			if (t->second[i] == canonical)
+				return true;
+		}
+		return false;
+	}
+
+	void insert(size_t key, const string &canonical) {
+		vector<string> &strs = trees[key];
+		if (!hash_only && !contains(key, canonical))
+			strs.push_back(canonical);
+	}
+
+	public:
+	TabooList() {
+		hash_only = false;
+	}
+
+	void set_hash_only(bool h) {
+		hash_only = h;
+	}
+
+	bool contains(Node *T) {
+		string canonical = T->canonical_str();
+		return contains(hash<string>()(canonical), canonical);
+	}
+
+	void insert(Node *T) {
+		string canonical = T->canonical_str();
+		insert(hash<string>()(canonical), canonical);
+	}
+
+	// write the hashes and canonical strings, one tree per line
+	void write(ostream &out) {
+		long long num_trees = 0;
+		unordered_map<size_t, vector<string> >::iterator t;
+		for(t = trees.begin(); t != trees.end(); t++) {
+			num_trees += hash_only ? 1 : t->second.size();
+		}
+		out << "taboo_trees " << num_trees << endl;
+		for(t = trees.begin(); t != trees.end(); t++) {
+			if (hash_only)
+				out << t->first << endl;
+			for(int i = 0; i < t->second.size(); i++) {
+				out << t->first << " " << t->second[i] << endl;
+			}
+		}
+	}
+
+	// read trees written by write
+	// returns false if the input is malformed
+	bool read(istream &in) {
+		string field;
+		long long num_trees;
+		if (!(in >> field >> num_trees) || field != "taboo_trees")
+			return false;
+		in >> ws;
+		for(long long i = 0; i < num_trees; i++) {
+			string line;
+			if (!getline(in, line))
+				return false;
+			size_t space = line.find(' ');
+			size_t key = strtoull(line.substr(0, space).c_str(), NULL, 10);
+			string canonical = "";
+			if (space != string::npos)
+				canonical = line.substr(space + 1);
+			if (!hash_only && canonical.empty())
+				return false;
+			insert(key, canonical);
+		}
+		return true;
+	}
+};
+
+#endif
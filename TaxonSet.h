@@ -0,0 +1,178 @@
+/*******************************************************************************
+TaxonSet.h
+
+The taxa (numbered leaf labels) of a tree packed one bit per label. Two
+sets are compared a 64 bit word at a time with AND and popcount, so
+deciding how many taxa two trees share does not copy or walk either
+tree. TaxonSetCache holds the sets of the gene trees, built once when
+they are loaded, so the total distance functions can skip a gene tree
+that shares too few taxa with the supertree to have a nonzero distance.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_TAXONSET
+
+#define INCLUDE_TAXONSET
+
+#include <cstdio>
+#include <climits>
+#include <list>
+#include <map>
+#include <vector>
+#include "Node.h"
+
+using namespace std;
+
+class TaxonSet {
+	private:
+	vector<unsigned long long> words;
+	int num_taxa;
+
+	void add_subtree(Node *n) {
+		if (n->is_leaf()) {
+			int label = n->get_min_label();
+			if (label < INT_MAX && label >= 0)
+				add(label);
+			return;
+		}
+		list<Node *>::iterator c;
+		for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
+			add_subtree(*c);
+		}
+	}
+
+	public:
+	TaxonSet() {
+		num_taxa = 0;
+	}
+
+	// the labelled leaves of T, rho and unlabelled leaves are ignored
+	TaxonSet(Node *T) {
+		num_taxa = 0;
+		add_subtree(T);
+	}
+
+	void add(int label) {
+		int w = label / 64;
+		if (w >= words.size())
+			words.resize(w + 1, 0);
+		unsigned long long bit = 1ULL << (label % 64);
+		if (!(words[w] & bit)) {
+			words[w] |= bit;
+			num_taxa++;
+		}
+	}
+
+	bool contains(int label) {
+		int w = label / 64;
+		return label >= 0 && w < words.size()
+				&& (words[w] >> (label % 64)) & 1;
+	}
+
+	int size() {
+		return num_taxa;
+	}
+
+	// the number of taxa in both sets
+	int intersection_size(TaxonSet &other) {
+		int end = min(words.size(), other.words.size());
+		int shared = 0;
+		for(int i = 0; i < end; i++) {
+			shared += __builtin_popcountll(words[i] & other.words[i]);
+		}
+		return shared;
+	}
+
+	// true if the sets have at least n taxa in common, stops counting
+	// once n are found
+	bool shares_at_least(TaxonSet &other, int n) {
+		if (num_taxa < n || other.num_taxa < n)
+			return false;
+		int end = min(words.size(), other.words.size());
+		int shared = 0;
+		for(int i = 0; i < end && shared < n; i++) {
+			shared += __builtin_popcountll(words[i] & other.words[i]);
+		}
+		return shared >= n;
+	}
+
+	// the taxa in increasing order
+	vector<int> get_labels() {
+		vector<int> labels = vector<int>();
+		labels.reserve(num_taxa);
+		for(int i = 0; i < words.size(); i++) {
+			unsigned long long w = words[i];
+			while (w != 0) {
+				labels.push_back(i * 64 + __builtin_ctzll(w));
+				w &= w - 1;
+			}
+		}
+		return labels;
+	}
+};
+
+/* taxa of trees that are compared many times, e.g. the gene trees of a
+ * supertree search. The map is only changed by add_tree and remove, so
+ * lookups do not need to lock
+ */
+class TaxonSetCache {
+	private:
+	map<Node *, TaxonSet *> sets;
+
+	public:
+	TaxonSetCache() {
+		sets = map<Node *, TaxonSet *>();
+	}
+
+	~TaxonSetCache() {
+		map<Node *, TaxonSet *>::iterator i;
+		for(i = sets.begin(); i != sets.end(); i++) {
+			delete i->second;
+		}
+	}
+
+	void add_tree(Node *T) {
+		TaxonSet *&taxa = sets[T];
+		if (taxa != NULL)
+			delete taxa;
+		taxa = new TaxonSet(T);
+	}
+
+	void add_trees(vector<Node *> &trees) {
+		for(int i = 0; i < trees.size(); i++) {
+			add_tree(trees[i]);
+		}
+	}
+
+	void remove(Node *T) {
+		map<Node *, TaxonSet *>::iterator i = sets.find(T);
+		if (i == sets.end())
+			return;
+		delete i->second;
+		sets.erase(i);
+	}
+
+	// the taxa of T or NULL
+	TaxonSet *lookup(Node *T) {
+		map<Node *, TaxonSet *>::iterator i = sets.find(T);
+		if (i == sets.end())
+			return NULL;
+		return i->second;
+	}
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*******************************************************************************
+TreeCorpus.h
+
+Compact binary storage for a set of integer-labelled trees so that large
+inputs only need to be parsed, filtered and relabelled once. Written with
+-write_corpus and read back with -corpus by rspr and spr_supertree.
+
+File layout (native byte order, checked with a marker):
+	header
+	label table    num_labels x (uint32 length, bytes) in label id order
+	tree names     num_trees  x (uint32 length, bytes)
+	trees          num_trees  x (uint32 num_nodes,
+	                             num_nodes x (int32 label, uint32 children))
+Nodes are stored in preorder. Unlabelled nodes have label -1.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_TREECORPUS
+
+#define INCLUDE_TREECORPUS
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "Node.h"
+#include "InputBuffer.h"
+
+using namespace std;
+
+#define TREE_CORPUS_MAGIC "RSPRTREE"
+#define TREE_CORPUS_VERSION 1
+#define TREE_CORPUS_BYTE_ORDER 0x01020304
+
+// options of the writing run that determine which trees were kept
+#define CORPUS_FILTERED 1
+#define CORPUS_IGNORE_MULTI 2
+#define CORPUS_SMALL_TREES 4
+#define CORPUS_REROOTED 8
+#define CORPUS_INCLUDE_ONLY 16
+#define CORPUS_OUTGROUP 32
+
+struct TreeCorpusHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t flags;
+	uint32_t num_labels;
+	uint64_t num_trees;
+	double required_support;
+};
+
+void write_corpus_uint32(ofstream &out, uint32_t x) {
+	out.write((const char *)&x, sizeof(x));
+}
+
+void write_corpus_string(ofstream &out, const string &s) {
+	write_corpus_uint32(out, s.size());
+	out.write(s.c_str(), s.size());
+}
+
+void write_corpus_tree(ofstream &out, Node *n) {
+	int32_t label = -1;
+	if (n->get_name() != "")
+		label = n->get_name_num();
+	write_corpus_uint32(out, label);
+	write_corpus_uint32(out, n->get_children().size());
+	list<Node *>::iterator c;
+	for(c = n->get_children().begin(); c != n->get_children().end(); c++)
+		write_corpus_tree(out, *c);
+}
+
+// write trees labelled with labels_to_numbers to filename
+bool write_tree_corpus(string filename, vector<Node *> &trees,
+		vector<string> &names, map<int, string> *reverse_label_map,
+		uint32_t flags, double required_support) {
+	ofstream out(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!out.is_open())
+		return false;
+	TreeCorpusHeader header;
+	memcpy(header.magic, TREE_CORPUS_MAGIC, 8);
+	header.version = TREE_CORPUS_VERSION;
+	header.byte_order = TREE_CORPUS_BYTE_ORDER;
+	header.flags = flags;
+	header.num_labels = reverse_label_map->size();
+	header.num_trees = trees.size();
+	header.required_support = required_support;
+	out.write((const char *)&header, sizeof(header));
+	for(int i = 0; i < header.num_labels; i++) {
+		map<int, string>::iterator l = reverse_label_map->find(i);
+		if (l == reverse_label_map->end())
+			return false;
+		write_corpus_string(out, l->second);
+	}
+	for(int i = 0; i < trees.size(); i++) {
+		if (i < names.size())
+			write_corpus_string(out, names[i]);
+		else
+			write_corpus_string(out, "");
+	}
+	for(int i = 0; i < trees.size(); i++) {
+		write_corpus_uint32(out, trees[i]->size());
+		write_corpus_tree(out, trees[i]);
+	}
+	out.close();
+	return !out.fail();
+}
+
+// sequential reader over a mapped corpus
+class CorpusReader {
+	public:
+	const char *pos;
+	const char *end;
+	bool ok;
+	CorpusReader(const char *data, size_t size) {
+		pos = data;
+		end = data + size;
+		ok = true;
+	}
+	bool read(void *x, size_t n) {
+		if (!ok || end - pos < n) {
+			ok = false;
+			return false;
+		}
+		memcpy(x, pos, n);
+		pos += n;
+		return true;
+	}
+	uint32_t read_uint32() {
+		uint32_t x = 0;
+		read(&x, sizeof(x));
+		return x;
+	}
+	string read_string() {
+		uint32_t len = read_uint32();
+		if (!ok || end - pos < len) {
+			ok = false;
+			return "";
+		}
+		string s = string(pos, len);
+		pos += len;
+		return s;
+	}
+};
+
+// read a tree written by write_corpus_tree
+// returns NULL and clears in.ok if the tree is malformed or has a label
+// that is not in the label table
+Node *read_corpus_tree(CorpusReader &in, uint32_t num_labels) {
+	uint32_t num_nodes = in.read_uint32();
+	if (num_nodes == 0)
+		in.ok = false;
+	if (!in.ok)
+		return NULL;
+	Node *root = NULL;
+	// open nodes and how many children each still expects
+	vector<pair<Node *, uint32_t> > open = vector<pair<Node *, uint32_t> >();
+	for(uint32_t i = 0; i < num_nodes && in.ok; i++) {
+		int32_t label = (int32_t)in.read_uint32();
+		uint32_t num_children = in.read_uint32();
+		if (label != -1 && (label < 0 || label >= num_labels)) {
+			in.ok = false;
+			break;
+		}
+		Node *n = new Node();
+		if (label >= 0)
+			n->set_label(label);
+		if (root == NULL)
+			root = n;
+		else {
+			while (!open.empty() && open.back().second == 0)
+				open.pop_back();
+			if (open.empty()) {
+				delete n;
+				in.ok = false;
+				break;
+			}
+			open.back().first->add_child(n);
+			open.back().second--;
+		}
+		if (num_children > 0)
+			open.push_back(make_pair(n, num_children));
+	}
+	// every node must have all of its children
+	for(int i = 0; i < open.size(); i++) {
+		if (open[i].second > 0)
+			in.ok = false;
+	}
+	if (!in.ok) {
+		if (root != NULL)
+			root->delete_tree();
+		return NULL;
+	}
+	return root;
+}
+
+// read a corpus written by write_tree_corpus
+// the label maps are replaced by the corpus label table
+// returns false and adds no trees if the file is missing or malformed
+bool read_tree_corpus(string filename, vector<Node *> *trees,
+		vector<string> *names, map<string, int> *label_map,
+		map<int, string> *reverse_label_map, uint32_t *flags,
+		double *required_support) {
+	InputBuffer input(filename.c_str());
+	if (!input.is_open())
+		return false;
+	CorpusReader in = CorpusReader(input.get_data(), input.get_size());
+	TreeCorpusHeader header;
+	if (!in.read(&header, sizeof(header))
+			|| memcmp(header.magic, TREE_CORPUS_MAGIC, 8) != 0
+			|| header.version != TREE_CORPUS_VERSION
+			|| header.byte_order != TREE_CORPUS_BYTE_ORDER)
+		return false;
+	if (flags != NULL)
+		*flags = header.flags;
+	if (required_support != NULL)
+		*required_support = header.required_support;
+	label_map->clear();
+	reverse_label_map->clear();
+	for(int i = 0; i < header.num_labels && in.ok; i++) {
+		string label = in.read_string();
+		label_map->insert(make_pair(label, i));
+		reverse_label_map->insert(make_pair(i, label));
+	}
+	vector<string> tree_names = vector<string>();
+	for(uint64_t i = 0; i < header.num_trees && in.ok; i++)
+		tree_names.push_back(in.read_string());
+	int first_tree = trees->size();
+	for(uint64_t i = 0; i < header.num_trees && in.ok; i++) {
+		Node *T = read_corpus_tree(in, header.num_labels);
+		if (T == NULL) {
+			in.ok = false;
+			break;
+		}
+		trees->push_back(T);
+	}
+	if (!in.ok) {
+		for(int i = first_tree; i < trees->size(); i++)
+			(*trees)[i]->delete_tree();
+		trees->resize(first_tree);
+		return false;
+	}
+	if (names != NULL)
+		names->insert(names->end(), tree_names.begin(), tree_names.end());
+	return true;
+}
+
+#endif
@@ -30,94 +30,23 @@ along with rspr.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "Node.h"
 #include "Forest.h"
+#include <cstdlib>
 #include <list>
-#include <typeinfo>
+#include <new>
+#include <string>
+#include <vector>
 
 
 class Node;
 
-class Undoable {
-	public:
-	virtual ~Undoable() {}
-	virtual void undo() = 0;
-};
-
-class UndoMachine {
-	public:
-	list<Undoable *> events;
-	int size;
-
-	UndoMachine() {
-		events = list<Undoable *>();
-		size = 0;
-	}
-
-	void add_event(Undoable *event) {
-		events.push_back(event);
-		size++;
-	}
-
-	void insert_event(list<Undoable *>::iterator i, Undoable *event) {
-		list<Undoable *>::iterator j = i;
-		j++;
-		events.insert(j, event);
-		size++;
-	}
-
-	 list<Undoable *>::iterator get_bookmark() {
-		 list<Undoable *>::iterator bookmark = events.end();
-		 if (size > 0)
-		 	bookmark--;
-		 else
-			 bookmark = events.begin();
-		 return bookmark;
-	 }
-
-	void undo() {
-		if (!events.empty()) {
-			Undoable *event = events.back();
-#ifdef DEBUG_UNDO
-			cout << typeid(*event).name() << endl;
-#endif
-			events.pop_back();
-			event->undo();
-			delete event;
-			size--;
-		}
-	}
-
-	void undo(int num) {
-		while (num > 0)
-			undo();
-	}
-
-	void undo_all() {
-		undo_to(0);
-	}
-
-	void undo_to(int to) {
-		while (size > to)
-			undo();
-	}
-
-	void clear_to(int to) {
-		while (size > to) {
-			Undoable *event = events.back();
-			events.pop_back();
-			delete event;
-			size--;
-		}
+class UndoMachine;
 
-	}
-
-	int num_events() {
-		return size;
-	}
-};
+/* the events are plain values that remember what a change overwrote.
+ * UndoMachine stores them by value in an UndoEvent so recording and
+ * undoing a change does not allocate or make a virtual call
+ */
 
-void ContractEvent(UndoMachine *um, Node *n);
-
-class AddRho : public Undoable {
+class AddRho {
 	public:
 	Forest *F;
 	AddRho(Forest *f) {
@@ -130,7 +59,7 @@ class AddRho : public Undoable {
 	}
 };
 
-class AddComponent : public Undoable {
+class AddComponent {
 	public:
 	Forest *F;
 	AddComponent(Forest *f) {
@@ -141,7 +70,7 @@ class AddComponent : public Undoable {
 	}
 };
 
-class AddComponentToFront : public Undoable {
+class AddComponentToFront {
 	public:
 	Forest *F;
 	AddComponentToFront(Forest *f) {
@@ -154,7 +83,7 @@ class AddComponentToFront : public Undoable {
 
 // TODO: use new insert_child function with a stored successor sibling
 // does the end work? maybe a seperate variable for that?
-class CutParent : public Undoable {
+class CutParent {
 	public:
 	Node *child;
 	Node *parent;
@@ -186,7 +115,7 @@ class CutParent : public Undoable {
 	}
 };
 
-class ClearSiblingPair : public Undoable {
+class ClearSiblingPair {
 	public:
 		Node *a;
 		Node *c;
@@ -219,7 +148,7 @@ class ClearSiblingPair : public Undoable {
 		}
 };
 
-class PopClearedSiblingPair : public Undoable {
+class PopClearedSiblingPair {
 	public:
 		Node *a;
 		Node *c;
@@ -239,7 +168,7 @@ class PopClearedSiblingPair : public Undoable {
 		}
 };
 
-class PopSiblingPair : public Undoable {
+class PopSiblingPair {
 	public:
 		Node *a;
 		Node *c;
@@ -256,7 +185,7 @@ class PopSiblingPair : public Undoable {
 		}
 };
 
-class ContractSiblingPair : public Undoable {
+class ContractSiblingPair {
 	public:
 		Node *node;
 		int c1_depth;
@@ -270,21 +199,9 @@ class ContractSiblingPair : public Undoable {
 			else
 				node_protected = false;
 		}
+		// records cuts of child1 and child2 in um when n is not binary
 		ContractSiblingPair(Node *n, Node *child1, Node *child2,
-				UndoMachine *um) {
-			if (n->get_children().size() == 2)
-				init(n);
-			else {
-				um->add_event(new CutParent(child1));
-				um->add_event(new CutParent(child2));
-				binary_node = false;
-				node = n;
-			}
-			if (n->is_protected())
-				node_protected = true;
-			else
-				node_protected = false;
-		}
+				UndoMachine *um);
 
 		void init(Node *n) {
 			node = n;
@@ -312,7 +229,7 @@ class ContractSiblingPair : public Undoable {
 		}
 };
 
-class AddToFrontSiblingPairs : public Undoable {
+class AddToFrontSiblingPairs {
 	public:
 		list<Node *> *sibling_pairs;
 		AddToFrontSiblingPairs(list<Node *> *s) {
@@ -326,7 +243,7 @@ class AddToFrontSiblingPairs : public Undoable {
 		}
 };
 
-class AddToSiblingPairs : public Undoable {
+class AddToSiblingPairs {
 	public:
 		list<Node *> *sibling_pairs;
 		AddToSiblingPairs(list<Node *> *s) {
@@ -340,36 +257,7 @@ class AddToSiblingPairs : public Undoable {
 		}
 };
 
-class AddToSetSiblingPairs : public Undoable {
-	public:
-		set<SiblingPair> *sibling_pairs;
-		SiblingPair pair;
-		AddToSetSiblingPairs(set<SiblingPair> *sp, SiblingPair p) {
-			sibling_pairs = sp;
-			//pair = SiblingPair(p->a,p->c);
-			pair = p;
-		}
-		void undo() {
-			if (!sibling_pairs->empty()) {
-				sibling_pairs->erase(pair);
-			}
-		}
-};
-
-class RemoveSetSiblingPairs : public Undoable {
-	public:
-		set<SiblingPair> *sibling_pairs;
-		SiblingPair pair;
-		RemoveSetSiblingPairs(set<SiblingPair> *sp, SiblingPair p) {
-			sibling_pairs = sp;
-			pair = p;
-		}
-		void undo() {
-			sibling_pairs->insert(pair);
-		}
-};
-
-class AddInSiblingPairs : public Undoable {
+class AddInSiblingPairs {
 	public:
 		list<Node *> *sibling_pairs;
 		int pos;
@@ -395,7 +283,7 @@ class AddInSiblingPairs : public Undoable {
 		}
 };
 
-class SetTwin : public Undoable {
+class SetTwin {
 	public:
 		Node *node;
 		Node *twin;
@@ -410,23 +298,25 @@ class SetTwin : public Undoable {
 		}
 };
 
-class ChangeName : public Undoable {
+// the old name is kept by the UndoMachine, name_index is its position
+class ChangeName {
 	public:
 		Node *node;
-		string name;
+		int name_index;
+		int label;
 
 		ChangeName(Node *n) {
 			node = n;
-			name = n->get_name();//str();
-//			name = n->str();
+			name_index = -1;
+			label = n->get_label();
 		}
 
-		void undo() {
-			node->set_name(name);
+		void undo(vector<string> &names) {
+			node->set_name(names[name_index], label);
 		}
 };
 
-class ChangeEdgePreInterval : public Undoable {
+class ChangeEdgePreInterval {
 	public:
 		Node *node;
 		int start;
@@ -444,7 +334,7 @@ class ChangeEdgePreInterval : public Undoable {
 		}
 };
 
-class ChangePreNum : public Undoable {
+class ChangePreNum {
 	public:
 		Node *node;
 		int prenum;
@@ -459,7 +349,7 @@ class ChangePreNum : public Undoable {
 		}
 };
 
-class ChangeRightChild : public Undoable {
+class ChangeRightChild {
 	public:
 		Node *node;
 		Node *rchild;
@@ -484,7 +374,7 @@ class ChangeRightChild : public Undoable {
 		}
 };
 
-class ChangeLeftChild : public Undoable {
+class ChangeLeftChild {
 	public:
 		Node *node;
 		Node *lchild;
@@ -509,7 +399,7 @@ class ChangeLeftChild : public Undoable {
 		}
 };
 
-class AddChild : public Undoable {
+class AddChild {
 	public:
 		Node *child;
 		int depth;
@@ -528,7 +418,7 @@ class AddChild : public Undoable {
 		}
 };
 
-class AddContractedLC : public Undoable {
+class AddContractedLC {
 	public:
 		Node *node;
 
@@ -541,7 +431,7 @@ class AddContractedLC : public Undoable {
 		}
 };
 
-class AddContractedRC : public Undoable {
+class AddContractedRC {
 	public:
 		Node *node;
 
@@ -554,7 +444,7 @@ class AddContractedRC : public Undoable {
 		}
 };
 
-class CreateNode : public Undoable {
+class CreateNode {
 	public:
 		Node *node;
 
@@ -568,7 +458,7 @@ class CreateNode : public Undoable {
 		}
 };
 
-class ProtectEdge : public Undoable {
+class ProtectEdge {
 	public:
 		Node *node;
 
@@ -582,7 +472,7 @@ class ProtectEdge : public Undoable {
 		}
 };
 
-class UnprotectEdge : public Undoable {
+class UnprotectEdge {
 	public:
 		Node *node;
 
@@ -596,7 +486,7 @@ class UnprotectEdge : public Undoable {
 		}
 };
 
-class ListPushBack : public Undoable {
+class ListPushBack {
 	public:
 		list<Node *> *l;
 
@@ -609,7 +499,7 @@ class ListPushBack : public Undoable {
 		}
 };
 
-class ListPopBack : public Undoable {
+class ListPopBack {
 	public:
 		list<Node *> *l;
 		Node *node;
@@ -629,8 +519,349 @@ class ListPopBack : public Undoable {
 };
 
 
-void ContractEvent(UndoMachine *um, Node *n, list<Undoable *>::iterator
-		bookmark) {
+enum UndoEventType {
+	UNDO_ADD_RHO,
+	UNDO_ADD_COMPONENT,
+	UNDO_ADD_COMPONENT_TO_FRONT,
+	UNDO_CUT_PARENT,
+	UNDO_CLEAR_SIBLING_PAIR,
+	UNDO_POP_CLEARED_SIBLING_PAIR,
+	UNDO_POP_SIBLING_PAIR,
+	UNDO_CONTRACT_SIBLING_PAIR,
+	UNDO_ADD_TO_FRONT_SIBLING_PAIRS,
+	UNDO_ADD_TO_SIBLING_PAIRS,
+	UNDO_ADD_IN_SIBLING_PAIRS,
+	UNDO_SET_TWIN,
+	UNDO_CHANGE_NAME,
+	UNDO_CHANGE_EDGE_PRE_INTERVAL,
+	UNDO_CHANGE_PRE_NUM,
+	UNDO_CHANGE_RIGHT_CHILD,
+	UNDO_CHANGE_LEFT_CHILD,
+	UNDO_ADD_CHILD,
+	UNDO_ADD_CONTRACTED_LC,
+	UNDO_ADD_CONTRACTED_RC,
+	UNDO_CREATE_NODE,
+	UNDO_PROTECT_EDGE,
+	UNDO_UNPROTECT_EDGE,
+	UNDO_LIST_PUSH_BACK,
+	UNDO_LIST_POP_BACK,
+};
+
+// one recorded change, tagged with the type of event it holds
+class UndoEvent {
+	public:
+	UndoEventType type;
+	union {
+		AddRho add_rho;
+		AddComponent add_component;
+		AddComponentToFront add_component_to_front;
+		CutParent cut_parent;
+		ClearSiblingPair clear_sibling_pair;
+		PopClearedSiblingPair pop_cleared_sibling_pair;
+		PopSiblingPair pop_sibling_pair;
+		ContractSiblingPair contract_sibling_pair;
+		AddToFrontSiblingPairs add_to_front_sibling_pairs;
+		AddToSiblingPairs add_to_sibling_pairs;
+		AddInSiblingPairs add_in_sibling_pairs;
+		SetTwin set_twin;
+		ChangeName change_name;
+		ChangeEdgePreInterval change_edge_pre_interval;
+		ChangePreNum change_pre_num;
+		ChangeRightChild change_right_child;
+		ChangeLeftChild change_left_child;
+		AddChild add_child;
+		AddContractedLC add_contracted_lc;
+		AddContractedRC add_contracted_rc;
+		CreateNode create_node;
+		ProtectEdge protect_edge;
+		UnprotectEdge unprotect_edge;
+		ListPushBack list_push_back;
+		ListPopBack list_pop_back;
+	};
+
+	UndoEvent(const AddRho &e) {
+		type = UNDO_ADD_RHO;
+		new (&add_rho) AddRho(e);
+	}
+	UndoEvent(const AddComponent &e) {
+		type = UNDO_ADD_COMPONENT;
+		new (&add_component) AddComponent(e);
+	}
+	UndoEvent(const AddComponentToFront &e) {
+		type = UNDO_ADD_COMPONENT_TO_FRONT;
+		new (&add_component_to_front) AddComponentToFront(e);
+	}
+	UndoEvent(const CutParent &e) {
+		type = UNDO_CUT_PARENT;
+		new (&cut_parent) CutParent(e);
+	}
+	UndoEvent(const ClearSiblingPair &e) {
+		type = UNDO_CLEAR_SIBLING_PAIR;
+		new (&clear_sibling_pair) ClearSiblingPair(e);
+	}
+	UndoEvent(const PopClearedSiblingPair &e) {
+		type = UNDO_POP_CLEARED_SIBLING_PAIR;
+		new (&pop_cleared_sibling_pair) PopClearedSiblingPair(e);
+	}
+	UndoEvent(const PopSiblingPair &e) {
+		type = UNDO_POP_SIBLING_PAIR;
+		new (&pop_sibling_pair) PopSiblingPair(e);
+	}
+	UndoEvent(const ContractSiblingPair &e) {
+		type = UNDO_CONTRACT_SIBLING_PAIR;
+		new (&contract_sibling_pair) ContractSiblingPair(e);
+	}
+	UndoEvent(const AddToFrontSiblingPairs &e) {
+		type = UNDO_ADD_TO_FRONT_SIBLING_PAIRS;
+		new (&add_to_front_sibling_pairs) AddToFrontSiblingPairs(e);
+	}
+	UndoEvent(const AddToSiblingPairs &e) {
+		type = UNDO_ADD_TO_SIBLING_PAIRS;
+		new (&add_to_sibling_pairs) AddToSiblingPairs(e);
+	}
+	UndoEvent(const AddInSiblingPairs &e) {
+		type = UNDO_ADD_IN_SIBLING_PAIRS;
+		new (&add_in_sibling_pairs) AddInSiblingPairs(e);
+	}
+	UndoEvent(const SetTwin &e) {
+		type = UNDO_SET_TWIN;
+		new (&set_twin) SetTwin(e);
+	}
+	UndoEvent(const ChangeName &e) {
+		type = UNDO_CHANGE_NAME;
+		new (&change_name) ChangeName(e);
+	}
+	UndoEvent(const ChangeEdgePreInterval &e) {
+		type = UNDO_CHANGE_EDGE_PRE_INTERVAL;
+		new (&change_edge_pre_interval) ChangeEdgePreInterval(e);
+	}
+	UndoEvent(const ChangePreNum &e) {
+		type = UNDO_CHANGE_PRE_NUM;
+		new (&change_pre_num) ChangePreNum(e);
+	}
+	UndoEvent(const ChangeRightChild &e) {
+		type = UNDO_CHANGE_RIGHT_CHILD;
+		new (&change_right_child) ChangeRightChild(e);
+	}
+	UndoEvent(const ChangeLeftChild &e) {
+		type = UNDO_CHANGE_LEFT_CHILD;
+		new (&change_left_child) ChangeLeftChild(e);
+	}
+	UndoEvent(const AddChild &e) {
+		type = UNDO_ADD_CHILD;
+		new (&add_child) AddChild(e);
+	}
+	UndoEvent(const AddContractedLC &e) {
+		type = UNDO_ADD_CONTRACTED_LC;
+		new (&add_contracted_lc) AddContractedLC(e);
+	}
+	UndoEvent(const AddContractedRC &e) {
+		type = UNDO_ADD_CONTRACTED_RC;
+		new (&add_contracted_rc) AddContractedRC(e);
+	}
+	UndoEvent(const CreateNode &e) {
+		type = UNDO_CREATE_NODE;
+		new (&create_node) CreateNode(e);
+	}
+	UndoEvent(const ProtectEdge &e) {
+		type = UNDO_PROTECT_EDGE;
+		new (&protect_edge) ProtectEdge(e);
+	}
+	UndoEvent(const UnprotectEdge &e) {
+		type = UNDO_UNPROTECT_EDGE;
+		new (&unprotect_edge) UnprotectEdge(e);
+	}
+	UndoEvent(const ListPushBack &e) {
+		type = UNDO_LIST_PUSH_BACK;
+		new (&list_push_back) ListPushBack(e);
+	}
+	UndoEvent(const ListPopBack &e) {
+		type = UNDO_LIST_POP_BACK;
+		new (&list_pop_back) ListPopBack(e);
+	}
+
+	/* names holds the old names of the ChangeName events, which are
+	 * recorded in the same order as the events
+	 */
+	void undo(vector<string> &names) {
+		switch (type) {
+			case UNDO_ADD_RHO:
+				add_rho.undo();
+				break;
+			case UNDO_ADD_COMPONENT:
+				add_component.undo();
+				break;
+			case UNDO_ADD_COMPONENT_TO_FRONT:
+				add_component_to_front.undo();
+				break;
+			case UNDO_CUT_PARENT:
+				cut_parent.undo();
+				break;
+			case UNDO_CLEAR_SIBLING_PAIR:
+				clear_sibling_pair.undo();
+				break;
+			case UNDO_POP_CLEARED_SIBLING_PAIR:
+				pop_cleared_sibling_pair.undo();
+				break;
+			case UNDO_POP_SIBLING_PAIR:
+				pop_sibling_pair.undo();
+				break;
+			case UNDO_CONTRACT_SIBLING_PAIR:
+				contract_sibling_pair.undo();
+				break;
+			case UNDO_ADD_TO_FRONT_SIBLING_PAIRS:
+				add_to_front_sibling_pairs.undo();
+				break;
+			case UNDO_ADD_TO_SIBLING_PAIRS:
+				add_to_sibling_pairs.undo();
+				break;
+			case UNDO_ADD_IN_SIBLING_PAIRS:
+				add_in_sibling_pairs.undo();
+				break;
+			case UNDO_SET_TWIN:
+				set_twin.undo();
+				break;
+			case UNDO_CHANGE_NAME:
+				change_name.undo(names);
+				names.resize(change_name.name_index);
+				break;
+			case UNDO_CHANGE_EDGE_PRE_INTERVAL:
+				change_edge_pre_interval.undo();
+				break;
+			case UNDO_CHANGE_PRE_NUM:
+				change_pre_num.undo();
+				break;
+			case UNDO_CHANGE_RIGHT_CHILD:
+				change_right_child.undo();
+				break;
+			case UNDO_CHANGE_LEFT_CHILD:
+				change_left_child.undo();
+				break;
+			case UNDO_ADD_CHILD:
+				add_child.undo();
+				break;
+			case UNDO_ADD_CONTRACTED_LC:
+				add_contracted_lc.undo();
+				break;
+			case UNDO_ADD_CONTRACTED_RC:
+				add_contracted_rc.undo();
+				break;
+			case UNDO_CREATE_NODE:
+				create_node.undo();
+				break;
+			case UNDO_PROTECT_EDGE:
+				protect_edge.undo();
+				break;
+			case UNDO_UNPROTECT_EDGE:
+				unprotect_edge.undo();
+				break;
+			case UNDO_LIST_PUSH_BACK:
+				list_push_back.undo();
+				break;
+			case UNDO_LIST_POP_BACK:
+				list_pop_back.undo();
+				break;
+			default:
+				// an event that was never constructed
+				abort();
+		}
+	}
+};
+
+/* a log of changes that can be undone in reverse order. num_events() is
+ * a bookmark that undo_to and insert_event accept. The old names of
+ * ChangeName events are kept on a stack that is popped as they are
+ * undone, so a ChangeName can only be added at the end of the log
+ */
+class UndoMachine {
+	public:
+	vector<UndoEvent> events;
+	// old names of the ChangeName events
+	vector<string> names;
+
+	UndoMachine() {
+		events.reserve(64);
+	}
+
+	template <typename T>
+	void add_event(const T &event) {
+		events.push_back(UndoEvent(event));
+	}
+
+	void add_event(ChangeName event) {
+		event.name_index = names.size();
+		names.push_back(event.node->get_name());
+		events.push_back(UndoEvent(event));
+	}
+
+	// record event just after the events that were recorded at bookmark
+	template <typename T>
+	void insert_event(int bookmark, const T &event) {
+		events.insert(events.begin() + bookmark, UndoEvent(event));
+	}
+
+	void insert_event(int bookmark, ChangeName event) = delete;
+
+	int get_bookmark() {
+		return events.size();
+	}
+
+	void undo() {
+		if (!events.empty()) {
+			UndoEvent &event = events.back();
+#ifdef DEBUG_UNDO
+			cout << event.type << endl;
+#endif
+			event.undo(names);
+			events.pop_back();
+		}
+	}
+
+	void undo(int num) {
+		undo_to(num_events() - num);
+	}
+
+	void undo_all() {
+		undo_to(0);
+	}
+
+	void undo_to(int to) {
+		while (events.size() > to)
+			undo();
+	}
+
+	void clear_to(int to) {
+		while (events.size() > to) {
+			if (events.back().type == UNDO_CHANGE_NAME)
+				names.resize(events.back().change_name.name_index);
+			events.pop_back();
+		}
+	}
+
+	int num_events() {
+		return events.size();
+	}
+};
+
+void ContractEvent(UndoMachine *um, Node *n);
+
+ContractSiblingPair::ContractSiblingPair(Node *n, Node *child1, Node *child2,
+		UndoMachine *um) {
+	if (n->get_children().size() == 2)
+		init(n);
+	else {
+		um->add_event(CutParent(child1));
+		um->add_event(CutParent(child2));
+		binary_node = false;
+		node = n;
+	}
+	if (n->is_protected())
+		node_protected = true;
+	else
+		node_protected = false;
+}
+
+void ContractEvent(UndoMachine *um, Node *n, int bookmark) {
 		Node *parent = n->parent();
 		Node *child;
 		Node *lc = n->lchild();
@@ -640,22 +871,22 @@ void ContractEvent(UndoMachine *um, Node *n, list<Undoable *>::iterator
 		if (parent != NULL) {
 			if (lc && !rc) {
 				child = lc;
-				um->add_event(new ChangeEdgePreInterval(child));
-				um->add_event(new CutParent(child));
-				um->add_event(new CutParent(n));
+				um->add_event(ChangeEdgePreInterval(child));
+				um->add_event(CutParent(child));
+				um->add_event(CutParent(n));
 				if (n->is_protected() && !child->is_protected())
-					um->add_event(new ProtectEdge(child));
+					um->add_event(ProtectEdge(child));
 			}
 			else if (rc && !lc) {
 				child = rc;
-				um->add_event(new ChangeEdgePreInterval(child));
-				um->add_event(new CutParent(child));
-				um->add_event(new CutParent(n));
+				um->add_event(ChangeEdgePreInterval(child));
+				um->add_event(CutParent(child));
+				um->add_event(CutParent(n));
 				if (n->is_protected() && !child->is_protected())
-					um->add_event(new ProtectEdge(child));
+					um->add_event(ProtectEdge(child));
 			}
 			else if (lc == NULL && rc == NULL) {
-				um->insert_event(bookmark, new CutParent(n));
+				um->insert_event(bookmark, CutParent(n));
 				parent->delete_child(n);
 				ContractEvent(um, parent);
 				parent->add_child(n);
@@ -666,26 +897,26 @@ void ContractEvent(UndoMachine *um, Node *n, list<Undoable *>::iterator
 
 			// dead component or singleton, will be cleaned up by the forest
 			if (n->get_children().empty()) {
-				um->add_event(new ChangeName(n));
+				um->add_event(ChangeName(n));
 			}
 			else if (n->get_children().size() == 1) {
 				child = n->get_children().front();
 //				if (rc == NULL) {
-//					um->add_event(new ChangeRightChild(n));
+//					um->add_event(ChangeRightChild(n));
 //					child = lc;
 //				}
 //				else {
-//					um->add_event(new ChangeLeftChild(n));
+//					um->add_event(ChangeLeftChild(n));
 //					child = rc;
 //				}
-				um->add_event(new CutParent(child));
+				um->add_event(CutParent(child));
 				/* cluster hack - if we delete a cluster node then
 				 * we may try to use it later. This only happens once
 				 * per cluster so we can spend linear time to update
 				 * the forest
 				 */
 				if (child->get_num_clustered_children() > 0) {
-					//um->add_event(new CutParent(n));
+					//um->add_event(CutParent(n));
 				}
 				else {
 					// if child is a leaf then get rid of this so we don't lose refs
@@ -698,23 +929,23 @@ void ContractEvent(UndoMachine *um, Node *n, list<Undoable *>::iterator
 					Node *new_rc = child->rchild();
 					if (child->is_leaf()) {
 						if (child->get_twin() != NULL) {
-							um->add_event(new SetTwin(n));
-							um->add_event(new SetTwin(child->get_twin()));
+							um->add_event(SetTwin(n));
+							um->add_event(SetTwin(child->get_twin()));
 						}
-						um->add_event(new ChangeName(n));
+						um->add_event(ChangeName(n));
 					}
-					um->add_event(new ChangePreNum(n));
-					//um->add_event(new CutParent(n));
+					um->add_event(ChangePreNum(n));
+					//um->add_event(CutParent(n));
 					list<Node *>::iterator c;
 					for(c = child->get_children().begin();
 							c != child->get_children().end();
 							c++) {
-						um->add_event(new CutParent(*c));
+						um->add_event(CutParent(*c));
 					}
 					if (child->get_contracted_lc() != NULL)
-						um->add_event(new AddContractedLC(n));
+						um->add_event(AddContractedLC(n));
 					if (child->get_contracted_rc() != NULL)
-						um->add_event(new AddContractedRC(n));
+						um->add_event(AddContractedRC(n));
 				}
 			}
 		}
@@ -722,7 +953,7 @@ void ContractEvent(UndoMachine *um, Node *n, list<Undoable *>::iterator
 	}
 
 void ContractEvent(UndoMachine *um, Node *n) {
-	list<Undoable *>::iterator bookmark = um->get_bookmark();
+	int bookmark = um->get_bookmark();
 	ContractEvent(um, n, bookmark);
 }
 
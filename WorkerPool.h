@@ -0,0 +1,445 @@
+/*******************************************************************************
+WorkerPool.h
+
+Scoring of candidate supertrees by worker processes. A worker is started
+with spr_supertree -worker PORT and waits for a coordinator, a normal
+spr_supertree run given -workers HOST:PORT,... . The coordinator sends
+each worker a shard of the gene trees and then batches of candidate
+supertrees. Each worker returns the total distance of its shard to each
+candidate and the coordinator adds them up. The workers can run on the
+same machine as the coordinator or on others.
+
+The connections are TCP and the protocol is text, one message per line.
+Trees have numbered labels as written by str_subtree after
+labels_to_numbers. Gene trees are numbered by their position in the
+coordinator's list.
+	coordinator                worker
+	clear
+	tree <i> <weight> <tree>   (once for each gene tree of the shard)
+	ready <mode>               ok <number of gene trees>
+	                           or mode <the worker's mode>
+	subset <n> <i> ...         (optional, score only these gene trees)
+	subset all
+	score <threshold> <k>
+	<tree>                     (k candidates)
+	                           <total>  (k totals)
+	quit
+The mode lists the options that change the distances, such as -unrooted
+and -max. A worker started with other options replies with its own mode
+instead of ok, and the coordinator then scores locally.
+A total is exact if it is at most the threshold and otherwise only
+known to be larger, as for rSPR_total_distance. A worker that cannot
+read a whole batch closes the connection instead of replying, and the
+coordinator treats a missing or malformed total as a lost worker.
+
+There is no authentication and the workers parse the trees they are
+sent, so by default a worker only accepts connections from the same
+machine. -worker_listen_all makes it accept them from any address.
+
+This file is part of rspr.
+
+rspr is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+rspr is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with rspr.  If not, see <http://www.gnu.org/licenses/>.
+
+*******************************************************************************/
+#ifndef INCLUDE_WORKERPOOL
+
+#define INCLUDE_WORKERPOOL
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <sstream>
+#include <map>
+#include <vector>
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#include "Node.h"
+
+using namespace std;
+
+// candidate supertrees sent to the workers at a time. The best total
+// of one batch is the threshold of the next
+#define WORKER_BATCH 32
+
+// buffered line reads and writes over a socket
+class LineChannel {
+	private:
+	int fd;
+	string buffer;
+	size_t pos;
+
+	public:
+	LineChannel(int fd) {
+		this->fd = fd;
+		buffer = "";
+		pos = 0;
+	}
+
+	bool is_open() {
+		return fd >= 0;
+	}
+
+	bool send_line(const string &line) {
+		string s = line + "\n";
+		return send_all(s.c_str(), s.size());
+	}
+
+	bool send_all(const char *data, size_t size) {
+#ifndef _WIN32
+		int flags = 0;
+#ifdef MSG_NOSIGNAL
+		flags = MSG_NOSIGNAL;
+#endif
+		while (size > 0 && fd >= 0) {
+			ssize_t sent = send(fd, data, size, flags);
+			if (sent <= 0)
+				return false;
+			data += sent;
+			size -= sent;
+		}
+		return fd >= 0;
+#else
+		return false;
+#endif
+	}
+
+	// false if the connection was closed before a full line arrived
+	bool read_line(string &line) {
+#ifndef _WIN32
+		while (fd >= 0) {
+			size_t end = buffer.find('\n', pos);
+			if (end != string::npos) {
+				line = buffer.substr(pos, end - pos);
+				pos = end + 1;
+				if (pos > 65536) {
+					buffer.erase(0, pos);
+					pos = 0;
+				}
+				return true;
+			}
+			char data[65536];
+			ssize_t received = recv(fd, data, sizeof(data), 0);
+			if (received <= 0)
+				return false;
+			buffer.append(data, received);
+		}
+#endif
+		return false;
+	}
+
+	void close_channel() {
+#ifndef _WIN32
+		if (fd >= 0)
+			close(fd);
+#endif
+		fd = -1;
+	}
+};
+
+#ifndef _WIN32
+void set_socket_options(int fd) {
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+#endif
+
+// listen for a coordinator on port, on any address if listen_all is true
+// and otherwise only on the loopback address. If port is 0 a free port
+// is chosen and port is set to it
+// returns a listening socket or -1
+int listen_for_coordinator(int &port, bool listen_all) {
+#ifndef _WIN32
+	int listener = -1;
+	if (listen_all)
+		listener = socket(AF_INET6, SOCK_STREAM, 0);
+	bool ipv6 = listener >= 0;
+	if (!ipv6)
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+		return -1;
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	int bound;
+	if (ipv6) {
+		int off = 0;
+		setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		struct sockaddr_in6 address;
+		memset(&address, 0, sizeof(address));
+		address.sin6_family = AF_INET6;
+		address.sin6_addr = in6addr_any;
+		address.sin6_port = htons(port);
+		bound = ::bind(listener, (struct sockaddr *)&address,
+				sizeof(address));
+	}
+	else {
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		if (listen_all)
+			address.sin_addr.s_addr = htonl(INADDR_ANY);
+		else
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(port);
+		bound = ::bind(listener, (struct sockaddr *)&address,
+				sizeof(address));
+	}
+	if (bound < 0 || listen(listener, 1) < 0) {
+		close(listener);
+		return -1;
+	}
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	if (getsockname(listener, (struct sockaddr *)&address, &length) < 0) {
+		close(listener);
+		return -1;
+	}
+	if (address.ss_family == AF_INET6)
+		port = ntohs(((struct sockaddr_in6 *)&address)->sin6_port);
+	else
+		port = ntohs(((struct sockaddr_in *)&address)->sin_port);
+	return listener;
+#else
+	return -1;
+#endif
+}
+
+// wait for one coordinator to connect to a socket from
+// listen_for_coordinator, which is then closed
+// returns a socket or -1
+int accept_coordinator(int listener) {
+#ifndef _WIN32
+	int fd = accept(listener, NULL, NULL);
+	close(listener);
+	if (fd >= 0)
+		set_socket_options(fd);
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+// connect to a worker given as host:port
+// returns a socket or -1
+int connect_to_worker(string worker) {
+#ifndef _WIN32
+	size_t colon = worker.rfind(':');
+	if (colon == string::npos)
+		return -1;
+	string host = worker.substr(0, colon);
+	string port = worker.substr(colon + 1);
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *addresses;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+		return -1;
+	int fd = -1;
+	for(struct addrinfo *a = addresses; a != NULL; a = a->ai_next) {
+		fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addresses);
+	if (fd >= 0)
+		set_socket_options(fd);
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+// parse a total sent by a worker
+bool parse_total(const string &reply, long long &total) {
+	if (reply.empty())
+		return false;
+	char *end;
+	total = strtoll(reply.c_str(), &end, 10);
+	return *end == '\0';
+}
+
+class WorkerPool {
+	private:
+	vector<string> names;
+	vector<LineChannel> workers;
+	// position of each gene tree sent by distribute
+	map<Node *, int> gene_tree_index;
+	// positions of the gene trees the workers score, empty for all
+	vector<int> subset;
+
+	public:
+	WorkerPool() {
+		names = vector<string>();
+		workers = vector<LineChannel>();
+		gene_tree_index = map<Node *, int>();
+		subset = vector<int>();
+	}
+
+	~WorkerPool() {
+		for(int w = 0; w < workers.size(); w++) {
+			workers[w].send_line("quit");
+			workers[w].close_channel();
+		}
+	}
+
+	int size() {
+		return workers.size();
+	}
+
+	// connect to a comma separated list of host:port workers
+	// returns false and sets failed to the first worker that could not
+	// be reached
+	bool connect_workers(string list, string &failed) {
+		stringstream ss(list);
+		string worker;
+		while (getline(ss, worker, ',')) {
+			if (worker.empty())
+				continue;
+			int fd = connect_to_worker(worker);
+			if (fd < 0) {
+				failed = worker;
+				return false;
+			}
+			names.push_back(worker);
+			workers.push_back(LineChannel(fd));
+		}
+		return !workers.empty();
+	}
+
+	/* send gene tree i to worker i mod size(), replacing any trees sent
+	 * before, and wait for the workers to build them
+	 * returns false if a worker could not be reached or scores with a
+	 * mode other than mode. failed is then set to that worker's reply
+	 */
+	bool distribute(vector<Node *> &gene_trees, vector<int> &weights,
+			const string &mode, string &failed) {
+		for(int w = 0; w < workers.size(); w++) {
+			if (!workers[w].send_line("clear"))
+				return false;
+		}
+		gene_tree_index.clear();
+		subset.clear();
+		vector<int> shard_sizes = vector<int>(workers.size(), 0);
+		for(int i = 0; i < gene_trees.size(); i++) {
+			int w = i % workers.size();
+			gene_tree_index[gene_trees[i]] = i;
+			stringstream line;
+			line << "tree " << i << " " << weights[i] << " "
+					<< gene_trees[i]->str_subtree();
+			if (!workers[w].send_line(line.str()))
+				return false;
+			shard_sizes[w]++;
+		}
+		for(int w = 0; w < workers.size(); w++) {
+			if (!workers[w].send_line("ready " + mode))
+				return false;
+		}
+		for(int w = 0; w < workers.size(); w++) {
+			string reply;
+			stringstream expected;
+			expected << "ok " << shard_sizes[w];
+			if (!workers[w].read_line(reply) || reply != expected.str()) {
+				failed = names[w] + ": " + reply;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/* score only gene_trees, which must be nonempty and all have been
+	 * sent by distribute, until the next call
+	 */
+	bool set_subset(vector<Node *> &gene_trees) {
+		vector<int> positions = vector<int>();
+		if (gene_trees.size() < gene_tree_index.size()) {
+			for(int i = 0; i < gene_trees.size(); i++) {
+				map<Node *, int>::iterator j =
+						gene_tree_index.find(gene_trees[i]);
+				if (j == gene_tree_index.end())
+					return false;
+				positions.push_back(j->second);
+			}
+		}
+		if (positions == subset)
+			return true;
+		stringstream line;
+		if (positions.empty())
+			line << "subset all";
+		else {
+			line << "subset " << positions.size();
+			for(int i = 0; i < positions.size(); i++) {
+				line << " " << positions[i];
+			}
+		}
+		for(int w = 0; w < workers.size(); w++) {
+			if (!workers[w].send_line(line.str()))
+				return false;
+		}
+		subset = positions;
+		return true;
+	}
+
+	/* set totals to the total distance of the gene trees to each of
+	 * trees. The workers score their shards at the same time
+	 * returns false if a worker could not be reached or did not send a
+	 * total for each tree
+	 */
+	bool score(vector<string> &trees, int threshold, vector<int> &totals) {
+		stringstream header;
+		header << "score " << threshold << " " << trees.size();
+		for(int w = 0; w < workers.size(); w++) {
+			if (!workers[w].send_line(header.str()))
+				return false;
+			for(int i = 0; i < trees.size(); i++) {
+				if (!workers[w].send_line(trees[i]))
+					return false;
+			}
+		}
+		vector<long long> sums = vector<long long>(trees.size(), 0);
+		for(int w = 0; w < workers.size(); w++) {
+			for(int i = 0; i < trees.size(); i++) {
+				string reply;
+				long long total;
+				if (!workers[w].read_line(reply) || !parse_total(reply, total))
+					return false;
+				sums[i] += total;
+			}
+		}
+		totals = vector<int>(trees.size());
+		for(int i = 0; i < trees.size(); i++) {
+			if (sums[i] > INT_MAX)
+				totals[i] = INT_MAX;
+			else
+				totals[i] = sums[i];
+		}
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,90 @@
+// time recording and undoing UndoMachine events on a caterpillar tree
+// usage: bench_undo [leaves] [rounds]
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <climits>
+#include <vector>
+#include <map>
+#include <list>
+#include <chrono>
+#include "rspr.h"
+#include "UndoMachine.h"
+
+using namespace std;
+
+string caterpillar(int n) {
+	stringstream ss;
+	for(int i = 2; i <= n; i++) {
+		ss << "(";
+	}
+	ss << "1";
+	for(int i = 2; i <= n; i++) {
+		ss << "," << i << ")";
+	}
+	ss << ";";
+	return ss.str();
+}
+
+int main(int argc, char **argv) {
+	int n = 200;
+	int rounds = 20000;
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	Node *T = build_tree(caterpillar(n));
+	Node *T2 = build_tree(caterpillar(n));
+	T->preorder_number();
+	string before = T->str_subtree();
+	vector<Node *> nodes = T->find_descendants();
+	nodes.push_back(T);
+	vector<Node *> nodes2 = T2->find_descendants();
+	nodes2.push_back(T2);
+
+	long long events = 0;
+	UndoMachine um = UndoMachine();
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for(int r = 0; r < rounds; r++) {
+		// record a mix of changes from a bookmark and roll them back
+		int bookmark = um.num_events();
+		for(int i = 0; i < nodes.size(); i++) {
+			Node *x = nodes[i];
+			um.add_event(SetTwin(x));
+			x->set_twin(nodes2[i]);
+			um.add_event(ChangePreNum(x));
+			x->set_preorder_number(r);
+			um.add_event(ChangeEdgePreInterval(x));
+			x->set_edge_pre_start(r);
+			if (!x->is_protected()) {
+				um.add_event(ProtectEdge(x));
+				x->protect_edge();
+			}
+			if (x->is_leaf() && (i % 16) == 0) {
+				um.add_event(ChangeName(x));
+				x->set_name("x");
+			}
+			if (x->is_leaf() && x->parent() != NULL && (i % 4) == 0) {
+				um.add_event(CutParent(x));
+				x->cut_parent();
+			}
+		}
+		events += um.num_events() - bookmark;
+		um.undo_to(bookmark);
+	}
+	chrono::steady_clock::time_point end = chrono::steady_clock::now();
+	double seconds = chrono::duration<double>(end - start).count();
+	cout << "events: " << events << endl;
+	cout << "seconds: " << seconds << endl;
+	cout << "Mevents/s: " << events / seconds / 1e6 << endl;
+	if (T->str_subtree() != before) {
+		cout << "FAILED: the tree was not restored" << endl;
+		return 1;
+	}
+	T->delete_tree();
+	T2->delete_tree();
+	return 0;
+}
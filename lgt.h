@@ -75,6 +75,8 @@ void add_transfers(vector<vector<int> > *transfer_counts, Node *super_tree,
 		vector<Node *> *gene_trees);
 void add_transfers(vector<vector<int> > *transfer_counts, Forest *F1,
 		Forest *F2, Forest *MAF1, Forest *MAF2);
+void add_transfers(vector<vector<int> > *transfer_counts, Forest *F1,
+		Forest *F2, Forest *MAF1, Forest *MAF2, int weight);
 void print_transfers(Node *super_tree, Forest *F1, Forest *F2, Forest *MAF1,
 		Forest *MAF2, map<int, string> *reverse_label_map);
 void print_leaf_list(Node *F1_source, map<int, string> *reverse_label_map);
@@ -150,7 +152,8 @@ void add_transfers(vector<vector<int> > *transfer_counts, Node *super_tree,
 			cout << "\tF2: "; MAF2->print_components_with_edge_pre_interval();
 #endif
 			sync_af_twins(MAF1, MAF2);
-			add_transfers(transfer_counts, &F1, &F2, MAF1, MAF2);
+			add_transfers(transfer_counts, &F1, &F2, MAF1, MAF2,
+					tree_weight((*gene_trees)[i]));
 		}
 		if (MAF1 != NULL)
 			delete MAF1;
@@ -161,6 +164,13 @@ void add_transfers(vector<vector<int> > *transfer_counts, Node *super_tree,
 
 void add_transfers(vector<vector<int> > *transfer_counts, Forest *F1,
 		Forest *F2, Forest *MAF1, Forest *MAF2) {
+	add_transfers(transfer_counts, F1, F2, MAF1, MAF2, 1);
+}
+
+// count each transfer weight times, for a tree that stands for weight
+// identical gene trees
+void add_transfers(vector<vector<int> > *transfer_counts, Forest *F1,
+		Forest *F2, Forest *MAF1, Forest *MAF2, int weight) {
 	int start = 1;
 	if (MAF2->contains_rho())
 		start = 0;
@@ -174,7 +184,7 @@ void add_transfers(vector<vector<int> > *transfer_counts, Forest *F1,
 		}
 
 		#pragma omp atomic
-		(*transfer_counts)[F1_source->get_preorder_number()][F1_target->get_preorder_number()]++;
+		(*transfer_counts)[F1_source->get_preorder_number()][F1_target->get_preorder_number()] += weight;
 		// do we want to check that the move is valid here?
 	}
 					// TODO: identify a valid move (if any) for each component
@@ -302,7 +312,7 @@ void print_leaf_list(Node *T, map<int, string> *reverse_label_map) {
 	vector<string> leaf_labels = vector<string>();
 	if (!leaves.empty()) {
 		for(int i = 0; i < leaves.size(); i++) {
-			map<int, string>::iterator j = reverse_label_map->find(atoi(leaves[i]->str().c_str()));
+			map<int, string>::iterator j = reverse_label_map->find(leaves[i]->get_name_num());
 			if (j != reverse_label_map->end()) {
 				stringstream ss;
 				ss << j->second;
@@ -337,7 +347,7 @@ void print_leaf_list(Node *T) {
 bool map_transfer(Node *F2_source, Forest *F1, Forest *MAF2,
 		Node **F1_source_out, Node **F1_target_out) {
 	bool ret_val = false;
-	if (F2_source->str() == "p")
+	if (F2_source->is_rho())
 		return ret_val;
 	Node *F2_target = find_best_target(F2_source, MAF2);
 	#ifdef DEBUG_LGT			
@@ -397,6 +407,7 @@ Node *find_best_target(Node *source, Node *target, Node **best_target) {
 			c != target->get_children().end(); c++) {
 		find_best_target(source, *c, best_target);
 	}
+	return *best_target;
 }
 
 void add_lcas_to_groups(vector<int> *pre_to_group, Node *subtree) {
@@ -424,9 +435,7 @@ void show_moves(Node *T1, Node *T2, map<string, int> *label_map,
 	int num_nodes = T1->size();
 	int distance = rSPR_branch_and_bound_simple_clustering(T1, T2);
 	int current_distance = distance;
-	T1->numbers_to_labels(reverse_label_map);
-	cout << T1->str_subtree() << endl;
-	T1->labels_to_numbers(label_map, reverse_label_map);
+	cout << T1->str_subtree(reverse_label_map) << endl;
 	while (current_distance > 0) {
 		list<transfer> transfer_list = list<transfer>();
 		list_transfers(&transfer_list, T1, T2);
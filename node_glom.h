@@ -228,15 +228,13 @@ void glom_gene_tree_bottom_up(Node *n, int a, int b) {
 			chosen_children[i]->delete_tree();
 		}
 		// renumber the last child
-		stringstream ss;
-		ss << a;
 		if (n->get_children().size() == 1) {
 			chosen_children[0]->cut_parent();
 			chosen_children[0]->delete_tree();
-			n->set_name(ss.str());
+			n->set_label(a);
 		}
 		else {
-			chosen_children[0]->set_name(ss.str());
+			chosen_children[0]->set_label(a);
 		}
 	}
 }
@@ -282,7 +280,7 @@ vector<vector<int> > find_component_trees(vector<Node *> *gene_trees, vector<Nod
 
 void append_component_trees(int tree, Node *n, vector<vector<int > > *component_trees) {
 	if (n->is_leaf()) {
-		int label = atoi(n->get_name().c_str());
+		int label = n->get_name_num();
 		(*component_trees)[label].push_back(tree);
 	}
 	else {
@@ -97,6 +97,19 @@ PAIRWISE COMPARISON OPTIONS
                          Larger values are output as -1. Very efficient for
                          small distances (e.g. 1-10).
 
+-write_corpus FILE       Use with -pairwise to write the input trees to the
+                         binary corpus FILE and exit.
+
+-corpus FILE             Use with -pairwise or -total to read the compared
+                         trees from a corpus written with -write_corpus
+                         instead of STDIN. With -total the first tree is
+                         still read from STDIN. The corpus must have been
+                         written with the same rooting options.
+
+-dedup                   Use with -pairwise or -total to compute distances
+                         once for each distinct tree topology. The output is
+                         the same as without -dedup.
+
 *******************************************************************************
 OTHER OPTIONS
 *******************************************************************************
@@ -134,6 +147,7 @@ exact BB drSPR=4
 #include <time.h>
 #include <list>
 #include "rspr.h"
+#include "TreeCorpus.h"
 
 #include "Forest.h"
 #include "ClusterForest.h"
@@ -175,6 +189,9 @@ bool PRINT_ROOTED_TREES = false;
 bool SHOW_MOVES = false;
 bool SEQUENCE = false;
 int MULTI_TEST = 0;
+string CORPUS = "";
+string WRITE_CORPUS = "";
+bool DEDUP = false;
 
 string USAGE =
 "rspr, version 1.2.2\n"
@@ -266,6 +283,19 @@ string USAGE =
 "                         Larger values are output as -1. Very efficient for\n"
 "                         small distances (e.g. 1-10).\n"
 "\n"
+"-write_corpus FILE       Use with -pairwise to write the input trees to the\n"
+"                         binary corpus FILE and exit.\n"
+"\n"
+"-corpus FILE             Use with -pairwise or -total to read the compared\n"
+"                         trees from a corpus written with -write_corpus\n"
+"                         instead of STDIN. With -total the first tree is\n"
+"                         still read from STDIN. The corpus must have been\n"
+"                         written with the same rooting options.\n"
+"\n"
+"-dedup                   Use with -pairwise or -total to compute distances\n"
+"                         once for each distinct tree topology. The output is\n"
+"                         the same as without -dedup.\n"
+"\n"
 "\n"
 "*******************************************************************************\n"
 "OTHER OPTIONS\n"
@@ -276,6 +306,88 @@ string USAGE =
 "-q          Quiet; Do not output the input trees or approximation\n"
 "*******************************************************************************\n";
 
+// build the trees of a batch of input lines in parallel
+// trees[i] is NULL if line i has no tree
+// labels are numbered by the caller in input order to keep them deterministic
+void read_tree_batch(vector<pair<const char *, const char *> > &lines,
+		vector<Node *> &trees) {
+	int end = lines.size();
+	trees.assign(end, NULL);
+	#pragma omp parallel for schedule(dynamic, 64)
+	for(int i = 0; i < end; i++) {
+		const char *line_start = lines[i].first;
+		const char *line_end = lines[i].second;
+		const char *loc = (const char *)memchr(line_start, '(',
+				line_end - line_start);
+		if (loc == NULL)
+			continue;
+		if (UNROOTED || SIMPLE_UNROOTED)
+			trees[i] = build_tree(root(string(loc, line_end - loc)));
+		else
+			trees[i] = build_tree(loc, line_end - loc, 0, NULL);
+	}
+}
+
+// the options of this run that determine the trees of a corpus
+uint32_t corpus_flags() {
+	uint32_t flags = 0;
+	if (UNROOTED || SIMPLE_UNROOTED)
+		flags |= CORPUS_REROOTED;
+	return flags;
+}
+
+// load the trees of -corpus, rooted and numbered as if read from STDIN
+bool read_corpus_trees(vector<Node *> *trees, vector<string> *names,
+		map<string, int> *label_map, map<int, string> *reverse_label_map) {
+	uint32_t flags;
+	if (!read_tree_corpus(CORPUS, trees, names, label_map,
+			reverse_label_map, &flags, NULL)) {
+		cerr << "could not read corpus " << CORPUS << endl;
+		return false;
+	}
+	// trees that rspr -write_corpus would not have kept or rooted the
+	// same way give different distances
+	if (flags != corpus_flags()) {
+		cerr << "corpus " << CORPUS << " was written with different tree"
+				<< " filtering or rooting options" << endl;
+		for(int i = 0; i < trees->size(); i++)
+			(*trees)[i]->delete_tree();
+		trees->clear();
+		return false;
+	}
+	if (UNROOTED) {
+		for(int i = 0; i < trees->size(); i++)
+			(*trees)[i]->preorder_number();
+	}
+	return true;
+}
+
+// one row of the -pairwise matrix: distances from T1 to trees[start, end)
+vector<int> pairwise_row(Node *T1, vector<Node *> &trees, int start,
+		int end) {
+	if (RF) {
+		if (UNROOTED)
+			return rf_pairwise_distance_unrooted_row(T1, trees, start, end);
+		else
+			return rf_pairwise_distance_row(T1, trees, start, end);
+	}
+	else if (UNROOTED) {
+		if (PAIRWISE_MAX)
+			return rSPR_pairwise_distance_unrooted_row(T1, trees,
+					PAIRWISE_MAX_SPR, start, end);
+		else
+			return rSPR_pairwise_distance_unrooted_row(T1, trees, start, end,
+					APPROX);
+	}
+	else {
+		if (PAIRWISE_MAX)
+			return rSPR_pairwise_distance_row(T1, trees, PAIRWISE_MAX_SPR,
+					start, end);
+		else
+			return rSPR_pairwise_distance_row(T1, trees, start, end, APPROX);
+	}
+}
+
 int main(int argc, char *argv[]) {
 	int max_args = argc-1;
 	while (argc > 1) {
@@ -488,6 +600,25 @@ int main(int argc, char *argv[]) {
 				}
 			}
 		}
+		else if (strcmp(arg, "-corpus") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-') {
+					CORPUS = string(arg2);
+				}
+			}
+		}
+		else if (strcmp(arg, "-dedup") == 0) {
+			DEDUP = true;
+		}
+		else if (strcmp(arg, "-write_corpus") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-') {
+					WRITE_CORPUS = string(arg2);
+				}
+			}
+		}
 		else if (strcmp(arg, "-cluster_tune") == 0) {
 			if (max_args > argc) {
 				char *arg2 = argv[argc+1];
@@ -978,7 +1109,8 @@ int main(int argc, char *argv[]) {
 		string line = "";
 		vector<Node *> trees = vector<Node *>();
 		vector<string> names = vector<string>();
-		if (!getline(cin, line))
+		InputBuffer input(fileno(stdin), cin);
+		if (!input.next_line(line))
 			return 0;
 		if (UNROOTED || SIMPLE_UNROOTED)
 			line = root(line);
@@ -987,18 +1119,20 @@ int main(int argc, char *argv[]) {
 			cout << "T1: ";
 			T1->print_subtree();
 		}
+		if (CORPUS != "") {
+			if (!read_corpus_trees(&trees, &names, &label_map,
+					&reverse_label_map))
+				return -1;
+		}
 		T1->labels_to_numbers(&label_map, &reverse_label_map);
-		while (getline(cin, line)) {
-			size_t loc = line.find_first_of("(");
-			if (loc != string::npos) {
-				string name = "";
-				if (loc != 0) {
-					name = line.substr(0,loc);
-					line.erase(0,loc);
-				}
-				if (UNROOTED || SIMPLE_UNROOTED)
-					line = root(line);
-				Node *T2 = build_tree(line);
+		vector<pair<const char *, const char *> > lines;
+		while (CORPUS == "" && input.next_lines(lines, INPUT_BATCH_LINES)) {
+			vector<Node *> batch_trees;
+			read_tree_batch(lines, batch_trees);
+			for(int i = 0; i < lines.size(); i++) {
+				Node *T2 = batch_trees[i];
+				if (T2 == NULL)
+					continue;
 				if (!QUIET) {
 					cout << "T2: ";
 					T2->print_subtree();
@@ -1006,7 +1140,9 @@ int main(int argc, char *argv[]) {
 				T2->labels_to_numbers(&label_map, &reverse_label_map);
 				if (UNROOTED)
 					T2->preorder_number();
-				names.push_back(name);
+				const char *loc = (const char *)memchr(lines[i].first, '(',
+						lines[i].second - lines[i].first);
+				names.push_back(string(lines[i].first, loc - lines[i].first));
 				trees.push_back(T2);
 			}
 		}
@@ -1032,12 +1168,17 @@ int main(int argc, char *argv[]) {
 					trees[i]->fix_depths();
 					trees[i]->preorder_number();
 				if (PRINT_ROOTED_TREES) {
-					trees[i]->numbers_to_labels(&reverse_label_map);
-					cout << "T" <<  i+2 << ": " << trees[i]->str_subtree() << endl;
-					trees[i]->labels_to_numbers(&label_map, &reverse_label_map);
+					cout << "T" <<  i+2 << ": " << trees[i]->str_subtree(&reverse_label_map) << endl;
 				}
 			}
 		}
+		if (DEDUP) {
+			// exact unrooted distances minimize over every rooting, the
+			// approximations depend on the child order
+			bool unrooted = UNROOTED && !RF && !APPROX && !UNROOTED_MIN_APPROX;
+			bool ordered = APPROX || UNROOTED_MIN_APPROX;
+			dedup_trees(&trees, &names, NULL, unrooted, ordered);
+		}
 		vector<Node *> rootings;
 		if (ALL_UNROOTED) {
 			rootings = T1->find_descendants();
@@ -1057,9 +1198,7 @@ int main(int argc, char *argv[]) {
 			int distance;
 
 			if (VERBOSE) {
-				T1->numbers_to_labels(&reverse_label_map);
-				cout << "T1: " <<  T1->str_subtree() << endl;
-				T1->labels_to_numbers(&label_map, &reverse_label_map);
+				cout << "T1: " <<  T1->str_subtree(&reverse_label_map) << endl;
 			}
 
 			if (RF) {
@@ -1108,46 +1247,91 @@ int main(int argc, char *argv[]) {
 //			T1->print_subtree();
 //		}
 //		T1->labels_to_numbers(&label_map, &reverse_label_map);
-		while (getline(cin, line)) {
-			size_t loc = line.find_first_of("(");
-			if (loc != string::npos) {
-				string name = "";
-				if (loc != 0) {
-					name = line.substr(0,loc);
-					line.erase(0,loc);
+		if (CORPUS != "") {
+			if (!read_corpus_trees(&trees, &names, &label_map,
+					&reverse_label_map))
+				return -1;
+		}
+		else {
+			InputBuffer input(fileno(stdin), cin);
+			vector<pair<const char *, const char *> > lines;
+			while (input.next_lines(lines, INPUT_BATCH_LINES)) {
+				vector<Node *> batch_trees;
+				read_tree_batch(lines, batch_trees);
+				for(int i = 0; i < lines.size(); i++) {
+					Node *T2 = batch_trees[i];
+					if (T2 == NULL)
+						continue;
+//					if (!QUIET) {
+//						cout << "T2: ";
+//						T2->print_subtree();
+//					}
+					T2->labels_to_numbers(&label_map, &reverse_label_map);
+					if (UNROOTED)
+						T2->preorder_number();
+					const char *loc = (const char *)memchr(lines[i].first, '(',
+							lines[i].second - lines[i].first);
+					names.push_back(string(lines[i].first, loc - lines[i].first));
+					trees.push_back(T2);
 				}
-				if (UNROOTED || SIMPLE_UNROOTED)
-					line = root(line);
-				Node *T2 = build_tree(line);
-//				if (!QUIET) {
-//					cout << "T2: ";
-//					T2->print_subtree();
-//				}
-				T2->labels_to_numbers(&label_map, &reverse_label_map);
-				if (UNROOTED)
-					T2->preorder_number();
-				names.push_back(name);
-				trees.push_back(T2);
 			}
 		}
 //		if (!QUIET) {
 //			cout << endl;
 //		}
+		if (WRITE_CORPUS != "") {
+			if (!write_tree_corpus(WRITE_CORPUS, trees, names,
+					&reverse_label_map, corpus_flags(), 0)) {
+				cerr << "could not write corpus " << WRITE_CORPUS << endl;
+				return -1;
+			}
+			for(vector<Node *>::iterator T2 = trees.begin(); T2 != trees.end(); T2++)
+				(*T2)->delete_tree();
+			return 0;
+		}
+		// with -dedup each input tree is replaced by the index of the
+		// tree kept for its topology
+		int num_trees = trees.size();
+		vector<int> representative = vector<int>();
+		if (DEDUP)
+			dedup_trees(&trees, &names, &representative, false, APPROX);
+		else {
+			for(int i = 0; i < num_trees; i++)
+				representative.push_back(i);
+		}
 		int start_i = PAIRWISE_START;
 		if (start_i < 0) {
 			start_i = 0;
 		}
 		int end_i = PAIRWISE_END;
-		if (end_i > trees.size()) {
-			end_i = trees.size();
+		if (end_i > num_trees) {
+			end_i = num_trees;
 		}
 		int start_j = PAIRWISE_COL_START;
 		if (start_j < 0) {
 			start_j = 0;
 		}
 		int end_j = PAIRWISE_COL_END;
-		if (end_j > trees.size()) {
-			end_j = trees.size();
+		if (end_j > num_trees) {
+			end_j = num_trees;
+		}
+
+		// rows are kept until the last row with the same topology
+		vector<int> last_row = vector<int>(trees.size(), -1);
+		for(int i = start_i; i < end_i; i++)
+			last_row[representative[i]] = i;
+		map<int, vector<int> > rows = map<int, vector<int> >();
+
+		// rooted -rf rows compare cluster tables built once per tree
+		vector<ClusterTable> rf_tables = vector<ClusterTable>();
+		vector<ClusterTable *> rf_columns = vector<ClusterTable *>();
+		if (RF && !UNROOTED) {
+			rf_tables = vector<ClusterTable>(trees.size());
+			#pragma omp parallel for
+			for(int i = 0; i < trees.size(); i++)
+				rf_tables[i] = ClusterTable(trees[i]);
+			for(int i = 0; i < trees.size(); i++)
+				rf_columns.push_back(&rf_tables[i]);
 		}
 
 		for(int i = start_i; i < end_i; i++) {
@@ -1157,32 +1341,50 @@ int main(int argc, char *argv[]) {
 					cout << ",";
 				}
 			}
-			if (RF) {
-				if (UNROOTED) {
-					rf_pairwise_distance_unrooted(trees[i], trees, j, end_j);
-				}
-				else {
-					rf_pairwise_distance(trees[i], trees, j, end_j);
-				}
+			if (!DEDUP) {
+				if (!rf_tables.empty())
+					print_pairwise_row(rf_pairwise_distance_row(&rf_tables[i],
+							rf_columns, j, end_j));
+				else
+					print_pairwise_row(pairwise_row(trees[i], trees, j, end_j));
+				continue;
 			}
-			else {
-				if (UNROOTED) {
-					if (PAIRWISE_MAX) {
-						rSPR_pairwise_distance_unrooted(trees[i], trees, PAIRWISE_MAX_SPR, j, end_j);
-					}
-					else {
-						rSPR_pairwise_distance_unrooted(trees[i], trees, j, end_j, APPROX);
-					}
-				}
-				else {
-					if (PAIRWISE_MAX) {
-						rSPR_pairwise_distance(trees[i], trees, PAIRWISE_MAX_SPR, j, end_j);
-					}
-					else {
-						rSPR_pairwise_distance(trees[i], trees, j, end_j, APPROX);
-					}
+			int r = representative[i];
+			map<int, vector<int> >::iterator row = rows.find(r);
+			if (row == rows.end())
+				row = rows.insert(make_pair(r,
+						vector<int>(trees.size(), INT_MIN))).first;
+			// compute the distances to topologies not seen in this row
+			vector<Node *> columns = vector<Node *>();
+			vector<int> column_trees = vector<int>();
+			vector<bool> queued = vector<bool>(trees.size(), false);
+			for(int c = j; c < end_j; c++) {
+				int t = representative[c];
+				if (row->second[t] == INT_MIN && !queued[t]) {
+					queued[t] = true;
+					columns.push_back(trees[t]);
+					column_trees.push_back(t);
 				}
 			}
+			vector<int> distances;
+			if (!rf_tables.empty()) {
+				vector<ClusterTable *> column_tables =
+						vector<ClusterTable *>();
+				for(int c = 0; c < column_trees.size(); c++)
+					column_tables.push_back(&rf_tables[column_trees[c]]);
+				distances = rf_pairwise_distance_row(&rf_tables[r],
+						column_tables, 0, column_tables.size());
+			}
+			else
+				distances = pairwise_row(trees[r], columns, 0, columns.size());
+			for(int c = 0; c < distances.size(); c++)
+				row->second[column_trees[c]] = distances[c];
+			distances.clear();
+			for(int c = j; c < end_j; c++)
+				distances.push_back(row->second[representative[c]]);
+			print_pairwise_row(distances);
+			if (last_row[r] == i)
+				rows.erase(row);
 		}
 		// cleanup
 		for(vector<Node *>::iterator T2 = trees.begin(); T2 != trees.end(); T2++)
@@ -1294,13 +1496,9 @@ int main(int argc, char *argv[]) {
 						best_distance = k;
 						T1_best_root = T1_rootings[i];
 						T2_best_root = T2_rootings[j];
-						T1->numbers_to_labels(&reverse_label_map);
-						T2->numbers_to_labels(&reverse_label_map);
 //						cout << i << "," << j << endl;
-//						cout << T1->str_subtree() << endl;
-//						cout << T2->str_subtree() << endl;
-						T1->labels_to_numbers(&label_map, &reverse_label_map);
-						T2->labels_to_numbers(&label_map, &reverse_label_map);
+//						cout << T1->str_subtree(&reverse_label_map) << endl;
+//						cout << T2->str_subtree(&reverse_label_map) << endl;
 //						cout << "d=" << k << endl;
 //						cout << "new best" << endl;
 //						cout << endl;
@@ -1338,10 +1536,8 @@ int main(int argc, char *argv[]) {
 			// print tree
 			if (!QUIET) {
 				cout << endl;
-				T2->numbers_to_labels(&reverse_label_map);
 				cout << T2_name << ": ";
-				T2->print_subtree();
-				T2->labels_to_numbers(&label_map, &reverse_label_map);
+				T2->print_subtree(&reverse_label_map);
 				cout << endl;
 			}
 
@@ -50,14 +50,20 @@ along with rspr.  If not, see <http://www.gnu.org/licenses/>.
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_set>
 #include <list>
 #include <algorithm>
 #include "Forest.h"
 #include "ClusterForest.h"
 #include "LCA.h"
+#include "FlatTree.h"
+#include "ClusterTable.h"
+#include "DistanceCache.h"
+#include "TaxonSet.h"
 #include "ClusterInstance.h"
 #include "SiblingPair.h"
 #include "UndoMachine.h"
+#include "InputBuffer.h"
 
 using namespace std;
 
@@ -74,6 +80,7 @@ int rSPR_worse_3_approx(Forest *T1, Forest *T2);
 int rSPR_worse_3_approx(Forest *T1, Forest *T2, bool sync);
 int rSPR_worse_3_approx(Node *subtree, Forest *T1, Forest *T2);
 int rSPR_worse_3_approx(Node *subtree, Forest *T1, Forest *T2, bool sync);
+int rSPR_worse_3_approx_distance_only(FlatForest *T1, FlatForest *T2);
 int rSPR_worse_3_approx_binary_hlpr(Forest *T1, Forest *T2, list<Node *> *singletons, list<Node *> *sibling_pairs, Forest **F1, Forest **F2, bool save_forests);
 int rSPR_worse_3_approx_binary(Forest *T1, Forest *T2, bool sync);
 int rSPR_worse_3_approx_binary(Forest *T1, Forest *T2);
@@ -83,16 +90,18 @@ int rSPR_branch_and_bound_range(Forest *T1, Forest *T2, int end_k);
 int rSPR_branch_and_bound_range(Forest *T1, Forest *T2, int start_k,
 		int end_k);
 int rSPR_branch_and_bound_hlpr(Forest *T1, Forest *T2, int k,
-		set<SiblingPair> *sibling_pairs, list<Node *> *singletons, bool cut_b_only,
+		SiblingPairWorklist *sibling_pairs, list<Node *> *singletons, bool cut_b_only,
 		list<pair<Forest,Forest> > *AFs, list<Node *> *protected_stack,
 		int *num_ties);
 int rSPR_branch_and_bound_hlpr(Forest *T1, Forest *T2, int k,
-		set<SiblingPair> *sibling_pairs, list<Node *> *singletons, bool cut_b_only,
+		SiblingPairWorklist *sibling_pairs, list<Node *> *singletons, bool cut_b_only,
 		list<pair<Forest,Forest> > *AFs, list<Node *> *protected_stack,
 		int *num_ties, Node *prev_T1_a, Node *prev_T1_c);
 int rSPR_total_approx_distance(Node *T1, vector<Node *> &gene_trees);
 int rSPR_total_approx_distance(Node *T1, vector<Node *> &gene_trees,
 		int threshold);
+int rSPR_total_lower_bound(Node *T1, vector<Node *> &gene_trees);
+int rSPR_total_lower_bound_unrooted(Node *T1, vector<Node *> &gene_trees);
 int rSPR_total_distance(Node *T1, vector<Node *> &gene_trees);
 int rSPR_total_distance(Node *T1, vector<Node *> &gene_trees,
 		vector<int> *original_scores);
@@ -112,8 +121,21 @@ void rf_pairwise_distance(Node *T1, vector<Node *> &gene_trees);
 void rf_pairwise_distance(Node *T1, vector<Node *> &gene_trees, int start, int end);
 void rf_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees);
 void rf_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int start, int end);
+vector<int> rSPR_pairwise_distance_row(Node *T1, vector<Node *> &gene_trees, int start, int end, bool approx);
+vector<int> rSPR_pairwise_distance_row(Node *T1, vector<Node *> &gene_trees, int max_spr, int start, int end);
+vector<int> rSPR_pairwise_distance_unrooted_row(Node *T1, vector<Node *> &gene_trees, int start, int end, bool approx);
+vector<int> rSPR_pairwise_distance_unrooted_row(Node *T1, vector<Node *> &gene_trees, int max_spr, int start, int end);
+vector<int> rf_pairwise_distance_row(Node *T1, vector<Node *> &gene_trees, int start, int end);
+vector<int> rf_pairwise_distance_unrooted_row(Node *T1, vector<Node *> &gene_trees, int start, int end);
+vector<int> rf_pairwise_distance_row(ClusterTable *T1,
+		vector<ClusterTable *> &trees, int start, int end);
+int rf_distance_unrooted(ClusterTable *T1, Node *T2);
+void print_pairwise_row(const vector<int> &distances);
 int rSPR_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int threshold);
 int rSPR_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int threshold, vector<int> *original_scores);
+int tree_weight(Node *T);
+int dedup_trees(vector<Node *> *trees, vector<string> *names,
+		vector<int> *representative, bool unrooted, bool ordered);
 int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, Forest **out_F1, Forest **out_F2);
 int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, map<string, int> *label_map, map<int, string> *reverse_label_map);
 int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, map<string, int> *label_map, map<int, string> *reverse_label_map, int min_k, int max_k);
@@ -121,9 +143,11 @@ int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2);
 int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose);
 int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, int min_k, int max_k);
 int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, map<string, int> *label_map, map<int, string> *reverse_label_map, int min_k, int max_k, Forest **out_F1, Forest **out_F2);
+int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, map<string, int> *label_map, map<int, string> *reverse_label_map, int min_k, int max_k, Forest **out_F1, Forest **out_F2, LCA *T2_tree_LCA);
 void reduction_leaf(Forest *T1, Forest *T2);
 void reduction_leaf(Forest *T1, Forest *T2, UndoMachine *um);
 bool chain_match(Node *T1_node, Node *T2_node, Node *T2_node_end);
+bool chain_match(FlatForest *T1, FlatForest *T2, int T1_node, int T2_node, int T2_node_end);
 Node *find_subtree_of_approx_distance(Node *n, Forest *F1, Forest *F2, int target_size);
 Node *find_best_root(Node *T1, Node *T2);
 double find_best_root_acc(Node *T1, Node *T2);
@@ -141,6 +165,29 @@ void modify_bipartition_support(Node *T1, Node *T2, enum RELAXATION relaxed);
 void modify_bipartition_support(Node *n, Forest *F1, Forest *F2,
 		Node *T1, Node *T2, vector<int> *F1_descendant_counts, enum RELAXATION);
 void modify_bipartition_support(Forest *F1, Forest *F2, Node *n1);
+
+// the cluster of a node as a sum of leaf keys and its number of leaves
+class BipartitionFingerprint {
+	public:
+	Node *node;
+	unsigned long long key;
+	int num_leaves;
+
+	BipartitionFingerprint(Node *n) {
+		node = n;
+		key = 0;
+		num_leaves = 0;
+	}
+};
+
+void count_bipartition_support(Node *T1, Node *T2, vector<Node *> &T1_nodes,
+		vector<int> &support, vector<int> &normalization,
+		enum RELAXATION relaxed);
+unsigned long long leaf_fingerprint(int preorder_number);
+unsigned long long find_cluster_fingerprints(Node *n,
+		unordered_set<unsigned long long> &clusters, bool &multifurcating);
+BipartitionFingerprint find_bipartition_fingerprints(Node *n,
+		vector<BipartitionFingerprint> &bipartitions);
 bool is_nonbranching(Forest *T1, Forest *T2, Node *T1_a, Node *T1_c, Node *T2_a, Node *T2_c);
 bool outgroup_root(Node *T, set<string, StringCompare> outgroup);
 bool outgroup_root(Node *n, vector<int> &num_in, vector<int> &num_out);
@@ -205,6 +252,14 @@ bool check_all_pairs = true;
 bool PREFER_NONBRANCHING = false;
 int CLUSTER_TUNE = -1;
 int SIMPLE_UNROOTED_LEAF = 0;
+// distances of the gene trees to the restrictions of the supertree
+// evaluated so far, see rSPR_projected_distance
+DistanceCache DISTANCE_CACHE = DistanceCache();
+// LCAs of the gene trees, shared by the copies of each gene tree that
+// rSPR_projected_distance compares
+LCACache GENE_TREE_LCAS = LCACache();
+// taxa of the gene trees, to skip those that share too few with T1
+TaxonSetCache GENE_TREE_TAXA = TaxonSetCache();
 
 class ProblemSolution {
 public:
@@ -562,9 +617,9 @@ while(!singletons->empty()) {
 		continue;
 	bool potential_new_sibling_pair = T1_a_parent->is_sibling_pair();
 	// cut the edge above T1_a
-	um.add_event(new CutParent(T1_a));
+	um.add_event(CutParent(T1_a));
 	T1_a->cut_parent();
-	um.add_event(new AddComponent(T1));
+	um.add_event(AddComponent(T1));
 	T1->add_component(T1_a);
 	//if (T1_a->get_sibling_pair_status() > 0)
 	//	T1_a->clear_sibling_pair(sibling_pairs);
@@ -574,7 +629,7 @@ while(!singletons->empty()) {
 	Node *node = T1_a_parent->contract();
 	if (node != NULL && potential_new_sibling_pair &&
 			node->is_sibling_pair()){
-		um.add_event(new AddToFrontSiblingPairs(sibling_pairs));
+		um.add_event(AddToFrontSiblingPairs(sibling_pairs));
 		sibling_pairs->push_front(node->rchild());
 		sibling_pairs->push_front(node->lchild());
 	}
@@ -608,7 +663,7 @@ if(!sibling_pairs->empty()) {
 //						cout << "invalid" << endl;
 //						sibling_pairs->erase(T1_c_i);
 //						sibling_pairs->erase(T1_a_i);
-//						um.add_event(new PopSiblingPair(T1_a, T1_c, sibling_pairs));
+//						um.add_event(PopSiblingPair(T1_a, T1_c, sibling_pairs));
 //						continue;
 //					}
 //					else {
@@ -642,7 +697,7 @@ if(!sibling_pairs->empty()) {
 	sibling_pairs->pop_back();
 	Node *T1_c = sibling_pairs->back();
 	sibling_pairs->pop_back();
-	um.add_event(new PopSiblingPair(T1_a, T1_c, sibling_pairs));
+	um.add_event(PopSiblingPair(T1_a, T1_c, sibling_pairs));
 
 	//if (T1_a->get_sibling_pair_status() == 0 ||
 	//		T1_c->get_sibling_pair_status() == 0) {
@@ -684,18 +739,18 @@ if(!sibling_pairs->empty()) {
 			T2->print_components();
 		#endif
 		Node *T2_ac = T2_a->parent();
-		um.add_event(new ContractSiblingPair(T1_ac));
+		um.add_event(ContractSiblingPair(T1_ac));
 		T1_ac->contract_sibling_pair_undoable();
-		um.add_event(new ContractSiblingPair(T2_ac, T2_a, T2_c, &um));
+		um.add_event(ContractSiblingPair(T2_ac, T2_a, T2_c, &um));
 		Node *T2_ac_new = T2_ac->contract_sibling_pair_undoable(T2_a, T2_c);
 		if (T2_ac_new != NULL && T2_ac_new != T2_ac) {
 			T2_ac = T2_ac_new;
-			um.add_event(new CreateNode(T2_ac));
-			um.add_event(new ContractSiblingPair(T2_ac));
+			um.add_event(CreateNode(T2_ac));
+			um.add_event(ContractSiblingPair(T2_ac));
 			T2_ac->contract_sibling_pair_undoable();
 		}
-		um.add_event(new SetTwin(T1_ac));
-		um.add_event(new SetTwin(T2_ac));
+		um.add_event(SetTwin(T1_ac));
+		um.add_event(SetTwin(T2_ac));
 		T1_ac->set_twin(T2_ac);
 		T2_ac->set_twin(T1_ac);
 		//T2_ac->fix_contracted_order();
@@ -710,7 +765,7 @@ if(!sibling_pairs->empty()) {
 			singletons->push_back(T2_ac);
 		// check if T1_ac is part of a sibling pair
 		if (T1_ac->parent() != NULL && T1_ac->parent()->is_sibling_pair()) {
-			um.add_event(new AddToSiblingPairs(sibling_pairs));
+			um.add_event(AddToSiblingPairs(sibling_pairs));
 			sibling_pairs->push_back(T1_ac->parent()->lchild());
 			sibling_pairs->push_back(T1_ac->parent()->rchild());
 		}
@@ -769,7 +824,7 @@ if(!sibling_pairs->empty()) {
 		if (APPROX_CUT_ONE_B && T2_a->parent() != NULL && T2_a->parent()->parent() != NULL && T2_a->parent()->parent() == T2_c->parent() && !multi_node
 						&& (!APPROX_EDGE_PROTECTION || !T2_b->is_protected())) {
 			cut_b_only = true;
-			um.add_event(new AddToSiblingPairs(sibling_pairs));
+			um.add_event(AddToSiblingPairs(sibling_pairs));
 			sibling_pairs->push_back(T1_c);
 			sibling_pairs->push_back(T1_a);
 		}
@@ -872,7 +927,7 @@ if(!sibling_pairs->empty()) {
 								|| !T2_b->is_protected()
 								|| T2_a->parent()->get_children().size() > 2)))) {
 //					|| cut_a_only)) {
-				um.add_event(new CutParent(T1_a));
+				um.add_event(CutParent(T1_a));
 				T1_a->cut_parent();
 				cut_a = true;
 
@@ -889,7 +944,7 @@ if(!sibling_pairs->empty()) {
 								|| !T2_c->get_sibling()->is_protected()
 								|| T2_c->parent()->get_children().size() > 2)))) {// &&
 //					|| cut_c_only)) {
-				um.add_event(new CutParent(T1_c));
+				um.add_event(CutParent(T1_c));
 				T1_c->cut_parent();
 				cut_c = true;
 
@@ -902,7 +957,7 @@ if(!sibling_pairs->empty()) {
 			// contract parents
 			// check for T1_ac sibling pair
 			if (node && node->is_sibling_pair()){
-				um.add_event(new AddToSiblingPairs(sibling_pairs));
+				um.add_event(AddToSiblingPairs(sibling_pairs));
 				sibling_pairs->push_back(node->lchild());
 				sibling_pairs->push_back(node->rchild());
 			}
@@ -915,7 +970,7 @@ if(!sibling_pairs->empty()) {
 		Node *T2_ab_parent = T2_ab->parent();
 		node = T2_ab;
 		if (cut_a) {
-			um.add_event(new CutParent(T2_a));
+			um.add_event(CutParent(T2_a));
 			T2_a->cut_parent();
 
 			//ContractEvent(&um, T2_ab);
@@ -931,19 +986,19 @@ if(!sibling_pairs->empty()) {
 //					|| cut_b_only)) {
 			if (multi_node) {
 				T2_b = T2_ab;
-				um.add_event(new CutParent(T2_ab));
+				um.add_event(CutParent(T2_ab));
 				T2_ab->cut_parent();
 				if (T2_a->parent() != NULL) {
-					um.add_event(new CutParent(T2_a));
+					um.add_event(CutParent(T2_a));
 					T2_a->cut_parent();
-					um.add_event(new AddChild(T2_a));
+					um.add_event(AddChild(T2_a));
 					T2_ab_parent->add_child(T2_a);
 				}
 				else
 					node = T2_ab_parent;
 			}
 			else {
-				um.add_event(new CutParent(T2_b));
+				um.add_event(CutParent(T2_b));
 				T2_b->cut_parent();
 				//ContractEvent(&um, node);
 				//node = node->contract();
@@ -970,7 +1025,7 @@ if(!sibling_pairs->empty()) {
 		// ignore T2_c if it is a singleton
 		if (cut_c && T2_c != node && T2_c->parent() != NULL) {
 			Node *T2_c_parent = T2_c->parent();
-			um.add_event(new CutParent(T2_c));
+			um.add_event(CutParent(T2_c));
 			T2_c->cut_parent();
 			ContractEvent(&um, T2_c_parent);
 			node = T2_c_parent->contract();
@@ -984,22 +1039,22 @@ if(!sibling_pairs->empty()) {
 
 		
 		if (cut_a) {
-			um.add_event(new AddComponent(T1));
+			um.add_event(AddComponent(T1));
 			T1->add_component(T1_a);
-			um.add_event(new AddComponent(T2));
+			um.add_event(AddComponent(T2));
 			T2->add_component(T2_a);
 		}
 		if (cut_c) {
-			um.add_event(new AddComponent(T1));
+			um.add_event(AddComponent(T1));
 			T1->add_component(T1_c);
 		}
 		if (cut_b) {
-			um.add_event(new AddComponent(T2));
+			um.add_event(AddComponent(T2));
 			T2->add_component(T2_b);
 		}
 		// problem if c is deleted
 		if (add_T2_c) {
-			um.add_event(new AddComponent(T2));
+			um.add_event(AddComponent(T2));
 			T2->add_component(T2_c);
 		}
 
@@ -1019,8 +1074,8 @@ if(!sibling_pairs->empty()) {
 // if the first component of the forests differ then we have cut p
 if (T1->get_component(0)->get_twin() != T2->get_component(0)) {
 	if (!T1->contains_rho()) {
-		um.add_event(new AddRho(T1));
-		um.add_event(new AddRho(T2));
+		um.add_event(AddRho(T1));
+		um.add_event(AddRho(T2));
 		T1->add_rho();
 		T2->add_rho();
 	}
@@ -1065,6 +1120,309 @@ if (save_forests) {
 return num_cut;
 }
 
+/* rSPR_worse_3_approx_distance_only on FlatForests
+ * the same cases and cut choices as rSPR_worse_3_approx_hlpr but
+ * without an undo log
+ * NOTE: destructive. T1 and T2 are left as the computed forests.
+ */
+int rSPR_worse_3_approx_distance_only(FlatForest *T1, FlatForest *T2) {
+	if (!sync_twins(T1, T2))
+		return 0;
+	deque<int> sibling_pairs = deque<int>();
+	T1->find_sibling_pairs(sibling_pairs);
+	vector<int> singletons = vector<int>();
+	T2->find_singletons(singletons);
+	int num_cut = 0;
+	while(!singletons.empty() || !sibling_pairs.empty()) {
+		// Case 1 - Remove singletons
+		while(!singletons.empty()) {
+			int T2_a = singletons.back();
+			singletons.pop_back();
+			int T1_a = T2->twins[T2_a];
+			if (T2_a == T2->get_component(0) || T1_a == -1)
+				continue;
+			int T1_a_parent = T1->parents[T1_a];
+			if (T1_a_parent == -1)
+				continue;
+			bool potential_new_sibling_pair = T1->is_sibling_pair(T1_a_parent);
+			T1->cut_parent(T1_a);
+			T1->add_component(T1_a);
+			int node = T1->contract(T1_a_parent);
+			if (node != -1 && potential_new_sibling_pair &&
+					T1->is_sibling_pair(node)) {
+				sibling_pairs.push_front(T1->rchild(node));
+				sibling_pairs.push_front(T1->lchild(node));
+			}
+		}
+		if (sibling_pairs.empty())
+			continue;
+		int T1_a = sibling_pairs.back();
+		sibling_pairs.pop_back();
+		int T1_c = sibling_pairs.back();
+		sibling_pairs.pop_back();
+		if (T1->parents[T1_a] == -1 || T1->parents[T1_c] == -1
+				|| T1->parents[T1_a] != T1->parents[T1_c])
+			continue;
+		if (!T1->can_be_sibling(T1_a) || !T1->can_be_sibling(T1_c)
+				|| num_cut >= INT_MAX - 3)
+			continue;
+		int T1_ac = T1->parents[T1_a];
+		// lookup in T2 and determine the case
+		int T2_a = T1->twins[T1_a];
+		int T2_c = T1->twins[T1_c];
+
+		// Case 2 - Contract identical sibling pair
+		if (T2->parents[T2_a] != -1
+				&& T2->parents[T2_a] == T2->parents[T2_c]) {
+			int T2_ac = T2->parents[T2_a];
+			T1->contract_sibling_pair(T1_ac);
+			int T2_ac_new = T2->contract_sibling_pair(T2_ac, T2_a, T2_c);
+			if (T2_ac_new != -1 && T2_ac_new != T2_ac) {
+				T2_ac = T2_ac_new;
+				T2->contract_sibling_pair(T2_ac);
+			}
+			T1->twins[T1_ac] = T2_ac;
+			T2->twins[T2_ac] = T1_ac;
+			// check if T2_ac is a singleton
+			if (T2->is_singleton(T2_ac) && T1_ac != T1->get_component(0)
+					&& T2_ac != T2->get_component(0))
+				singletons.push_back(T2_ac);
+			// check if T1_ac is part of a sibling pair
+			int T1_ac_parent = T1->parents[T1_ac];
+			if (T1_ac_parent != -1 && T1->is_sibling_pair(T1_ac_parent)) {
+				sibling_pairs.push_back(T1->lchild(T1_ac_parent));
+				sibling_pairs.push_back(T1->rchild(T1_ac_parent));
+			}
+			continue;
+		}
+
+		// Case 3
+		//  ensure T2_a is below T2_c
+		if ((T2->depths[T2_a] < T2->depths[T2_c]
+				&& T2->parents[T2_c] != -1)
+				|| T2->parents[T2_a] == -1) {
+			swap(T1_a, T1_c);
+			swap(T2_a, T2_c);
+		}
+		else if (T2->depths[T2_a] == T2->depths[T2_c]) {
+			if (T2->parents[T2_a] != -1 && T2->parents[T2_c] != -1 &&
+					T2->depths[T2->parents[T2_a]] <
+					T2->depths[T2->parents[T2_c]]) {
+				swap(T1_a, T1_c);
+				swap(T2_a, T2_c);
+			}
+		}
+
+		// get T2_b
+		bool multi_node = false;
+		int T2_ab = T2->parents[T2_a];
+		int T2_b = T2_ab;
+		if (T2->num_children[T2_ab] > 2) {
+			multi_node = true;
+		}
+		else {
+			T2_b = T2->rchild(T2_ab);
+			if (T2_b == T2_a)
+				T2_b = T2->lchild(T2_ab);
+		}
+
+		// cut T1_a, T1_c, T2_a, T2_b, T2_c
+		bool cut_a_only = false;
+		bool cut_b_only = false;
+		bool cut_c_only = false;
+		bool cut_b_only_if_not_a_or_c = false;
+		if (APPROX_CUT_ONE_B && T2->parents[T2_ab] != -1
+				&& T2->parents[T2_ab] == T2->parents[T2_c] && !multi_node
+				&& (!APPROX_EDGE_PROTECTION || !T2->is_protected(T2_b))) {
+			cut_b_only = true;
+			sibling_pairs.push_back(T1_c);
+			sibling_pairs.push_back(T1_a);
+		}
+		if (APPROX_CUT_TWO_B && !cut_b_only && T1->parents[T1_ac] != -1
+				&& (!APPROX_EDGE_PROTECTION || !T2->is_protected(T2_b))) {
+			int T1_s = T1->get_sibling(T1_ac);
+			if (T1->is_leaf(T1_s)) {
+				int T2_l = T2->parents[T2_ab];
+				int T2_c_parent = T2->parents[T2_c];
+				if (T2_l != -1) {
+					if (T2_c_parent != -1 && T2->parents[T2_c_parent] == T2_l
+							&& T2->num_children[T2_ab] > 2
+							&& T2->num_children[T2_c_parent] > 2) {
+						if (T2->get_sibling(T2_l) == T1->twins[T1_s]) {
+							cut_b_only=true;
+						}
+						else if (T2->parents[T2_l] == -1 &&
+								(T2->contains_rho() ||
+								 T2->get_component(0) != T2_l)) {
+							cut_b_only_if_not_a_or_c=true;
+						}
+					}
+					else if ((T2_l = T2->parents[T2_l]) != -1
+							&& T2_c_parent == T2_l
+							&& T2->num_children[T2_ab] > 2
+							&& T2->num_children[T2->parents[T2_ab]] > 2) {
+						if (T2->get_sibling(T2_l) == T1->twins[T1_s]) {
+							cut_b_only=true;
+						}
+						else if (T2->parents[T2_l] == -1 &&
+								(T2->contains_rho() ||
+								 T2->get_component(0) != T2_l)) {
+							cut_b_only_if_not_a_or_c=true;
+						}
+					}
+				}
+			}
+		}
+		if (APPROX_REVERSE_CUT_ONE_B && !cut_b_only
+				&& T1->parents[T1_ac] != -1) {
+			int T1_s = T1->get_sibling(T1_ac);
+			if (T1->is_leaf(T1_s)) {
+				int T2_s = T1->twins[T1_s];
+				if (T2_s != -1 && T2->parents[T2_s] == T2_ab
+						&& (!APPROX_EDGE_PROTECTION || !T2->is_protected(T2_c))) {
+					cut_c_only=true;
+				}
+				else if (T2_s != -1 && T2->parents[T2_s] == T2->parents[T2_c]
+						&& T2->parents[T2_c] != -1
+						&& (!APPROX_EDGE_PROTECTION || !T2->is_protected(T2_a))
+						&& T2->num_children[T2->parents[T2_c]] <= 2) {
+					cut_a_only=true;
+				}
+			}
+			else if (APPROX_REVERSE_CUT_ONE_B_2) {
+				if (T2->parents[T2_c] != -1
+					&& chain_match(T1, T2, T1_s, T2->get_sibling(T2_c), T2_a)
+						&& (!APPROX_EDGE_PROTECTION || !T2->is_protected(T2_a)))
+				cut_a_only = true;
+			}
+		}
+		if (APPROX_CUT_TWO_B_ROOT && cut_a_only == false && cut_c_only == false
+				&& cut_b_only_if_not_a_or_c == true) {
+			cut_b_only = true;
+		}
+
+		int node;
+		bool cut_a = false;
+		bool cut_c = false;
+		if (!cut_b_only || T2->num_children[T2_ab] > 2) {
+			if (!cut_c_only &&
+					(!APPROX_EDGE_PROTECTION
+					 	|| (!T2->is_protected(T2_a)
+							&& (T2->parents[T2_ab] != -1
+								|| !T2->is_protected(T2_b)
+								|| T2->num_children[T2_ab] > 2)))) {
+				T1->cut_parent(T1_a);
+				cut_a = true;
+				node = T1->contract(T1_ac);
+			}
+			else
+				node = T1_ac;
+			int T2_c_parent = T2->parents[T2_c];
+			if (!cut_a_only &&
+					(!APPROX_EDGE_PROTECTION
+					 	|| (!T2->is_protected(T2_c)
+						&& (T2_c_parent == -1
+								|| T2->parents[T2_c_parent] != -1
+								|| !T2->is_protected(T2->get_sibling(T2_c))
+								|| T2->num_children[T2_c_parent] > 2)))) {
+				T1->cut_parent(T1_c);
+				cut_c = true;
+				if (node != -1)
+					node = T1->contract(node);
+			}
+			// check for T1_ac sibling pair
+			if (node != -1 && T1->is_sibling_pair(node)) {
+				sibling_pairs.push_back(T1->lchild(node));
+				sibling_pairs.push_back(T1->rchild(node));
+			}
+		}
+
+		bool same_component = true;
+		if (APPROX_CHECK_COMPONENT && !cut_a_only && !cut_c_only)
+			same_component = (T2->find_root(T2_a) == T2->find_root(T2_c));
+
+		int T2_ab_parent = T2->parents[T2_ab];
+		node = T2_ab;
+		if (cut_a)
+			T2->cut_parent(T2_a);
+		bool cut_b = false;
+		if (same_component && T2_ab_parent != -1
+				&& !cut_a_only && !cut_c_only
+				&& (!APPROX_EDGE_PROTECTION || !T2->is_protected(T2_b))) {
+			if (multi_node) {
+				T2_b = T2_ab;
+				T2->cut_parent(T2_ab);
+				if (T2->parents[T2_a] != -1) {
+					T2->cut_parent(T2_a);
+					T2->add_child(T2_ab_parent, T2_a);
+				}
+				else
+					node = T2_ab_parent;
+			}
+			else
+				T2->cut_parent(T2_b);
+			cut_b = true;
+		}
+		// T2_b will move up after contraction
+		else if (!multi_node) {
+			T2_b = T2->parents[T2_b];
+		}
+		if (node != -1) {
+			node = T2->contract(node);
+			// check for T2 parents as singletons
+			if (node != -1 && T2->is_singleton(node)
+					&& node != T2->get_component(0))
+				singletons.push_back(node);
+		}
+
+		// if T2_c is gone then its replacement is in singleton list
+		bool add_T2_c = true;
+		T2_c = T1->twins[T1_c];
+		if (cut_c && T2_c != node && T2->parents[T2_c] != -1) {
+			int T2_c_parent = T2->parents[T2_c];
+			T2->cut_parent(T2_c);
+			node = T2->contract(T2_c_parent);
+			if (node != -1 && T2->is_singleton(node)
+					&& node != T2->get_component(0))
+				singletons.push_back(node);
+		}
+		else {
+			add_T2_c = false;
+		}
+
+		if (cut_a) {
+			T1->add_component(T1_a);
+			T2->add_component(T2_a);
+		}
+		if (cut_c)
+			T1->add_component(T1_c);
+		if (cut_b)
+			T2->add_component(T2_b);
+		if (add_T2_c)
+			T2->add_component(T2_c);
+
+		if (T2->is_leaf(T2_b) && cut_b)
+			singletons.push_back(T2_b);
+
+		num_cut+=3;
+
+		if (cut_a == false && cut_b == false && cut_c == false) {
+			num_cut = INT_MAX-3;
+		}
+	}
+	// if the first component of the forests differ then we have cut p
+	if (T1->twins[T1->get_component(0)] != T2->get_component(0)) {
+		if (!T1->contains_rho()) {
+			T1->add_rho();
+			T2->add_rho();
+		}
+		else
+			// hack to ignore rho when it shouldn't be in a cluster
+			num_cut -=3;
+	}
+	return num_cut;
+}
+
 /*******************************************************************************
 	RSPR WORSE_3_APPROX_BINARY
 *******************************************************************************/
@@ -1139,9 +1497,9 @@ while(!singletons->empty()) {
 		continue;
 	bool potential_new_sibling_pair = T1_a_parent->is_sibling_pair();
 	// cut the edge above T1_a
-	um.add_event(new CutParent(T1_a));
+	um.add_event(CutParent(T1_a));
 	T1_a->cut_parent();
-	um.add_event(new AddComponent(T1));
+	um.add_event(AddComponent(T1));
 	T1->add_component(T1_a);
 	//if (T1_a->get_sibling_pair_status() > 0)
 	//	T1_a->clear_sibling_pair(sibling_pairs);
@@ -1150,7 +1508,7 @@ while(!singletons->empty()) {
 	ContractEvent(&um, T1_a_parent);
 	Node *node = T1_a_parent->contract();
 	if (node != NULL && potential_new_sibling_pair && node->is_sibling_pair()){
-		um.add_event(new AddToFrontSiblingPairs(sibling_pairs));
+		um.add_event(AddToFrontSiblingPairs(sibling_pairs));
 		sibling_pairs->push_front(node->rchild());
 		sibling_pairs->push_front(node->lchild());
 	}
@@ -1167,7 +1525,7 @@ if(!sibling_pairs->empty()) {
 	sibling_pairs->pop_back();
 	Node *T1_c = sibling_pairs->back();
 	sibling_pairs->pop_back();
-	um.add_event(new PopSiblingPair(T1_a, T1_c, sibling_pairs));
+	um.add_event(PopSiblingPair(T1_a, T1_c, sibling_pairs));
 
 	//if (T1_a->get_sibling_pair_status() == 0 ||
 	//		T1_c->get_sibling_pair_status() == 0) {
@@ -1205,12 +1563,12 @@ if(!sibling_pairs->empty()) {
 			T2->print_components();
 		#endif
 		Node *T2_ac = T2_a->parent();
-		um.add_event(new ContractSiblingPair(T1_ac));
-		um.add_event(new ContractSiblingPair(T2_ac));
+		um.add_event(ContractSiblingPair(T1_ac));
+		um.add_event(ContractSiblingPair(T2_ac));
 		T1_ac->contract_sibling_pair_undoable();
 		T2_ac->contract_sibling_pair_undoable();
-		um.add_event(new SetTwin(T1_ac));
-		um.add_event(new SetTwin(T2_ac));
+		um.add_event(SetTwin(T1_ac));
+		um.add_event(SetTwin(T2_ac));
 		T1_ac->set_twin(T2_ac);
 		T2_ac->set_twin(T1_ac);
 		//T1->add_deleted_node(T1_a);
@@ -1223,7 +1581,7 @@ if(!sibling_pairs->empty()) {
 			singletons->push_back(T2_ac);
 		// check if T1_ac is part of a sibling pair
 		if (T1_ac->parent() != NULL && T1_ac->parent()->is_sibling_pair()) {
-			um.add_event(new AddToSiblingPairs(sibling_pairs));
+			um.add_event(AddToSiblingPairs(sibling_pairs));
 			sibling_pairs->push_back(T1_ac->parent()->lchild());
 			sibling_pairs->push_back(T1_ac->parent()->rchild());
 		}
@@ -1271,7 +1629,7 @@ if(!sibling_pairs->empty()) {
 		bool cut_b_only = false;
 		if (T2_a->parent() != NULL && T2_a->parent()->parent() != NULL && T2_a->parent()->parent() == T2_c->parent()) {
 			cut_b_only = true;
-			um.add_event(new AddToSiblingPairs(sibling_pairs));
+			um.add_event(AddToSiblingPairs(sibling_pairs));
 			sibling_pairs->push_back(T1_c);
 			sibling_pairs->push_back(T1_a);
 		}
@@ -1279,13 +1637,13 @@ if(!sibling_pairs->empty()) {
 		Node *node;
 
 		if (!cut_b_only) {
-			um.add_event(new CutParent(T1_a));
+			um.add_event(CutParent(T1_a));
 			T1_a->cut_parent();
 
 			ContractEvent(&um, T1_ac);
 			node = T1_ac->contract();
 
-			um.add_event(new CutParent(T1_c));
+			um.add_event(CutParent(T1_c));
 			T1_c->cut_parent();
 
 
@@ -1295,7 +1653,7 @@ if(!sibling_pairs->empty()) {
 			// contract parents
 			// check for T1_ac sibling pair
 			if (node && node->is_sibling_pair()){
-				um.add_event(new AddToSiblingPairs(sibling_pairs));
+				um.add_event(AddToSiblingPairs(sibling_pairs));
 				sibling_pairs->push_back(node->lchild());
 				sibling_pairs->push_back(node->rchild());
 			}
@@ -1308,7 +1666,7 @@ if(!sibling_pairs->empty()) {
 		Node *T2_ab_parent = T2_ab->parent();
 		node = T2_ab;
 		if (!cut_b_only) {
-			um.add_event(new CutParent(T2_a));
+			um.add_event(CutParent(T2_a));
 			T2_a->cut_parent();
 
 			//ContractEvent(&um, T2_ab);
@@ -1316,7 +1674,7 @@ if(!sibling_pairs->empty()) {
 		}
 		bool cut_b = false;
 		if (same_component && T2_ab_parent != NULL) {
-			um.add_event(new CutParent(T2_b));
+			um.add_event(CutParent(T2_b));
 			T2_b->cut_parent();
 			//ContractEvent(&um, node);
 			//node = node->contract();
@@ -1341,7 +1699,7 @@ if(!sibling_pairs->empty()) {
 		if (T2_c != node && T2_c->parent() != NULL && !cut_b_only) {
 
 			Node *T2_c_parent = T2_c->parent();
-			um.add_event(new CutParent(T2_c));
+			um.add_event(CutParent(T2_c));
 			T2_c->cut_parent();
 			ContractEvent(&um, T2_c_parent);
 			node = T2_c_parent->contract();
@@ -1355,22 +1713,22 @@ if(!sibling_pairs->empty()) {
 
 		
 		if (!cut_b_only) {
-			um.add_event(new AddComponent(T1));
+			um.add_event(AddComponent(T1));
 			T1->add_component(T1_a);
-			um.add_event(new AddComponent(T1));
+			um.add_event(AddComponent(T1));
 			T1->add_component(T1_c);
 			// put T2 cut parts into T2
-			um.add_event(new AddComponent(T2));
+			um.add_event(AddComponent(T2));
 			T2->add_component(T2_a);
 			// may have already been added
 		}
 		if (cut_b) {
-			um.add_event(new AddComponent(T2));
+			um.add_event(AddComponent(T2));
 			T2->add_component(T2_b);
 		}
 		// problem if c is deleted
 		if (add_T2_c) {
-			um.add_event(new AddComponent(T2));
+			um.add_event(AddComponent(T2));
 			T2->add_component(T2_c);
 		}
 
@@ -1386,8 +1744,8 @@ if(!sibling_pairs->empty()) {
 // if the first component of the forests differ then we have cut p
 if (T1->get_component(0)->get_twin() != T2->get_component(0)) {
 	if (!T1->contains_rho()) {
-		um.add_event(new AddRho(T1));
-		um.add_event(new AddRho(T2));
+		um.add_event(AddRho(T1));
+		um.add_event(AddRho(T2));
 		T1->add_rho();
 		T2->add_rho();
 	}
@@ -1525,10 +1883,10 @@ return 0;
 		T2->get_component(0)->edge_preorder_interval();
 	}
 
-	set<SiblingPair> *sibling_pairs;
+	SiblingPairWorklist *sibling_pairs;
 	list<Node *> singletons;
 	list<pair<Forest,Forest> > AFs = list<pair<Forest,Forest> >();
-	sibling_pairs = find_sibling_pairs_set(T1);
+	sibling_pairs = find_sibling_pairs_worklist(T1);
 	singletons = T2->find_singletons();
 	list<Node *> protected_stack = list<Node *>();
 	int num_ties = 2;
@@ -1564,35 +1922,12 @@ final_k = k - final_k;
 	return final_k;
 }
 
-void add_sibling_pair(set<SiblingPair> *sibling_pairs, Node *a, Node *c, UndoMachine *um) {
-	SiblingPair sp = SiblingPair(a,c);
-	pair< set<SiblingPair>::iterator, bool> ins = 
-	sibling_pairs->insert(sp);
-	if (ins.second == false) {
-um->add_event(new RemoveSetSiblingPairs(sibling_pairs, *(ins.first)));
-sibling_pairs->erase(ins.first);
-ins = sibling_pairs->insert(sp);
-	}
-	um->add_event(new AddToSetSiblingPairs(sibling_pairs, *(ins.first)));
-}
-
-SiblingPair pop_sibling_pair(set<SiblingPair> *sibling_pairs, UndoMachine *um) {
-	set<SiblingPair>::iterator s = sibling_pairs->begin();
-	SiblingPair spair = SiblingPair(*s); 
-	um->add_event(new RemoveSetSiblingPairs(sibling_pairs, spair));
-	sibling_pairs->erase(s);
-	return spair;
-}
-
-SiblingPair pop_sibling_pair(set<SiblingPair>::iterator s, set<SiblingPair> *sibling_pairs, UndoMachine *um) {
-	SiblingPair spair = SiblingPair(*s); 
-	um->add_event(new RemoveSetSiblingPairs(sibling_pairs, spair));
-	sibling_pairs->erase(s);
-	return spair;
+void add_sibling_pair(SiblingPairWorklist *sibling_pairs, Node *a, Node *c) {
+	sibling_pairs->insert(SiblingPair(a,c));
 }
 
 inline int rSPR_branch_and_bound_hlpr(Forest *T1, Forest *T2, int k,
-set<SiblingPair> *sibling_pairs, list<Node *> *singletons,
+SiblingPairWorklist *sibling_pairs, list<Node *> *singletons,
 bool cut_b_only, list<pair<Forest,Forest> > *AFs,
 list<Node *> *protected_stack, int *num_ties) {
 	return rSPR_branch_and_bound_hlpr(T1, T2, k, sibling_pairs,
@@ -1601,7 +1936,7 @@ list<Node *> *protected_stack, int *num_ties) {
 
 // rSPR_branch_and_bound recursive helper function
 int rSPR_branch_and_bound_hlpr(Forest *T1, Forest *T2, int k,
-set<SiblingPair> *sibling_pairs, list<Node *> *singletons,
+SiblingPairWorklist *sibling_pairs, list<Node *> *singletons,
 bool cut_b_only, list<pair<Forest,Forest> > *AFs,
 list<Node *> *protected_stack, int *num_ties, Node *prev_T1_a, Node *prev_T1_c) {
 	#ifdef DEBUG
@@ -1612,11 +1947,11 @@ list<Node *> *protected_stack, int *num_ties, Node *prev_T1_a, Node *prev_T1_c)
 	T2->print_components();
 	cout << "K=" << k << endl;
 	cout << "sibling pairs:";
-	for (set<SiblingPair>::iterator i = sibling_pairs->begin(); i != sibling_pairs->end(); i++) {
+	for (int i = sibling_pairs->begin(); i != sibling_pairs->end(); i = sibling_pairs->next(i)) {
 cout << "  ";
-(*i).a->print_subtree_hlpr();
+sibling_pairs->get(i).a->print_subtree_hlpr();
 cout << ",";
-(*i).c->print_subtree_hlpr();
+sibling_pairs->get(i).c->print_subtree_hlpr();
 	}
 	cout << endl;
 	cout << "protected_stack:";
@@ -1628,6 +1963,8 @@ cout << "  ";
 	#endif
 
 	UndoMachine um = UndoMachine();
+	// the sibling pairs keep their own undo log
+	int sibling_pairs_start = sibling_pairs->mark();
 
 
 	while(!singletons->empty() || !sibling_pairs->empty()) {
@@ -1654,8 +1991,8 @@ cout << "  ";
 			if (T2_a == T2->get_component(0)) {
 				// TODO: should we do this when it happens?
 				if (!T1->contains_rho()) {
-					um.add_event(new AddRho(T1));
-					um.add_event(new AddRho(T2));
+					um.add_event(AddRho(T1));
+					um.add_event(AddRho(T2));
 					T1->add_rho();
 					T2->add_rho();
 					k--;
@@ -1666,10 +2003,10 @@ cout << "  ";
 			}
 		
 			// cut the edge above T1_a
-			um.add_event(new CutParent(T1_a));
+			um.add_event(CutParent(T1_a));
 			T1_a->cut_parent();
 		
-			um.add_event(new AddComponent(T1));
+			um.add_event(AddComponent(T1));
 			T1->add_component(T1_a);
 			ContractEvent(&um, T1_a_parent);
 		
@@ -1677,8 +2014,7 @@ cout << "  ";
 			Node *node = T1_a_parent->contract();
 		
 			if (node != NULL && potential_new_sibling_pair && node->is_sibling_pair()){
-				add_sibling_pair(sibling_pairs, node->lchild(), node->rchild(),
-						&um);
+				add_sibling_pair(sibling_pairs, node->lchild(), node->rchild());
 			}
 			#ifdef DEBUG
 				cout << "\tT1: ";
@@ -1691,7 +2027,7 @@ cout << "  ";
 		if(!sibling_pairs->empty()) {
 			Node *T1_a;
 			Node *T1_c;
-			set<SiblingPair>::iterator deepest_valid = sibling_pairs->end();
+			int deepest_valid = sibling_pairs->end();
 			int deepest_depth = INT_MAX;
 			int deepest_depth_2 = INT_MAX;
 			Node *best_a = NULL;
@@ -1702,18 +2038,19 @@ cout << "  ";
 					&& protected_stack->back()->get_twin()->parent() == NULL
 					&& protected_stack->back()->get_twin() != T1->get_component(0)) {
 				um.undo_all();
+				sibling_pairs->undo_to(sibling_pairs_start);
 				return -1;
 			}
 			while(!protected_stack->empty()
 					&& (protected_stack->back()->is_contracted()
 					// this shouldn't happen
 						|| protected_stack->back()->get_twin()->parent() == NULL)) {
-				um.add_event(new ListPopBack(protected_stack));
+				um.add_event(ListPopBack(protected_stack));
 				protected_stack->pop_back();
 			}
 			if (LEAF_REDUCTION && !cut_b_only) {
 				bool found = false;
-				set<SiblingPair>::iterator sp_i = sibling_pairs->begin();
+				int sp_i = sibling_pairs->begin();
 				// correct in case sibling pair involves previous
 		/*				if (sp_i != sibling_pairs->begin()) {
 					if (check_all_pairs)
@@ -1723,14 +2060,12 @@ cout << "  ";
 				}
 				*/
 				while (sp_i != sibling_pairs->end()) {
-					T1_a = (*sp_i).a;
-					T1_c = (*sp_i).c;
+					T1_a = sibling_pairs->get(sp_i).a;
+					T1_c = sibling_pairs->get(sp_i).c;
 					if (T1_a->parent() == NULL || T1_a->parent() != T1_c->parent()) {
-						um.add_event(new RemoveSetSiblingPairs(sibling_pairs,
-									SiblingPair(T1_a, T1_c)));
-						set<SiblingPair>::iterator rem = sp_i;
-						sp_i++;
-						sibling_pairs->erase(rem);
+						int rem = sp_i;
+						sp_i = sibling_pairs->next(sp_i);
+						sibling_pairs->remove(rem);
 						continue;
 					}
 					Node *T2_a = T1_a->get_twin();
@@ -1739,11 +2074,7 @@ cout << "  ";
 					if (T2_a->parent() != NULL && T2_a->parent() == T2_c->parent()
 							|| (!cut_b_only && PREFER_NONBRANCHING
 									&& is_nonbranching(T1, T2, T1_a, T1_c, T2_a, T2_c))) {
-						um.add_event(new RemoveSetSiblingPairs(sibling_pairs,
-									SiblingPair(T1_a, T1_c)));
-						set<SiblingPair>::iterator rem = sp_i;
-						sp_i++;
-						sibling_pairs->erase(rem);
+						sibling_pairs->remove(sp_i);
 						found = true;
 						break;
 					}
@@ -1781,7 +2112,7 @@ cout << "  ";
 
 					/* TODO: remember to pop the stack when we include the protected
 					   node */
-					sp_i++;
+					sp_i = sibling_pairs->next(sp_i);
 				}
 				if (!found) {
 					if (sibling_pairs->empty())
@@ -1790,9 +2121,9 @@ cout << "  ";
 						SiblingPair spair;
 //						cout << "depth: " << deepest_depth << endl;
 						if (DEEPEST_ORDER && deepest_valid != sibling_pairs->end())
-							spair = pop_sibling_pair(deepest_valid, sibling_pairs, &um);
+							spair = sibling_pairs->remove(deepest_valid);
 						else
-							spair = pop_sibling_pair(sibling_pairs, &um);
+							spair = sibling_pairs->pop();
 						T1_a = spair.a;
 						T1_c = spair.c;
 					}
@@ -1806,7 +2137,7 @@ cout << "  ";
 					prev_T1_c = NULL;
 				}
 				else {
-					SiblingPair spair = pop_sibling_pair(sibling_pairs, &um);
+					SiblingPair spair = sibling_pairs->pop();
 					T1_a = spair.a;
 					T1_c = spair.c;
 				}
@@ -1837,37 +2168,38 @@ cout << "  ";
 						(T2_a->get_max_merge_depth() > T2_ac->get_depth()
 							|| T2_c->get_max_merge_depth() > T2_ac->get_depth())) {
 					um.undo_all();
+					sibling_pairs->undo_to(sibling_pairs_start);
 					return -1;
 				}
 
 				if (!protected_stack->empty() &&
 						(T2_a == protected_stack->back()
 						 	|| T2_c == protected_stack->back())) {
-					um.add_event(new ListPopBack(protected_stack));
+					um.add_event(ListPopBack(protected_stack));
 					protected_stack->pop_back();
 				}
 				// CAN THIS HAPPEN TWICE?
 				if (!protected_stack->empty() &&
 						(T2_a == protected_stack->back()
 						 	|| T2_c == protected_stack->back())) {
-					um.add_event(new ListPopBack(protected_stack));
+					um.add_event(ListPopBack(protected_stack));
 					protected_stack->pop_back();
 				}
 
 
-				um.add_event(new ContractSiblingPair(T1_ac));
+				um.add_event(ContractSiblingPair(T1_ac));
 				T1_ac->contract_sibling_pair_undoable();
-				um.add_event(new ContractSiblingPair(T2_ac, T2_a, T2_c, &um));
+				um.add_event(ContractSiblingPair(T2_ac, T2_a, T2_c, &um));
 				Node *T2_ac_new = T2_ac->contract_sibling_pair_undoable(T2_a, T2_c);
 				if (T2_ac_new != NULL && T2_ac_new != T2_ac) {
 					T2_ac = T2_ac_new;
-					um.add_event(new CreateNode(T2_ac));
-					um.add_event(new ContractSiblingPair(T2_ac));
+					um.add_event(CreateNode(T2_ac));
+					um.add_event(ContractSiblingPair(T2_ac));
 					T2_ac->contract_sibling_pair_undoable();
 				}
 
-				um.add_event(new SetTwin(T1_ac));
-				um.add_event(new SetTwin(T2_ac));
+				um.add_event(SetTwin(T1_ac));
+				um.add_event(SetTwin(T2_ac));
 				T1_ac->set_twin(T2_ac);
 				T2_ac->set_twin(T1_ac);
 				//T1->add_deleted_node(T1_a);
@@ -1880,8 +2212,7 @@ cout << "  ";
 					singletons->push_back(T2_ac);
 				// check if T1_ac is part of a sibling pair
 				if (T1_ac->parent() != NULL && T1_ac->parent()->is_sibling_pair()) {
-				add_sibling_pair(sibling_pairs, T1_ac->parent()->lchild(), T1_ac->parent()->rchild(),
-						&um);
+				add_sibling_pair(sibling_pairs, T1_ac->parent()->lchild(), T1_ac->parent()->rchild());
 				}
 				#ifdef DEBUG
 					cout << "\tT1: ";
@@ -1914,6 +2245,7 @@ cout << "  ";
 							&& (T2_c->parent() != NULL && T2_a->parent() != NULL)|| !T2->contains_rho()) {
 						singletons->clear();
 						um.undo_all();
+						sibling_pairs->undo_to(sibling_pairs_start);
 						return k-1;
 					}
 				}
@@ -1933,6 +2265,7 @@ cout << "  ";
 				bool cut_b_only_if_not_a_or_c = false;
 				bool cob = false;
 				int undo_state = um.num_events();
+				int sibling_pairs_state = sibling_pairs->mark();
 				//  ensure T2_a is below T2_c
 				if ((T2_a->get_depth() < T2_c->get_depth()
 						&& T2_c->parent() != NULL)
@@ -2040,7 +2373,7 @@ cout << "  ";
 						cut_b_only=false;
 						cob=false;
 						if (!T2_a->is_protected()) {
-							um.add_event(new ProtectEdge(T2_a));
+							um.add_event(ProtectEdge(T2_a));
 							T2_a->protect_edge();
 						}
 					}
@@ -2065,7 +2398,7 @@ cout << "  ";
 					cut_b_only=false;
 					cob=false;
 					if (!T2_a->is_protected()) {
-						um.add_event(new ProtectEdge(T2_a));
+						um.add_event(ProtectEdge(T2_a));
 						T2_a->protect_edge();
 					}
 				}
@@ -2109,11 +2442,11 @@ cout << "  ";
 					T2->print_components();
 					cout << "\tK=" << k << endl;
 					cout << "\tsibling pairs:";
-					for (set<SiblingPair>::iterator i = sibling_pairs->begin(); i != sibling_pairs->end(); i++) {
+					for (int i = sibling_pairs->begin(); i != sibling_pairs->end(); i = sibling_pairs->next(i)) {
 						cout << "  ";
-						(*i).a->print_subtree_hlpr();
+						sibling_pairs->get(i).a->print_subtree_hlpr();
 						cout << ",";
-						(*i).c->print_subtree_hlpr();
+						sibling_pairs->get(i).c->print_subtree_hlpr();
 					}
 					cout << endl;
 					cout << "\tprotected_stack:";
@@ -2155,9 +2488,9 @@ cout << "  ";
 					spairs = new list<Node *>();
 					spairs->push_back(T1_c);
 					spairs->push_back(T1_a);
-					for (set<SiblingPair>::iterator i = sibling_pairs->begin(); i != sibling_pairs->end(); i++) {
-						spairs->push_back((*i).a);
-						spairs->push_back((*i).c);
+					for (int i = sibling_pairs->begin(); i != sibling_pairs->end(); i = sibling_pairs->next(i)) {
+						spairs->push_back(sibling_pairs->get(i).a);
+						spairs->push_back(sibling_pairs->get(i).c);
 					}
 					int approx_spr = rSPR_worse_3_approx_hlpr(T1, T2,
 							singletons, spairs, NULL, NULL, false);
@@ -2174,9 +2507,11 @@ cout << "  ";
 							cout << "approx failed" << endl;
 						#endif
 						um.undo_all();
+						sibling_pairs->undo_to(sibling_pairs_start);
 						return -1;
 					}
 					um.undo_to(undo_state);
+					sibling_pairs->undo_to(sibling_pairs_state);
 				}
 
 				if (!cut_a_only && !cut_c_only && !cut_b_only)
@@ -2406,14 +2741,14 @@ cout << "  ";
 								|| T2_a->parent()->get_children().size() > 2)) {// &&
 //						(!T2_a->parent()->is_protected() ||
 //							T2_a->parent()->get_children().size() > 2)) { }
-					um.add_event(new CutParent(T2_a));
+					um.add_event(CutParent(T2_a));
 					T2_a->cut_parent();
 					ContractEvent(&um, T2_ab);
 					node = T2_ab->contract();
 					if (node != NULL && node->is_singleton() &&
 							node != T2->get_component(0))
 						singletons->push_back(node);
-					um.add_event(new AddComponent(T2));
+					um.add_event(AddComponent(T2));
 					T2->add_component(T2_a);
 					singletons->push_back(T2_a);
 
@@ -2424,7 +2759,7 @@ cout << "  ";
 					if (EDGE_PROTECTION_TWO_B && T2_c->is_protected() && !cut_a_only){
 						if (path_length == 4) {
 							if (!multi_b1 && !multi_b2 && !T2_b->is_protected()) {
-								um.add_event(new ProtectEdge(T2_b));
+								um.add_event(ProtectEdge(T2_b));
 								T2_b->protect_edge();
 							}
 							if (!multi_b2 && !multi_b1) {
@@ -2432,7 +2767,7 @@ cout << "  ";
 								if (balanced)
 									T2_b2 = T2_d;
 								if (!T2_b2->is_protected()) {
-									um.add_event(new ProtectEdge(T2_b2));
+									um.add_event(ProtectEdge(T2_b2));
 									T2_b2->protect_edge();
 								}
 							}
@@ -2454,6 +2789,7 @@ cout << "  ";
 				best_T2 = T2;
 
 				um.undo_to(undo_state);
+				sibling_pairs->undo_to(sibling_pairs_state);
 /*				#ifdef DEBUG
 					cout << "Case 3 CHECK" << endl;
 					cout << "\tT1: ";
@@ -2549,61 +2885,60 @@ cout << "  ";
 								|| (T2_a->parent() == T2->get_component(0)
 										&& !T2->contains_rho()))) {
 					if (multi_node) {
-						um.add_event(new ChangeEdgePreInterval(T2_a));
+						um.add_event(ChangeEdgePreInterval(T2_a));
 						T2_a->copy_edge_pre_interval(T2_ab);
-						um.add_event(new CutParent(T2_a));
+						um.add_event(CutParent(T2_a));
 						T2_a->cut_parent();
-						um.add_event(new ChangeEdgePreInterval(T2_ab));
+						um.add_event(ChangeEdgePreInterval(T2_ab));
 						T2_ab->set_edge_pre_start(-1);
 						T2_ab->set_edge_pre_end(-1);
 						Node *T2_ab_parent = T2_ab->parent();
 						if (T2_ab_parent != NULL) {
-							um.add_event(new CutParent(T2_ab));
+							um.add_event(CutParent(T2_ab));
 							T2_ab->cut_parent();
-							um.add_event(new AddChild(T2_a));
+							um.add_event(AddChild(T2_a));
 							T2_ab_parent->add_child(T2_a);
-							um.add_event(new AddComponent(T2));
+							um.add_event(AddComponent(T2));
 							T2->add_component(T2_ab);
 						}
 						else {
 							if (T2->get_component(0) == T2_ab) {
-								um.add_event(new AddComponentToFront(T2));
+								um.add_event(AddComponentToFront(T2));
 								T2->add_component(0, T2_a);
 							}
 							else {
-								um.add_event(new AddComponent(T2));
+								um.add_event(AddComponent(T2));
 								T2->add_component(T2_a);
 								singletons->push_back(T2_a);
 							}
 						}
 					}
 					else {
-						um.add_event(new CutParent(T2_b));
+						um.add_event(CutParent(T2_b));
 						T2_b->cut_parent();
 						ContractEvent(&um, T2_ab);
 						node = T2_ab->contract();
 						if (node != NULL && node->is_singleton()
 								&& node != T2->get_component(0))
 								singletons->push_back(node);
-						um.add_event(new AddComponent(T2));
+						um.add_event(AddComponent(T2));
 						T2->add_component(T2_b);
 						if (T2_b->is_leaf())
 							singletons->push_back(T2_b);
 					}
-				add_sibling_pair(sibling_pairs, T1_a, T1_c,
-						&um);
+				add_sibling_pair(sibling_pairs, T1_a, T1_c);
 
 					// TODO: check carefully
 
 					if (cut_a_or_merge_ac) {
 						if (!T2_a->is_protected()) {
-							um.add_event(new ProtectEdge(T2_a));
+							um.add_event(ProtectEdge(T2_a));
 							T2_a->protect_edge();
-							um.add_event(new ListPushBack(protected_stack));
+							um.add_event(ListPushBack(protected_stack));
 							protected_stack->push_back(T2_a);
 						}
 						if (!T2_c->is_protected()) {
-							um.add_event(new ProtectEdge(T2_c));
+							um.add_event(ProtectEdge(T2_c));
 							T2_c->protect_edge();
 						}
 					}
@@ -2631,6 +2966,7 @@ cout << "  ";
 				}
 
 				um.undo_to(undo_state);
+				sibling_pairs->undo_to(sibling_pairs_state);
 
 				/*
 				delete T1;
@@ -2673,14 +3009,14 @@ cout << "  ";
 
 					if (T2_c->parent() != NULL) {
 						Node *T2_c_parent = T2_c->parent();
-						um.add_event(new CutParent(T2_c));
+						um.add_event(CutParent(T2_c));
 						T2_c->cut_parent();
 						ContractEvent(&um, T2_c_parent);
 						node = T2_c_parent->contract();
 						if (node != NULL && node->is_singleton()
 								&& node != T2->get_component(0))
 							singletons->push_back(node);
-						um.add_event(new AddComponent(T2));
+						um.add_event(AddComponent(T2));
 						T2->add_component(T2_c);
 					}
 					else {
@@ -2689,11 +3025,11 @@ cout << "  ";
 					}
 					if (EDGE_PROTECTION && !cut_c_only) {
 						if (!T2_a->is_protected()) {
-							um.add_event(new ProtectEdge(T2_a));
+							um.add_event(ProtectEdge(T2_a));
 							T2_a->protect_edge();
 //							if (DEEPEST_PROTECTED_ORDER && !cut_c_only) {
 							if (DEEPEST_PROTECTED_ORDER) {
-								um.add_event(new ListPushBack(protected_stack));
+								um.add_event(ListPushBack(protected_stack));
 								protected_stack->push_back(T2_a);
 							}
 							// TODO: add to protected list
@@ -2704,7 +3040,7 @@ cout << "  ";
 						if (EDGE_PROTECTION_TWO_B) {
 							if (path_length == 4) {
 								if (!multi_b1 && !multi_b2 && !T2_b->is_protected()) {
-									um.add_event(new ProtectEdge(T2_b));
+									um.add_event(ProtectEdge(T2_b));
 									T2_b->protect_edge();
 								}
 								if (!multi_b2 && !multi_b1) {
@@ -2712,7 +3048,7 @@ cout << "  ";
 									if (balanced)
 										T2_b2 = T2_d;
 									if (!T2_b2->is_protected()) {
-										um.add_event(new ProtectEdge(T2_b2));
+										um.add_event(ProtectEdge(T2_b2));
 										T2_b2->protect_edge();
 									}
 								}
@@ -2749,6 +3085,7 @@ cout << "  ";
 				*/
 
 				um.undo_to(undo_state);
+				sibling_pairs->undo_to(sibling_pairs_state);
 
 				//T1 = best_T1;
 				//T2 = best_T2;
@@ -2761,11 +3098,11 @@ cout << "  ";
 				cout << "T2: ";
 				T2->print_components();
 					cout << "sibling pairs:";
-					for (set<SiblingPair>::iterator i = sibling_pairs->begin(); i != sibling_pairs->end(); i++) {
+					for (int i = sibling_pairs->begin(); i != sibling_pairs->end(); i = sibling_pairs->next(i)) {
 						cout << "  ";
-						(*i).a->print_subtree_hlpr();
+						sibling_pairs->get(i).a->print_subtree_hlpr();
 						cout << ",";
-						(*i).c->print_subtree_hlpr();
+						sibling_pairs->get(i).c->print_subtree_hlpr();
 					}
 					cout << endl;
 			 um.undo();
@@ -2774,6 +3111,7 @@ cout << "  ";
 #else
 		 um.undo_all();
 #endif
+		 sibling_pairs->undo_to(sibling_pairs_start);
 				singletons->clear();
 				return best_k;
 			}
@@ -2808,11 +3146,11 @@ cout << "  ";
 				cout << "T2: ";
 				T2->print_components();
 					cout << "sibling pairs:";
-					for (set<SiblingPair>::iterator i = sibling_pairs->begin(); i != sibling_pairs->end(); i++) {
+					for (int i = sibling_pairs->begin(); i != sibling_pairs->end(); i = sibling_pairs->next(i)) {
 						cout << "  ";
-						(*i).a->print_subtree_hlpr();
+						sibling_pairs->get(i).a->print_subtree_hlpr();
 						cout << ",";
-						(*i).c->print_subtree_hlpr();
+						sibling_pairs->get(i).c->print_subtree_hlpr();
 					}
 					cout << endl;
 			 um.undo();
@@ -2821,6 +3159,7 @@ cout << "  ";
 #else
 		 um.undo_all();
 #endif
+		 sibling_pairs->undo_to(sibling_pairs_start);
 
 	return k;
 }
@@ -2834,7 +3173,19 @@ int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, ma
 }
 
 int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, map<string, int> *label_map, map<int, string> *reverse_label_map, int min_k, int max_k, Forest **out_F1, Forest **out_F2) {
+	return rSPR_branch_and_bound_simple_clustering(T1, T2, verbose, label_map, reverse_label_map, min_k, max_k, out_F1, out_F2, NULL);
+}
+
+/* T2_tree_LCA, if not NULL, is the LCA of T2 from GENE_TREE_LCAS and
+ * saves building one for the copy of T2
+ */
+int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, map<string, int> *label_map, map<int, string> *reverse_label_map, int min_k, int max_k, Forest **out_F1, Forest **out_F2, LCA *T2_tree_LCA) {
+	// every forest below is a copy that dies with this comparison unless
+	// the MAFs are returned, so draw them from the thread's arena
+	NodeArenaScope arena(out_F1 == NULL && out_F2 == NULL);
 	bool do_cluster = true;
+	// a caller that sets max_k only needs to know when it is exceeded
+	bool bounded = (max_k >= 0 && max_k <= MAX_SPR);
 	if (max_k > MAX_SPR)
 		max_k = MAX_SPR;
 	else if (max_k == -1)
@@ -2905,7 +3256,7 @@ int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, ma
 		//F1.print_components();
 		//F2.print_components();
 	if (do_cluster) {
-		sync_interior_twins(&F1, &F2);
+		sync_interior_twins(&F1, &F2, T2_tree_LCA);
 		cluster_points = find_cluster_points(&F1, &F2);
 		//	list<Node *> *cluster_points = new list<Node *>();
 		for(list<Node *>::iterator i = cluster_points->begin();
@@ -3073,6 +3424,9 @@ int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, ma
 							// TODO: this should be an approx of the remaining forest
 //							total_k += approx_spr;
 						}
+						else if (bounded && k + total_k > max_k) {
+							total_k = max_k + 1;
+						}
 						else if (CLAMP) {
 							total_k = max_k;
 						}
@@ -3154,8 +3508,8 @@ int rSPR_branch_and_bound_simple_clustering(Node *T1, Node *T2, bool verbose, ma
 //						if (split_node->rchild() != NULL)
 //							split_node->rchild()->allow_siblings_subtree();
 							//f1s.get_component(0)->find_subtree_of_size(tree_fraction);
-							set<SiblingPair > *sibling_pairs =
-								find_sibling_pairs_set(split_node);
+							SiblingPairWorklist *sibling_pairs =
+								find_sibling_pairs_worklist(split_node);
 							list<Node *> singletons = f2s.find_singletons();
 							list<pair<Forest,Forest> > AFs = list<pair<Forest,Forest> >();
 							list<Node *> protected_stack = list<Node *>();
@@ -3563,6 +3917,148 @@ bool chain_match(Node *T1_node, Node *T2_node, Node *T2_node_end) {
 	return false;
 }
 
+// chain_match on FlatForests
+bool chain_match(FlatForest *T1, FlatForest *T2, int T1_node, int T2_node,
+		int T2_node_end) {
+	if (T1_node == -1 || T2_node == -1 || T2->is_leaf(T2_node))
+		return false;
+	// T1_node is a leaf
+	if (T1->is_leaf(T1_node)) {
+		int twin = T1->twins[T1_node];
+		if (twin == T2->lchild(T2_node)) {
+			if (T2->rchild(T2_node) == T2_node_end)
+				return true;
+		}
+		else if (twin == T2->rchild(T2_node)) {
+			if (T2->lchild(T2_node) == T2_node_end)
+				return true;
+		}
+		return false;
+	}
+	// T1_pendant is T1_node->lchild()
+	int T1_pendant = T1->lchild(T1_node);
+	if (T1->is_leaf(T1_pendant)) {
+		int T2_pendant = T2->lchild(T2_node);
+		if (T2->is_leaf(T2_pendant) && T1->twins[T1_pendant] == T2_pendant) {
+			return chain_match(T1, T2, T1->get_sibling(T1_pendant),
+					T2->get_sibling(T2_pendant), T2_node_end);
+		}
+		T2_pendant = T2->rchild(T2_node);
+		if (T2_pendant != -1 && T2->is_leaf(T2_pendant)
+				&& T1->twins[T1_pendant] == T2_pendant) {
+			return chain_match(T1, T2, T1->get_sibling(T1_pendant),
+					T2->get_sibling(T2_pendant), T2_node_end);
+		}
+	}
+	return false;
+}
+
+/* rSPR distance between T1 and T2 using T1 restricted to the leaves of
+ * T2 by T1_projection (when it can be used) instead of a full copy
+ * of T1
+ *
+ * if max_k is not -1 then a distance larger than max_k is only
+ * guaranteed to be larger than max_k
+ */
+int rSPR_projected_distance(Node *T1, FlatProjection *T1_projection,
+		Node *T2, int max_k) {
+	if (T1_projection != NULL && T1_projection->is_exact() && !COUNT_LOSSES) {
+		NodeArenaScope arena;
+		Node *T1_restricted = T1_projection->project(T2);
+		if (T1_restricted != NULL) {
+			// the distance only depends on the topology of the restriction
+			bool cached = DISTANCE_CACHE.is_cached(T2);
+			RestrictionKey key = RestrictionKey();
+			int k;
+			if (cached)
+				key = DistanceCache::restriction_key(
+						T1_restricted->canonical_str());
+			if (!cached || !DISTANCE_CACHE.lookup(T2, key, &k)) {
+				k = rSPR_branch_and_bound_simple_clustering(T1_restricted, T2,
+						VERBOSE, NULL, NULL, -1, max_k, NULL, NULL,
+						GENE_TREE_LCAS.lookup(T2));
+				// a bounded search that failed is not the distance
+				if (cached && (max_k < 0 || k <= max_k))
+					DISTANCE_CACHE.insert(T2, key, k);
+			}
+			T1_restricted->delete_tree();
+			return k;
+		}
+	}
+	return rSPR_branch_and_bound_simple_clustering(T1, T2, VERBOSE, -1,
+			max_k);
+}
+
+int rSPR_projected_distance(Node *T1, FlatProjection *T1_projection,
+		Node *T2) {
+	return rSPR_projected_distance(T1, T1_projection, T2, -1);
+}
+
+/* false if T2 is known to share fewer than n taxa with T1_taxa, so its
+ * distance to T1 is 0 when n is 3 for rooted trees or 4 for unrooted
+ * trees. Trees that are not in GENE_TREE_TAXA are never skipped
+ */
+bool shares_taxa(TaxonSet *T1_taxa, Node *T2, int n) {
+	if (COUNT_LOSSES)
+		return true;
+	TaxonSet *T2_taxa = GENE_TREE_TAXA.lookup(T2);
+	return T2_taxa == NULL || T1_taxa->shares_at_least(*T2_taxa, n);
+}
+
+// number of input copies that the tree T stands for, see dedup_trees
+int tree_weight(Node *T) {
+	return T->get_weight();
+}
+
+/* dedup_trees
+ * Collapse trees with the same topology into their first occurrence and
+ * add the weights of the copies to its root. The total distance
+ * functions multiply each distance by this weight so the totals are
+ * unchanged. Topologies are compared by canonical_str, or
+ * canonical_unrooted_str if unrooted is set, or by the exact string with
+ * child order if ordered is set.
+ * names, if not NULL, is kept parallel to trees and representative, if
+ * not NULL, is set to the index of the tree kept for each input tree.
+ * RETURN the number of trees removed
+ */
+int dedup_trees(vector<Node *> *trees, vector<string> *names,
+		vector<int> *representative, bool unrooted, bool ordered) {
+	map<string, int> seen = map<string, int>();
+	vector<Node *> unique_trees = vector<Node *>();
+	vector<string> unique_names = vector<string>();
+	if (representative != NULL)
+		representative->clear();
+	for(int i = 0; i < trees->size(); i++) {
+		Node *T = (*trees)[i];
+		string key;
+		if (ordered)
+			key = T->str_subtree();
+		else if (unrooted)
+			key = T->canonical_unrooted_str();
+		else
+			key = T->canonical_str();
+		map<string, int>::iterator s = seen.find(key);
+		if (s == seen.end()) {
+			s = seen.insert(make_pair(key, unique_trees.size())).first;
+			unique_trees.push_back(T);
+			if (names != NULL)
+				unique_names.push_back((*names)[i]);
+		}
+		else {
+			Node *kept = unique_trees[s->second];
+			kept->set_weight(kept->get_weight() + T->get_weight());
+			T->delete_tree();
+		}
+		if (representative != NULL)
+			representative->push_back(s->second);
+	}
+	int removed = trees->size() - unique_trees.size();
+	*trees = unique_trees;
+	if (names != NULL)
+		*names = unique_names;
+	return removed;
+}
+
 int rSPR_total_distance(Node *T1, vector<Node *> &gene_trees) {
 	return rSPR_total_distance(T1, gene_trees, NULL);
 }
@@ -3573,17 +4069,22 @@ int rSPR_total_distance(Node *T1, vector<Node *> &gene_trees,
 	MAIN_CALL = false;
 	int end = gene_trees.size();
 //	T1->preorder_number();
+	FlatProjection T1_projection = FlatProjection(T1);
+	TaxonSet T1_taxa = TaxonSet(T1);
 	#pragma omp parallel for reduction(+ : total) firstprivate(PREFER_RHO)  // firstprivate(IN_SPLIT_APPROX)
 //	for(int j = 0; j < 10; j++)
 //	cout << "T1: " << T1->str_subtree() << endl;
 	for(int i = 0; i < end; i++) {
 			//		cout << i << endl;
-		int k = rSPR_branch_and_bound_simple_clustering(T1, gene_trees[i], VERBOSE);
+		int k = 0;
+		if (shares_taxa(&T1_taxa, gene_trees[i], 3))
+			k = rSPR_projected_distance(T1, &T1_projection, gene_trees[i]);
 //		k *= mylog2(gene_trees[i]->size());
+		int weight = tree_weight(gene_trees[i]);
 
 		if (original_scores != NULL)
-			(*original_scores)[i] = k;
-		total += k;
+			(*original_scores)[i] = k * weight;
+		total += k * weight;
 //		cout << "T2: " << gene_trees[i]->str_subtree() << endl;
 //		cout << " k: " << k << endl;
 		if (FIND_RATE) {
@@ -3591,7 +4092,8 @@ int rSPR_total_distance(Node *T1, vector<Node *> &gene_trees,
 				int size = gene_trees[i]->find_leaves().size();
 //				cout << k << endl;
 //				cout << size << endl;
-				cout << "rate=" << (float)k / size << endl;
+				for(int w = 0; w < weight; w++)
+					cout << "rate=" << (float)k / size << endl;
 //				cout << T1->str_subtree() << endl;
 //				cout << gene_trees[i]->str_subtree() << endl;
 			}
@@ -3603,6 +4105,16 @@ int rSPR_total_distance(Node *T1, vector<Node *> &gene_trees,
 	return total;
 }
 
+// comma separated distances of one row of a pairwise matrix
+void print_pairwise_row(const vector<int> &distances) {
+	for(int i = 0; i < distances.size(); i++) {
+		if (i > 0)
+			cout << ",";
+		cout << distances[i];
+	}
+	cout << "\n";
+}
+
 void rSPR_pairwise_distance(Node *T1, vector<Node *> &gene_trees) {
 	rSPR_pairwise_distance(T1, gene_trees, 0, gene_trees.size());
 }
@@ -3616,15 +4128,22 @@ void rSPR_pairwise_distance(Node *T1, vector<Node *> &gene_trees, int start, int
 }
 
 void rSPR_pairwise_distance(Node *T1, vector<Node *> &gene_trees, int start, int end, bool approx) {
+	print_pairwise_row(rSPR_pairwise_distance_row(T1, gene_trees, start, end, approx));
+}
+
+vector<int> rSPR_pairwise_distance_row(Node *T1, vector<Node *> &gene_trees, int start, int end, bool approx) {
 	MAIN_CALL = false;
 //	T1->preorder_number();
 	vector<int> distances = vector<int>(end-start);
+	FlatForest T1_flat = FlatForest();
+	if (approx)
+		T1_flat = FlatForest(T1);
 	#pragma omp parallel for shared(distances) firstprivate(PREFER_RHO)
 	for(int i = start; i < end; i++) {
 		int k;
 		if (approx) {
-			Forest F1 = Forest(T1);
-			Forest F2 = Forest(gene_trees[i]);
+			FlatForest F1 = T1_flat;
+			FlatForest F2 = FlatForest(gene_trees[i]);
 			k = rSPR_worse_3_approx_distance_only(&F1, &F2)/3;
 		}
 		else {
@@ -3632,12 +4151,7 @@ void rSPR_pairwise_distance(Node *T1, vector<Node *> &gene_trees, int start, int
 		}
 		distances[i-start] = k;
 	}
-
-	cout << distances[0];
-	for(int i = 1; i < end-start; i++) {
-		cout << "," << distances[i];
-	}
-	cout << "\n";
+	return distances;
 }
 
 
@@ -3646,22 +4160,22 @@ void rSPR_pairwise_distance(Node *T1, vector<Node *> &gene_trees, int max_spr) {
 }
 
 void rSPR_pairwise_distance(Node *T1, vector<Node *> &gene_trees, int max_spr, int start, int end) {
+	print_pairwise_row(rSPR_pairwise_distance_row(T1, gene_trees, max_spr, start, end));
+}
+
+vector<int> rSPR_pairwise_distance_row(Node *T1, vector<Node *> &gene_trees, int max_spr, int start, int end) {
 	MAIN_CALL = false;
 //	T1->preorder_number();
 	vector<int> distances = vector<int>(end-start);
 	#pragma omp parallel for shared(distances) firstprivate(PREFER_RHO)
 	for(int i = start; i < end; i++) {
+		NodeArenaScope arena;
 		Forest F1 = Forest(T1);
 		Forest F2 = Forest(gene_trees[i]);
 		int k = rSPR_branch_and_bound_range(&F1, &F2, 0, max_spr);
 		distances[i-start] = k;
 	}
-
-	cout << distances[0];
-	for(int i = 1; i < end-start; i++) {
-		cout << "," << distances[i];
-	}
-	cout << "\n";
+	return distances;
 }
 
 void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees) {
@@ -3677,11 +4191,16 @@ void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int s
 }
 
 void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int start, int end, bool approx) {
+	print_pairwise_row(rSPR_pairwise_distance_unrooted_row(T1, gene_trees, start, end, approx));
+}
+
+vector<int> rSPR_pairwise_distance_unrooted_row(Node *T1, vector<Node *> &gene_trees, int start, int end, bool approx) {
 	MAIN_CALL = false;
 	T1->preorder_number();
 	vector<int> distances = vector<int>(end-start);
 	#pragma omp parallel for shared(distances) firstprivate(PREFER_RHO)
 	for(int i = start; i < end; i++) {
+		NodeArenaScope arena;
 		int best_k = INT_MAX;
 		Node *T2_copy = new Node(*(gene_trees[i]));
 		vector<Node *> descendants = 
@@ -3710,12 +4229,7 @@ void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int s
 		distances[i-start] = best_k;
 		T2_copy->delete_tree();
 	}
-
-	cout << distances[0];
-	for(int i = 1; i < end-start; i++) {
-		cout << "," << distances[i];
-	}
-	cout << "\n";
+	return distances;
 }
 
 void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int max_spr) {
@@ -3723,11 +4237,16 @@ void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int m
 }
 
 void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int max_spr, int start, int end) {
+	print_pairwise_row(rSPR_pairwise_distance_unrooted_row(T1, gene_trees, max_spr, start, end));
+}
+
+vector<int> rSPR_pairwise_distance_unrooted_row(Node *T1, vector<Node *> &gene_trees, int max_spr, int start, int end) {
 	MAIN_CALL = false;
 	T1->preorder_number();
 	vector<int> distances = vector<int>(end-start);
 	#pragma omp parallel for shared(distances) firstprivate(PREFER_RHO)
 	for(int i = start; i < end; i++) {
+		NodeArenaScope arena;
 		int best_k = -1;
 		Node *T2_copy = new Node(*(gene_trees[i]));
 		vector<Node *> descendants = 
@@ -3750,12 +4269,7 @@ void rSPR_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int m
 		distances[i-start] = best_k;
 		T2_copy->delete_tree();
 	}
-
-	cout << distances[0];
-	for(int i = 1; i < end-start; i++) {
-		cout << "," << distances[i];
-	}
-	cout << "\n";
+	return distances;
 }
 
 int rSPR_total_distance_precomputed(Node *T1, vector<Node *> &gene_trees,
@@ -3764,8 +4278,26 @@ int rSPR_total_distance_precomputed(Node *T1, vector<Node *> &gene_trees,
 	MAIN_CALL = false;
 	int end = gene_trees.size();
 //	T1->preorder_number();
+	FlatProjection T1_projection = FlatProjection(T1);
+	bool project = T1_projection.is_exact() && !COUNT_LOSSES;
+	TaxonSet T1_taxa = TaxonSet(T1);
 	#pragma omp parallel for reduction(+ : total) firstprivate(PREFER_RHO)  // firstprivate(IN_SPLIT_APPROX)
 	for(int i = 0; i < end; i++) {
+		NodeArenaScope arena;
+		if (!shares_taxa(&T1_taxa, gene_trees[i], 3)) {
+			if (new_original_scores != NULL)
+				(*new_original_scores)[i] = 0;
+			continue;
+		}
+		// cached distances are looked up by the restriction itself
+		if (project && DISTANCE_CACHE.is_cached(gene_trees[i])) {
+			int k = rSPR_projected_distance(T1, &T1_projection, gene_trees[i])
+					* tree_weight(gene_trees[i]);
+			if (new_original_scores != NULL)
+				(*new_original_scores)[i] = k;
+			total += k;
+			continue;
+		}
 		// check that the SPR move affects the projection of T1
 		Forest F1 = Forest(T1);
 		Forest F2 = Forest(gene_trees[i]);
@@ -3775,7 +4307,8 @@ int rSPR_total_distance_precomputed(Node *T1, vector<Node *> &gene_trees,
 		int k = 0;
 		if (original_scores == NULL
 				|| rSPR_worse_3_approx(&F1, &F1_old) > 0) {
-			k = rSPR_branch_and_bound_simple_clustering(T1, gene_trees[i], VERBOSE);
+			k = rSPR_branch_and_bound_simple_clustering(T1, gene_trees[i], VERBOSE)
+					* tree_weight(gene_trees[i]);
 		}
 		else {
 			k = (*original_scores)[i];
@@ -3793,35 +4326,38 @@ int rSPR_total_distance_precomputed(Node *T1, vector<Node *> &gene_trees,
 int rf_total_distance(Node *T1, vector<Node *> &gene_trees) {
 	int total = 0;
 	int end = gene_trees.size();
-	#pragma omp parallel for reduction(+ : total) firstprivate(PREFER_RHO)  // firstprivate(IN_SPLIT_APPROX)
+	ClusterTable T1_table = ClusterTable(T1);
+	#pragma omp parallel for reduction(+ : total)
 	for(int i = 0; i < end; i++) {
-			//		cout << i << endl;
-		int k = rf_distance(T1, gene_trees[i]);
-		total += k;
+		int k = rf_distance(&T1_table, gene_trees[i]);
+		total += k * tree_weight(gene_trees[i]);
 	}
 	return total;
 }
 
+// minimum RF distance of T1 to any rooting of T2
+int rf_distance_unrooted(ClusterTable *T1, Node *T2) {
+	int best_k = INT_MAX;
+	Node T2_copy = Node(*T2);
+	vector<Node *> descendants = T2_copy.find_descendants();
+	for(int j = 0; j < descendants.size(); j++) {
+		T2_copy.reroot(descendants[j]);
+		int k = rf_distance(T1, &T2_copy);
+		if (k < best_k) {
+			best_k = k;
+		}
+	}
+	return best_k;
+}
+
 int rf_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees) {
 	int total = 0;
 	int end = gene_trees.size();
-	#pragma omp parallel for reduction(+ : total) firstprivate(PREFER_RHO)  // firstprivate(IN_SPLIT_APPROX)
+	ClusterTable T1_table = ClusterTable(T1);
+	#pragma omp parallel for reduction(+ : total)
 	for(int i = 0; i < end; i++) {
-		int best_k = INT_MAX;
-		Node T2_copy = Node(*(gene_trees[i]));
-		vector<Node *> descendants = 
-				T2_copy.find_descendants();
-		for(int j = 0; j < descendants.size(); j++) {
-			T2_copy.reroot(descendants[j]);
-			T2_copy.set_depth(0);
-			T2_copy.fix_depths();
-			T2_copy.preorder_number();
-			int k = rf_distance(T1, &T2_copy);
-			if (k < best_k) {
-				best_k = k;
-			}
-		}
-		total += best_k;
+		int best_k = rf_distance_unrooted(&T1_table, gene_trees[i]);
+		total += best_k * tree_weight(gene_trees[i]);
 	}
 	return total;
 }
@@ -3833,20 +4369,29 @@ void rf_pairwise_distance(Node *T1, vector<Node *> &gene_trees) {
 }
 
 void rf_pairwise_distance(Node *T1, vector<Node *> &gene_trees, int start, int end) {
+	print_pairwise_row(rf_pairwise_distance_row(T1, gene_trees, start, end));
+}
+
+vector<int> rf_pairwise_distance_row(Node *T1, vector<Node *> &gene_trees, int start, int end) {
 	MAIN_CALL = false;
-//	T1->preorder_number();
 	vector<int> distances = vector<int>(end-start);
-	#pragma omp parallel for shared(distances) firstprivate(PREFER_RHO)
+	ClusterTable T1_table = ClusterTable(T1);
+	#pragma omp parallel for shared(distances)
 	for(int i = start; i < end; i++) {
-		int k = rf_distance(T1, gene_trees[i]);
-		distances[i-start] = k;
+		distances[i-start] = rf_distance(&T1_table, gene_trees[i]);
 	}
+	return distances;
+}
 
-	cout << distances[0];
-	for(int i = 1; i < end-start; i++) {
-		cout << "," << distances[i];
+// as above for trees that were already converted to cluster tables
+vector<int> rf_pairwise_distance_row(ClusterTable *T1,
+		vector<ClusterTable *> &trees, int start, int end) {
+	vector<int> distances = vector<int>(end-start);
+	#pragma omp parallel for shared(distances)
+	for(int i = start; i < end; i++) {
+		distances[i-start] = rf_distance(T1, trees[i]);
 	}
-	cout << "\n";
+	return distances;
 }
 
 void rf_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees) {
@@ -3854,51 +4399,52 @@ void rf_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees) {
 }
 
 void rf_pairwise_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int start, int end) {
+	print_pairwise_row(rf_pairwise_distance_unrooted_row(T1, gene_trees, start, end));
+}
+
+vector<int> rf_pairwise_distance_unrooted_row(Node *T1, vector<Node *> &gene_trees, int start, int end) {
 	MAIN_CALL = false;
-	T1->preorder_number();
 	vector<int> distances = vector<int>(end-start);
-	#pragma omp parallel for shared(distances) firstprivate(PREFER_RHO)
+	ClusterTable T1_table = ClusterTable(T1);
+	#pragma omp parallel for shared(distances)
 	for(int i = start; i < end; i++) {
-		int best_k = INT_MAX;
-		Node T2_copy = Node(*(gene_trees[i]));
-		vector<Node *> descendants = 
-				T2_copy.find_descendants();
-		for(int j = 0; j < descendants.size(); j++) {
-			T2_copy.reroot(descendants[j]);
-			T2_copy.set_depth(0);
-			T2_copy.fix_depths();
-			T2_copy.preorder_number();
-	//				cout << i << "," << j << endl;
-	//				cout << T1->str_subtree() << endl;
-	//				cout << gene_trees[i]->str_subtree() << endl;
-			int k = rf_distance(T1, &T2_copy);
-			if (k < best_k) {
-				best_k = k;
-			}
-		}
-		distances[i-start] = best_k;
+		distances[i-start] = rf_distance_unrooted(&T1_table, gene_trees[i]);
 	}
-
-	cout << distances[0];
-	for(int i = 1; i < end-start; i++) {
-		cout << "," << distances[i];
-	}
-	cout << "\n";
+	return distances;
 }
 
+/* total distance that stops once it exceeds threshold
+ * The threads share the running total. Once it is larger than threshold
+ * the remaining gene trees are skipped and each branch and bound only
+ * searches up to the part of threshold that is left.
+ * RETURN the total distance if it is at most threshold, otherwise some
+ * value larger than threshold
+ */
 int rSPR_total_distance(Node *T1, vector<Node *> &gene_trees, int threshold) {
 	int total = 0;
 	MAIN_CALL = false;
 	int end = gene_trees.size();
 	T1->preorder_number();
-	#pragma omp parallel for reduction(+ : total) firstprivate(PREFER_RHO)  // firstprivate(IN_SPLIT_APPROX)
+	FlatProjection T1_projection = FlatProjection(T1);
+	TaxonSet T1_taxa = TaxonSet(T1);
+	#pragma omp parallel for schedule(dynamic) firstprivate(PREFER_RHO)  // firstprivate(IN_SPLIT_APPROX)
 	for(int i = 0; i < end; i++) {
-		int k = rSPR_branch_and_bound_simple_clustering(T1, gene_trees[i], VERBOSE);
+		int partial_total;
+		#pragma omp atomic read
+		partial_total = total;
+		if (partial_total > threshold)
+			continue;
+		if (!shares_taxa(&T1_taxa, gene_trees[i], 3))
+			continue;
+		int weight = tree_weight(gene_trees[i]);
+		int max_k = -1;
+		if (threshold < INT_MAX)
+			max_k = (threshold - partial_total) / weight;
+		int k = rSPR_projected_distance(T1, &T1_projection, gene_trees[i],
+				max_k);
 //		k *= mylog2(gene_trees[i]->size());
-		total += k;
-//		if (total > threshold) {
-//			break;
-//		}
+		#pragma omp atomic
+		total += k * weight;
 	}
 	return total;
 }
@@ -3909,22 +4455,25 @@ int rSPR_total_distance(Forest *T1, vector<Node *> &gene_trees){
 	#pragma omp parallel for reduction(+ : total) firstprivate(PREFER_RHO)
 	for(int i = 0; i < gene_trees.size(); i++) {
 		Forest T2 = Forest(gene_trees[i]);
-		total += rSPR_branch_and_bound_simple_clustering(&T2, T1, VERBOSE);
+		total += rSPR_branch_and_bound_simple_clustering(&T2, T1, VERBOSE)
+				* tree_weight(gene_trees[i]);
 	}
 	return total;
 }
 
 int rSPR_total_approx_distance(Forest *T1, vector<Node *> &gene_trees) {
 	int total = 0;
+	FlatForest T1_flat = FlatForest(T1);
 	#pragma omp parallel for reduction(+ : total)
 	for(int i = 0; i < gene_trees.size(); i++) {
-		Forest F1 = Forest(T1);
-		Forest F2 = Forest(gene_trees[i]);
+		FlatForest F1 = T1_flat;
+		FlatForest F2 = FlatForest(gene_trees[i]);
 //		cout << i << endl;
 //		cout << T1->str_subtree() << endl;
 //		cout << gene_trees[i]->str_subtree() << endl;
 		//total += rSPR_worse_3_approx(&F2, &F1)/3;
-		total += rSPR_worse_3_approx(&F2, &F1)/3;
+		total += rSPR_worse_3_approx_distance_only(&F2, &F1)/3
+				* tree_weight(gene_trees[i]);
 	}
 	return total;
 }
@@ -3943,11 +4492,37 @@ int rSPR_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int thres
 	int total = 0;
 	MAIN_CALL = false;
 	T1->preorder_number();
-	#pragma omp parallel for reduction(+ : total) firstprivate(PREFER_RHO) firstprivate(MAX_SPR) firstprivate(MIN_SPR)
+	FlatProjection T1_projection = FlatProjection(T1);
+	bool project = T1_projection.is_exact() && !COUNT_LOSSES;
+	TaxonSet T1_taxa = TaxonSet(T1);
+	#pragma omp parallel for schedule(dynamic) firstprivate(PREFER_RHO) firstprivate(MAX_SPR) firstprivate(MIN_SPR)
 	for(int i = 0; i < gene_trees.size(); i++) {
+		// see rSPR_total_distance(T1, gene_trees, threshold)
+		int partial_total;
+		#pragma omp atomic read
+		partial_total = total;
+		if (partial_total > threshold)
+			continue;
+		if (!shares_taxa(&T1_taxa, gene_trees[i], 4)) {
+			if (original_scores != NULL)
+				(*original_scores)[i] = 0;
+			continue;
+		}
+		int weight = tree_weight(gene_trees[i]);
+		int max_k = -1;
+		if (threshold < INT_MAX)
+			max_k = (threshold - partial_total) / weight;
 //		cout << "T1: " << T1->str_subtree() << endl;
 //		cout << "T2: " << gene_trees[i]->str_subtree() << endl;
-		Forest f1 = Forest(T1);
+		NodeArenaScope arena;
+		// T1 restricted to the leaves of the gene tree
+		Node *T1_restricted = NULL;
+		if (project)
+			T1_restricted = T1_projection.project(gene_trees[i]);
+		Forest f1 = (T1_restricted != NULL) ? Forest(T1_restricted)
+				: Forest(T1);
+		if (T1_restricted != NULL)
+			T1_restricted->delete_tree();
 		//f1.print_components();
 		Forest f2 = Forest(gene_trees[i]);
 		//f2.print_components();
@@ -3990,6 +4565,12 @@ int rSPR_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int thres
 			if (best_min_spr < INT_MAX)
 				min_spr = best_min_spr;
 			for(int k = min_spr; k <= NO_CLUSTER_ROUNDS; k++) {
+				// no rooting is within k-1 so the budget is exceeded
+				if (max_k >= 0 && k > max_k) {
+					best_distance = k;
+					done = true;
+					break;
+				}
 //			for(int k = min_spr; !done; k++) {
 ////				cout << k << endl;
 				MIN_SPR=k;
@@ -4048,7 +4629,7 @@ int rSPR_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int thres
 	//				cout << i << "," << j << endl;
 	//				cout << T1->str_subtree() << endl;
 	//				cout << gene_trees[i]->str_subtree() << endl;
-					int distance = rSPR_branch_and_bound_simple_clustering(f1.get_component(0), f2.get_component(0), VERBOSE);
+					int distance = rSPR_branch_and_bound_simple_clustering(f1.get_component(0), f2.get_component(0), VERBOSE, -1, max_k);
 					if (distance <= best_distance) {
 							best_distance = distance;
 					}
@@ -4057,6 +4638,8 @@ int rSPR_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int thres
 	//		cout << "best_distance: " << best_distance << endl;
 			if (best_distance == INT_MAX)
 				best_distance = 0;
+			best_distance *= weight;
+			#pragma omp atomic
 			total += best_distance;
 			if (original_scores != NULL)
 				(*original_scores)[i] = best_distance;
@@ -4107,9 +4690,11 @@ int rSPR_total_distance_unrooted(Node *T1, vector<Node *> &gene_trees, int thres
 					f2.get_component(0)->preorder_number();
 			int k;
 			if (best_approx > 20)
-				k = rSPR_branch_and_bound_simple_clustering(f1.get_component(0), f2.get_component(0), VERBOSE);
+				k = rSPR_branch_and_bound_simple_clustering(f1.get_component(0), f2.get_component(0), VERBOSE, -1, max_k);
 			else
 					k = rSPR_branch_and_bound_range(&f1, &f2, best_approx/3, best_approx);
+			k *= weight;
+			#pragma omp atomic
 			total += k;
 		if (original_scores != NULL)
 			(*original_scores)[i] = k;
@@ -4125,6 +4710,7 @@ int rSPR_total_approx_distance_unrooted(Node *T1, vector<Node *> &gene_trees) {
 	MAIN_CALL = false;
 	#pragma omp parallel for reduction(+: total)
 	for(int i = 0; i < gene_trees.size(); i++) {
+		NodeArenaScope arena;
 		Forest f1 = Forest(T1);
 		Forest f2 = Forest(gene_trees[i]);
 		if (!sync_twins(&f1, &f2))
@@ -4153,7 +4739,7 @@ int rSPR_total_approx_distance_unrooted(Node *T1, vector<Node *> &gene_trees) {
 		}
 		if (best_distance == INT_MAX)
 			best_distance = 0;
-		total += best_distance;
+		total += best_distance * tree_weight(gene_trees[i]);
 	}
 	return total;
 }
@@ -4166,20 +4752,123 @@ int rSPR_total_approx_distance(Node *T1, vector<Node *> &gene_trees,
 		int threshold) {
 	int total = 0;
 	MAIN_CALL = false;
+	FlatForest T1_flat = FlatForest(T1);
 	#pragma omp parallel for reduction(+ : total)
 	for(int i = 0; i < gene_trees.size(); i++) {
-		Forest F1 = Forest(T1);
-		Forest F2 = Forest(gene_trees[i]);
+		FlatForest F1 = T1_flat;
+		FlatForest F2 = FlatForest(gene_trees[i]);
 //		cout << i << endl;
 //		cout << T1->str_subtree() << endl;
 //		cout << gene_trees[i]->str_subtree() << endl;
-		total += rSPR_worse_3_approx(&F1, &F2)/3;
+		total += rSPR_worse_3_approx_distance_only(&F1, &F2)/3
+				* tree_weight(gene_trees[i]);
 //		if (total > threshold)
 //			break;
 	}
 	return total;
 }
 
+/* lower bound on rSPR_total_distance from the 3-approximation
+ * Like the exact distance, each gene tree is compared to T1 restricted
+ * to its leaves by a FlatProjection, is skipped if it shares fewer than
+ * 3 taxa with T1, and uses the exact distance of the restriction if it
+ * is in DISTANCE_CACHE
+ */
+int rSPR_total_lower_bound(Node *T1, vector<Node *> &gene_trees) {
+	int total = 0;
+	MAIN_CALL = false;
+	FlatProjection T1_projection = FlatProjection(T1);
+	bool project = T1_projection.is_exact() && !COUNT_LOSSES;
+	FlatForest T1_flat = FlatForest();
+	if (!project)
+		T1_flat = FlatForest(T1);
+	TaxonSet T1_taxa = TaxonSet(T1);
+	#pragma omp parallel for reduction(+ : total)
+	for(int i = 0; i < gene_trees.size(); i++) {
+		if (!shares_taxa(&T1_taxa, gene_trees[i], 3))
+			continue;
+		int k;
+		if (project) {
+			NodeArenaScope arena;
+			Node *T1_restricted = T1_projection.project(gene_trees[i]);
+			if (T1_restricted == NULL)
+				continue;
+			RestrictionKey key = RestrictionKey();
+			bool cached = DISTANCE_CACHE.is_cached(gene_trees[i]);
+			if (cached)
+				key = DistanceCache::restriction_key(
+						T1_restricted->canonical_str());
+			if (!cached || !DISTANCE_CACHE.lookup(gene_trees[i], key, &k)) {
+				FlatForest F1 = FlatForest(T1_restricted);
+				FlatForest F2 = FlatForest(gene_trees[i]);
+				k = rSPR_worse_3_approx_distance_only(&F1, &F2)/3;
+			}
+			T1_restricted->delete_tree();
+		}
+		else {
+			FlatForest F1 = T1_flat;
+			FlatForest F2 = FlatForest(gene_trees[i]);
+			k = rSPR_worse_3_approx_distance_only(&F1, &F2)/3;
+		}
+		total += k * tree_weight(gene_trees[i]);
+	}
+	return total;
+}
+
+/* lower bound on rSPR_total_distance_unrooted from the 3-approximation
+ * of each rooting of the gene trees, with the same restriction of T1
+ * and skipping of gene trees as the exact distance
+ */
+int rSPR_total_lower_bound_unrooted(Node *T1, vector<Node *> &gene_trees) {
+	int total = 0;
+	MAIN_CALL = false;
+	T1->preorder_number();
+	FlatProjection T1_projection = FlatProjection(T1);
+	bool project = T1_projection.is_exact() && !COUNT_LOSSES;
+	TaxonSet T1_taxa = TaxonSet(T1);
+	#pragma omp parallel for schedule(dynamic) reduction(+ : total)
+	for(int i = 0; i < gene_trees.size(); i++) {
+		if (!shares_taxa(&T1_taxa, gene_trees[i], 4))
+			continue;
+		NodeArenaScope arena;
+		Node *T1_restricted = NULL;
+		if (project)
+			T1_restricted = T1_projection.project(gene_trees[i]);
+		Forest f1 = (T1_restricted != NULL) ? Forest(T1_restricted)
+				: Forest(T1);
+		if (T1_restricted != NULL)
+			T1_restricted->delete_tree();
+		Forest f2 = Forest(gene_trees[i]);
+		if (!sync_twins(&f1, &f2))
+			continue;
+		if (f2.get_component(0)->get_children().size() > 2) {
+			f2.get_component(0)->fixroot();
+			f2.get_component(0)->set_depth(0);
+			f2.get_component(0)->fix_depths();
+			f2.get_component(0)->preorder_number();
+		}
+		int best_distance = INT_MAX;
+		vector<Node *> descendants =
+			f2.get_component(0)->find_descendants();
+		for(int j = 0; j < descendants.size(); j++) {
+			f2.get_component(0)->reroot(descendants[j]);
+			f2.get_component(0)->set_depth(0);
+			f2.get_component(0)->fix_depths();
+			f2.get_component(0)->preorder_number();
+			int distance = rSPR_worse_3_approx_distance_only(&f1, &f2)/3;
+			if (distance < best_distance)
+				best_distance = distance;
+			// no rooting can do better
+			if (best_distance == 0)
+				break;
+		}
+		if (best_distance == INT_MAX)
+			best_distance = 0;
+		total += best_distance * tree_weight(gene_trees[i]);
+	}
+	return total;
+}
+
 
 string itos(int i) {
 	stringstream ss;
@@ -4667,18 +5356,121 @@ void modify_bipartition_support(Node *n, Forest *F1, Forest *F2,
 	}
 }
 
-int rf_distance(Node *T1, Node *T2) {
+/* count_bipartition_support
+ * Add the bipartition support of T2 for the edges of T1 to support and
+ * normalization, indexed by the preorder numbers of T1, in the same way
+ * as modify_bipartition_support. T1_nodes[i] is the node of T1 with
+ * preorder number i. Instead of searching T2 for each edge, the
+ * clusters of T2 restricted to the shared leaves are hashed as sums of
+ * random 64 bit leaf keys, so an edge of T1 is supported when its
+ * cluster or the complement is in the table. Multifurcating gene trees
+ * also support splits that merge children of a multifurcation, so those
+ * fall back to contains_bipartition when the table has no match.
+ * T2 counts tree_weight(T2) times in both support and normalization, so
+ * merged duplicates give the same normalized support as the copies.
+ */
+void count_bipartition_support(Node *T1, Node *T2, vector<Node *> &T1_nodes,
+		vector<int> &support, vector<int> &normalization,
+		enum RELAXATION relaxed) {
 	Forest F1 = Forest(T1);
 	Forest F2 = Forest(T2);
-	if (!sync_twins(&F1, &F2))
-		return 0;
-	if (F1.get_component(0)->is_leaf())
-		return 0;
-	sync_interior_twins(&F1, &F2);
-	int rf_d = 0;
-	rf_d += count_differing_bipartitions(F1.get_component(0));
-	rf_d += count_differing_bipartitions(F2.get_component(0));
-	return rf_d;
+	if (!sync_twins(&F1, &F2)) {
+		return;
+	}
+	unordered_set<unsigned long long> clusters =
+			unordered_set<unsigned long long>();
+	bool multifurcating = false;
+	find_cluster_fingerprints(F2.get_component(0), clusters, multifurcating);
+	vector<BipartitionFingerprint> bipartitions =
+			vector<BipartitionFingerprint>();
+	BipartitionFingerprint all = find_bipartition_fingerprints(
+			F1.get_component(0), bipartitions);
+	int weight = tree_weight(T2);
+	for(int i = 0; i < bipartitions.size(); i++) {
+		Node *n = bipartitions[i].node;
+		Node *t = T1_nodes[n->get_preorder_number()];
+		if (t->parent() == NULL)
+			continue;
+		int group_1_total = bipartitions[i].num_leaves;
+		int group_2_total = all.num_leaves - group_1_total;
+		if (group_2_total < 2)
+			continue;
+		unsigned long long key = bipartitions[i].key;
+		bool found = clusters.count(key) > 0
+				|| clusters.count(all.key - key) > 0;
+		if (!found && multifurcating)
+			found = contains_bipartition(F2.get_component(0),
+					n->get_edge_pre_start(), n->get_edge_pre_end(),
+					group_1_total, group_2_total, NULL, NULL);
+		normalization[t->get_preorder_number()] += weight;
+		if (found)
+			support[t->get_preorder_number()] += weight;
+		else if ((relaxed == ALL_RELAXED || relaxed == NEGATIVE_RELAXED)
+				&& n->parent() != NULL) {
+			int stop_pre = n->parent()->get_preorder_number();
+			while ((t = t->parent()) != NULL
+					&& t->get_preorder_number() != stop_pre)
+				normalization[t->get_preorder_number()] += weight;
+		}
+	}
+}
+
+// key of a leaf for cluster fingerprints
+unsigned long long leaf_fingerprint(int preorder_number) {
+	unsigned long long x = (preorder_number + 1) * 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/* insert the fingerprint of each cluster of n's subtree into clusters
+ * leaves are keyed by the preorder numbers of their twins
+ * RETURN the fingerprint of n's cluster
+ */
+unsigned long long find_cluster_fingerprints(Node *n,
+		unordered_set<unsigned long long> &clusters, bool &multifurcating) {
+	unsigned long long key = 0;
+	if (n->is_leaf())
+		key = leaf_fingerprint(n->get_twin()->get_preorder_number());
+	else {
+		if (n->get_children().size() > 2)
+			multifurcating = true;
+		list<Node *>::iterator c;
+		for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
+			key += find_cluster_fingerprints(*c, clusters, multifurcating);
+		}
+	}
+	clusters.insert(key);
+	return key;
+}
+
+/* append the fingerprint and number of leaves of each interior node of
+ * n's subtree to bipartitions, children first
+ * RETURN the fingerprint of n's cluster
+ */
+BipartitionFingerprint find_bipartition_fingerprints(Node *n,
+		vector<BipartitionFingerprint> &bipartitions) {
+	BipartitionFingerprint b = BipartitionFingerprint(n);
+	if (n->is_leaf()) {
+		b.key = leaf_fingerprint(n->get_preorder_number());
+		b.num_leaves = 1;
+		return b;
+	}
+	list<Node *>::iterator c;
+	for(c = n->get_children().begin(); c != n->get_children().end(); c++) {
+		BipartitionFingerprint child =
+				find_bipartition_fingerprints(*c, bipartitions);
+		b.key += child.key;
+		b.num_leaves += child.num_leaves;
+	}
+	bipartitions.push_back(b);
+	return b;
+}
+
+int rf_distance(Node *T1, Node *T2) {
+	ClusterTable T1_table = ClusterTable(T1);
+	ClusterTable T2_table = ClusterTable(T2);
+	return rf_distance(&T1_table, &T2_table);
 }
 
 int count_differing_bipartitions(Node *n) {
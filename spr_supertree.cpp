@@ -136,6 +136,18 @@ SEARCH STRATEGY OPTIONS
 
 -rf_ties              Break SPR distance ties with the RF distance
 
+-screen K             Score the SPR moves of each iteration with a lower
+                      bound from the 3-approximation and compute exact
+                      distances only for the K moves with the smallest
+                      bounds
+
+-screen_margin M      Also compute exact distances for the moves with
+                      bounds within M of the smallest bound
+
+-screen_verify        Also compute exact distances for any move whose
+                      bound does not exceed the best exact distance, so
+                      the move chosen is the same as without screening
+
 *******************************************************************************
 LGT ANALYSIS
 *******************************************************************************
@@ -162,7 +174,13 @@ LGT ANALYSIS
 OTHER OPTIONS
 *******************************************************************************
 -time                  Print iteration and total CPU time used at each
-                       iteration
+                       iteration, the hit rate and memory use of the
+                       distance cache, and the number of moves scored
+                       exactly when screening
+
+-distance_cache N      Remember at most N exact distances between gene trees
+                       and the restrictions of the supertree evaluated during
+                       the search (default 4000000). 0 disables the cache
 
 -cc                    Calculate a potentially better approximation with a
                        quadratic time algorithm
@@ -173,6 +191,45 @@ OTHER OPTIONS
 
 -multi_trees           Output the set of multifurcating or invalid trees
 
+-write_corpus FILE     Write the gene trees that remain after filtering to
+                       the binary corpus FILE and exit
+
+-corpus FILE           Read the gene trees from a binary corpus written with
+                       -write_corpus instead of STDIN. The corpus must have
+                       been written by spr_supertree with the same tree
+                       filtering and rooting options
+
+-dedup                 Keep one copy of gene trees with the same topology,
+                       counted once per copy. Distances and LGT counts are
+                       unchanged. Ignored with options that report on each
+                       gene tree separately or reroot the gene trees
+
+-taboo_hash_only       With -taboo_search, keep only a hash of each visited
+                       supertree. Uses less memory but a hash collision can
+                       skip a supertree that was not visited
+
+-checkpoint FILE       Save the state of the search to FILE before each
+                       iteration of the global rearrangement search
+
+-resume FILE           Continue the search saved in the checkpoint FILE.
+                       Use the same gene trees and options as the run that
+                       wrote it. Checkpoints are then saved to FILE unless
+                       -checkpoint is given
+
+-workers HOST:PORT,... Score candidate supertrees with worker processes,
+                       each holding a share of the gene trees. The workers
+                       must be started first, with the same comparison
+                       options. If a worker's options differ, the run
+                       scores locally
+
+-worker PORT           Run as a worker: wait for a run given -workers to
+                       connect on TCP PORT and score its candidate
+                       supertrees. The gene trees are sent by that run.
+                       Only connections from this machine are accepted.
+                       With PORT 0 a free port is chosen and printed
+
+-worker_listen_all     Accept a -worker connection from any address
+
 *******************************************************************************/
 
 #include <cstdio>
@@ -192,6 +249,10 @@ OTHER OPTIONS
 #include <time.h>
 #include <boost/algorithm/string.hpp>
 #include "rspr.h"
+#include "TreeCorpus.h"
+#include "Checkpoint.h"
+#include "TabooList.h"
+#include "WorkerPool.h"
 
 #include "Forest.h"
 #include "ClusterForest.h"
@@ -230,6 +291,10 @@ bool RANDOM_INSERT_ORDER = false;
 bool APPROX = false;
 bool TIMING = false;
 int NUM_ITERATIONS = 25;
+int DISTANCE_CACHE_SIZE = 4000000;
+int SCREEN_TOP_K = 0;
+int SCREEN_MARGIN = -1;
+bool SCREEN_VERIFY = false;
 bool SMALL_TREES = false;
 bool CONVERT_LIST = false;
 bool INVALID_TREES = false;
@@ -267,6 +332,14 @@ bool RANDOM_TREE = false;
 bool GREEDY = false;
 bool GREEDY_REFINED = false;
 
+// result of reading one gene tree line
+#define GENE_TREE_VALID 0
+#define GENE_TREE_NO_BRACKET 1
+#define GENE_TREE_INVALID 2
+#define GENE_TREE_SMALL 3
+#define GENE_TREE_STAR 4
+#define GENE_TREE_NO_OUTGROUP 5
+
 string USAGE =
 "spr_supertrees, version 1.2.1\n"
 "\n"
@@ -400,6 +473,18 @@ string USAGE =
 "\n"
 "-rf_ties              Break SPR distance ties with the RF distance\n"
 "\n"
+"-screen K             Score the SPR moves of each iteration with a lower\n"
+"                      bound from the 3-approximation and compute exact\n"
+"                      distances only for the K moves with the smallest\n"
+"                      bounds\n"
+"\n"
+"-screen_margin M      Also compute exact distances for the moves with\n"
+"                      bounds within M of the smallest bound\n"
+"\n"
+"-screen_verify        Also compute exact distances for any move whose\n"
+"                      bound does not exceed the best exact distance, so\n"
+"                      the move chosen is the same as without screening\n"
+"\n"
 "*******************************************************************************\n"
 "LGT ANALYSIS\n"
 "*******************************************************************************\n"
@@ -420,7 +505,13 @@ string USAGE =
 "OTHER OPTIONS\n"
 "*******************************************************************************\n"
 "-time                  Print iteration and total CPU time used at each\n"
-"                       iteration\n"
+"                       iteration, the hit rate and memory use of the\n"
+"                       distance cache, and the number of moves scored\n"
+"                       exactly when screening\n"
+"\n"
+"-distance_cache N      Remember at most N exact distances between gene trees\n"
+"                       and the restrictions of the supertree evaluated during\n"
+"                       the search (default 4000000). 0 disables the cache\n"
 "\n"
 "-cc                    Calculate a potentially better approximation with a\n"
 "                       quadratic time algorithm\n"
@@ -429,22 +520,114 @@ string USAGE =
 "-valid_trees_rooted    Output the set of trees that appear valid after applying\n"
 "                       any rooting options.\n"
 "\n"
-"-multi_trees           Output the set of multifurcating or invalid trees\n";
+"-multi_trees           Output the set of multifurcating or invalid trees\n"
+"\n"
+"-write_corpus FILE     Write the gene trees that remain after filtering to\n"
+"                       the binary corpus FILE and exit\n"
+"\n"
+"-corpus FILE           Read the gene trees from a binary corpus written with\n"
+"                       -write_corpus instead of STDIN. The corpus must have\n"
+"                       been written by spr_supertree with the same tree\n"
+"                       filtering and rooting options\n"
+"\n"
+"-dedup                 Keep one copy of gene trees with the same topology,\n"
+"                       counted once per copy. Distances and LGT counts are\n"
+"                       unchanged. Ignored with options that report on each\n"
+"                       gene tree separately or reroot the gene trees\n"
+"\n"
+"-taboo_hash_only       With -taboo_search, keep only a hash of each visited\n"
+"                       supertree. Uses less memory but a hash collision can\n"
+"                       skip a supertree that was not visited\n"
+"\n"
+"-checkpoint FILE       Save the state of the search to FILE before each\n"
+"                       iteration of the global rearrangement search\n"
+"\n"
+"-resume FILE           Continue the search saved in the checkpoint FILE.\n"
+"                       Use the same gene trees and options as the run that\n"
+"                       wrote it. Checkpoints are then saved to FILE unless\n"
+"                       -checkpoint is given\n"
+"\n"
+"-workers HOST:PORT,... Score candidate supertrees with worker processes,\n"
+"                       each holding a share of the gene trees. The workers\n"
+"                       must be started first, with the same comparison\n"
+"                       options. If a worker's options differ, the run\n"
+"                       scores locally\n"
+"\n"
+"-worker PORT           Run as a worker: wait for a run given -workers to\n"
+"                       connect on TCP PORT and score its candidate\n"
+"                       supertrees. The gene trees are sent by that run.\n"
+"                       Only connections from this machine are accepted.\n"
+"                       With PORT 0 a free port is chosen and printed\n"
+"\n"
+"-worker_listen_all     Accept a -worker connection from any address\n";
+
+/* candidate spr moves of the supertree
+ * Each move is scored against a set of gene trees plus an offset that
+ * stands for the gene trees left out of the set.
+ */
+class SprMoveScreen {
+	public:
+	vector<pair<Node *, Node *> > moves;
+	vector<int> gene_tree_set;
+	vector<int> offsets;
+	vector<vector<Node *> > gene_tree_sets;
+	// break ties with RF_TIES and skip moves to TABOO_SEARCH trees
+	bool tie_rules;
+	// the gene trees of the last move, copied to gene_tree_sets.back()
+	vector<Node *> *last_gene_trees;
+
+	SprMoveScreen() {
+		tie_rules = false;
+		last_gene_trees = NULL;
+	}
+
+	/* moves from one source share their gene trees, so a new set is
+	 * only copied when add_move is given a different vector. Call
+	 * new_gene_tree_set before reusing a vector for other gene trees
+	 */
+	void add_move(Node *n, Node *new_sibling, vector<Node *> &gene_trees,
+			int offset) {
+		if (&gene_trees != last_gene_trees) {
+			gene_tree_sets.push_back(gene_trees);
+			last_gene_trees = &gene_trees;
+		}
+		moves.push_back(make_pair(n, new_sibling));
+		gene_tree_set.push_back(gene_tree_sets.size() - 1);
+		offsets.push_back(offset);
+	}
+
+	void new_gene_tree_set() {
+		last_gene_trees = NULL;
+	}
+
+	int size() {
+		return moves.size();
+	}
+};
+
+// the find_best_spr helpers collect their moves here to be scored later,
+// it must be set while they run
+SprMoveScreen *MOVE_SCREEN = NULL;
+long long SCREEN_MOVES = 0;
+long long SCREEN_EXACT_MOVES = 0;
+
+// workers that score candidate supertrees, see WorkerPool.h
+WorkerPool *WORKER_POOL = NULL;
+// accept a coordinator from any address, not only this machine
+bool WORKER_LISTEN_ALL = false;
 
 Node *find_best_sibling(Node *super_tree, vector<Node *> &gene_trees,
 		int label);
 Node *find_best_sibling(Node *super_tree, vector<Node *> &gene_trees,
 		vector<Node *> *best_siblings, int label);
-void find_best_sibling_helper(Node *n, Node *new_leaf, Node *super_tree,
-		vector<Node *> &gene_trees, int &min_distance, int &min_tie_distance,
-		int &num_ties, Node **best_sibling);
 vector<Node *> *find_best_siblings(Node *super_tree, vector<Node *> &gene_trees, int label, int num_siblings);
 void find_best_siblings_helper(Node *n, Node *new_leaf, Node *super_tree,
 		vector<Node *> &gene_trees, int &min_distance, int &min_tie_distance,
 		int &num_ties, multimap<int, Node*> *best_siblings, int num_siblings);
-void test_sibling_helper(Node *n, Node *new_leaf, Node *super_tree,
-		vector<Node *> &gene_trees, int &min_distance, int &min_tie_distance,
-		int &num_ties, Node **best_sibling);
+Node *best_insertion(Node *super_tree, vector<Node *> &gene_trees,
+		vector<Node *> &candidates, int label);
+Node *insert_leaf(Node *n, Node *new_leaf, int &status);
+void remove_leaf(Node *n, Node *new_leaf, Node *new_node, int status);
 void find_best_spr(Node *super_tree, vector<Node *> &gene_trees,
 		Node *&best_spr_move, Node *&best_sibling);
 void find_best_spr_helper(Node *n, Node *super_tree,
@@ -453,6 +636,23 @@ void find_best_spr_helper(Node *n, Node *super_tree,
 void find_best_spr_helper(Node *n, Node *new_sibling, Node *super_tree,
 		vector<Node *> &gene_trees, Node *&best_spr_move,
 		Node *&best_sibling, int &min_distance, int &num_ties);
+int supertree_distance(Node *super_tree, vector<Node *> &gene_trees,
+		int min_distance);
+int supertree_lower_bound(Node *super_tree, vector<Node *> &gene_trees);
+void find_spr_move_nodes(Node *n, vector<Node *> &nodes);
+void score_spr_moves(Node *super_tree, SprMoveScreen &screen,
+		vector<int> &selected, vector<int> &scores, bool exact,
+		int min_distance);
+bool screen_best_spr(Node *super_tree, SprMoveScreen &screen,
+		Node *&best_spr_move, Node *&best_sibling);
+void find_approx_moves(Node *super_tree, SprMoveScreen &screen,
+		vector<pair <pair<Node*,Node*>, int> > &approx_moves);
+bool screening();
+bool score_spr_moves_remote(Node *super_tree, SprMoveScreen &screen,
+		vector<int> &selected, vector<int> &scores, int min_distance);
+bool distribute_gene_trees(vector<Node *> &gene_trees);
+int run_worker(int port);
+unsigned int tie_key(unsigned int seed, unsigned int move);
 void get_support(Node *super_tree, vector<Node *> *gene_trees);
 void get_support(Node *n, Node *super_tree, vector<Node *> *gene_trees);
 void get_transfer_support(Node *super_tree, vector<Node *> *gene_trees);
@@ -513,7 +713,12 @@ vector<pair<Node *, int> > get_best_scores(vector<pair<Node *, int> > &scores);
 void find_best_spr_r_helper(Node *n, Node *new_sibling, Node *super_tree,
 		vector<Node *> &gene_trees, Node *&best_spr_move,
 		Node *&best_sibling, int &min_distance, int &num_ties, int r, int origin, vector<pair <pair<Node*,Node*>, int> > &approx_moves);
-bool is_taboo(list<Node> taboo_trees, Node *super_tree);
+bool is_taboo(TabooList &taboo_trees, Node *super_tree);
+Node *checkpoint_tree(string s);
+vector<int> root_side(Node *T);
+void restore_root(Node *T, vector<int> &side);
+int restore_root_hlpr(Node *n, vector<bool> &in_side, int side_size,
+		int num_leaves, int &num_in_side, Node *&new_lc);
 
 	map<string, int> label_map;
 	map<int, string> reverse_label_map;
@@ -524,7 +729,7 @@ bool is_pow_2(int n) {
 
 bool BIPARTITION_CLUSTER = false;
 
-list<Node> taboo_trees = list<Node>();
+TabooList taboo_trees = TabooList();
 
 int main(int argc, char *argv[]) {
 
@@ -536,6 +741,13 @@ int main(int argc, char *argv[]) {
 	string INITIAL_SUPER_TREE = "";
 	string LGT_GROUPS = "";
 	string GENES_ATTRIBUTES = "";
+	string CORPUS = "";
+	string WRITE_CORPUS = "";
+	string CHECKPOINT = "";
+	string RESUME = "";
+	string WORKERS = "";
+	int WORKER_PORT = -1;
+	bool DEDUP = false;
 	bool INITIAL_SUPER_TREE_UNROOTED = false;
 	bool FIND_SUPPORT = false;
 	bool FIND_BIPARTITION_SUPPORT = false;
@@ -797,6 +1009,33 @@ int main(int argc, char *argv[]) {
 		else if (strcmp(arg, "-time") == 0) {
 			TIMING= true;
 		}
+		else if (strcmp(arg, "-distance_cache") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					DISTANCE_CACHE_SIZE = atoi(arg2);
+				cout << "DISTANCE_CACHE_SIZE=" << DISTANCE_CACHE_SIZE << endl;
+			}
+		}
+		else if (strcmp(arg, "-screen") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					SCREEN_TOP_K = atoi(arg2);
+				cout << "SCREEN_TOP_K=" << SCREEN_TOP_K << endl;
+			}
+		}
+		else if (strcmp(arg, "-screen_margin") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					SCREEN_MARGIN = atoi(arg2);
+				cout << "SCREEN_MARGIN=" << SCREEN_MARGIN << endl;
+			}
+		}
+		else if (strcmp(arg, "-screen_verify") == 0) {
+			SCREEN_VERIFY = true;
+		}
 		else if (strcmp(arg, "-clamp") == 0) {
 			CLAMP= true;
 		}
@@ -937,6 +1176,66 @@ int main(int argc, char *argv[]) {
 						<< endl;
 			}
 		}
+		else if (strcmp(arg, "-corpus") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					CORPUS = string(arg2);
+				cout << "CORPUS=" << CORPUS
+						<< endl;
+			}
+		}
+		else if (strcmp(arg, "-write_corpus") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					WRITE_CORPUS = string(arg2);
+				cout << "WRITE_CORPUS=" << WRITE_CORPUS
+						<< endl;
+			}
+		}
+		else if (strcmp(arg, "-dedup") == 0) {
+			DEDUP = true;
+		}
+		else if (strcmp(arg, "-checkpoint") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					CHECKPOINT = string(arg2);
+				cout << "CHECKPOINT=" << CHECKPOINT
+						<< endl;
+			}
+		}
+		else if (strcmp(arg, "-resume") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					RESUME = string(arg2);
+				cout << "RESUME=" << RESUME
+						<< endl;
+			}
+		}
+		else if (strcmp(arg, "-workers") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					WORKERS = string(arg2);
+				cout << "WORKERS=" << WORKERS
+						<< endl;
+			}
+		}
+		else if (strcmp(arg, "-worker") == 0) {
+			if (max_args > argc) {
+				char *arg2 = argv[argc+1];
+				if (arg2[0] != '-')
+					WORKER_PORT = atoi(arg2);
+				cout << "WORKER_PORT=" << WORKER_PORT
+						<< endl;
+			}
+		}
+		else if (strcmp(arg, "-worker_listen_all") == 0) {
+			WORKER_LISTEN_ALL = true;
+		}
 		else if (strcmp(arg, "-initial_tree_unrooted") == 0) {
 			if (max_args > argc) {
 				char *arg2 = argv[argc+1];
@@ -983,6 +1282,9 @@ int main(int argc, char *argv[]) {
 		else if (strcmp(arg, "-taboo_search") == 0) {
 			TABOO_SEARCH = true;
 		}
+		else if (strcmp(arg, "-taboo_hash_only") == 0) {
+			taboo_trees.set_hash_only(true);
+		}
 		else if (strcmp(arg, "-one_tree_at_a_time") == 0
 				|| (strcmp(arg, "-one_tree") == 0) ) {
 			ONE_TREE_AT_A_TIME = true;
@@ -1059,6 +1361,9 @@ int main(int argc, char *argv[]) {
 		PREFER_RHO = true;
 	}
 
+	if (WORKER_PORT >= 0)
+		return run_worker(WORKER_PORT);
+
 
 
 	// initialize random number generator
@@ -1069,7 +1374,6 @@ int main(int argc, char *argv[]) {
 	label_map= map<string, int>();
 	reverse_label_map = map<int, string>();
 
-	string T_line = "";
 	vector<Node *> gene_trees = vector<Node *>();
 //	multimap<int, pair<Node*, string> > gene_tree_map
 //		= multimap<int, pair<Node*, string> >();
@@ -1123,118 +1427,164 @@ int main(int argc, char *argv[]) {
 	int skipped_no_bracket = 0;
 	int skipped_star = 0;
 	int skipped_no_outgroup = 0;
-	while (getline(cin, T_line)) {
-		string name = "";
-		size_t loc = T_line.find_first_of("(");
-		if (loc != string::npos) {
-			if (loc != 0) {
-				name = T_line.substr(0,loc);
-				T_line.erase(0,loc);
-			}
-			// TODO: should we be doing this with OUTGROUP?
-			if ((UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT)
-					&& IGNORE_MULTI) {
-				T_line = root(T_line);
-			}
-			Node *T;
-			if (INCLUDE_ONLY != "")
-				T = build_tree(T_line, &include_only);
-			else
-				T = build_tree(T_line);
-			if (UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT) {
-				T->fixroot();
-			}
-//			cout << T->str_subtree() << endl;
-			// TODO: check that this works
-			/*
-			if ((UNROOTED || SIMPLE_UNROOTED) &&
-					T->get_children().size() > 2) {
-//					cout << T->str_subtree() << endl;
-					Node *new_root = T->get_children().back();
-					new_root->cut_parent();
-					if (new_root->is_leaf()) {
-						Node *real_root = new Node();
-						real_root->add_child(new_root);
-						new_root = real_root;
-					}
-
-					while(new_root->get_children().size() > 1) {
-						Node *new_child = new_root->get_children().back();
-						new_child->cut_parent();
-						T->add_child(new_child);
-					}
-					new_root->add_child(T);
-					T = new_root;
-//					cout << T->str_subtree() << endl;
-//					cout << endl;
-			}
-			*/
-
-			if (T->is_leaf() && T->str() == "p") {
-				if (MULTI_TREES)
-					cout << name << T_line << endl;
-
-				skipped_multifurcating++;
-				continue;
-			}
-			int T_size = T->size();
-			if (!INVALID_TREES && ((T_size <= 4)
-					|| T_size == 5 && !SMALL_TREES)) {
-				skipped_small++;
-				continue;
-			}
-			if (!IGNORE_MULTI && !INVALID_TREES) {
-				int T_depth = T->max_depth();
-				if (T_depth <= 1 ||
-						((UNROOTED || SIMPLE_UNROOTED) && T_depth <= 2)) {
-					skipped_star++;
+	// options that determine which trees a corpus holds
+	uint32_t corpus_flags = CORPUS_FILTERED;
+	if (IGNORE_MULTI)
+		corpus_flags |= CORPUS_IGNORE_MULTI;
+	if (SMALL_TREES)
+		corpus_flags |= CORPUS_SMALL_TREES;
+	if (UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT)
+		corpus_flags |= CORPUS_REROOTED;
+	if (INCLUDE_ONLY != "")
+		corpus_flags |= CORPUS_INCLUDE_ONLY;
+	if (OUTGROUP != "")
+		corpus_flags |= CORPUS_OUTGROUP;
+	bool read_corpus = false;
+	if (CORPUS != "") {
+		uint32_t flags;
+		double support;
+		if (!read_tree_corpus(CORPUS, &gene_trees, &gene_tree_names,
+				&label_map, &reverse_label_map, &flags, &support)) {
+			cout << "The parameter -corpus was set but the file could not be read. Please check: " << CORPUS << endl;
+			return -1;
+		}
+		// the filters below only run on STDIN, so a corpus written with
+		// other options would hold a different set of gene trees
+		if (flags != corpus_flags || support != REQUIRED_SUPPORT) {
+			cout << "The corpus " << CORPUS << " was written with different tree filtering or rooting options. Please write it again with -write_corpus and the current options" << endl;
+			return -1;
+		}
+		if (UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT) {
+			for(int i = 0; i < gene_trees.size(); i++)
+				gene_trees[i]->preorder_number();
+		}
+		cout << "read " << gene_trees.size() << " trees from corpus" << endl;
+		read_corpus = true;
+	}
+	else {
+		InputBuffer input(fileno(stdin), cin);
+		vector<pair<const char *, const char *> > lines;
+		vector<Node *> batch_trees;
+		vector<int> batch_status;
+		set<string, StringCompare> *include = NULL;
+		if (INCLUDE_ONLY != "")
+			include = &include_only;
+		// build and filter each batch of trees in parallel, then merge them
+		// in input order so the output matches a sequential read
+		while (input.next_lines(lines, INPUT_BATCH_LINES)) {
+			int end = lines.size();
+			batch_trees.assign(end, NULL);
+			batch_status.assign(end, GENE_TREE_VALID);
+			#pragma omp parallel for schedule(dynamic, 64)
+			for(int i = 0; i < end; i++) {
+				const char *line_start = lines[i].first;
+				const char *line_end = lines[i].second;
+				const char *loc = (const char *)memchr(line_start, '(',
+						line_end - line_start);
+				if (loc == NULL) {
+					batch_status[i] = GENE_TREE_NO_BRACKET;
 					continue;
-				//cout << T->str_subtree() << endl;
-				//cout << T_depth << endl;
 				}
-			}
-			if (UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT)
-				T->preorder_number();
+				Node *T;
+				// TODO: should we be doing this with OUTGROUP?
+				if ((UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT)
+						&& IGNORE_MULTI)
+					T = build_tree(root(string(loc, line_end - loc)), include);
+				else
+					T = build_tree(loc, line_end - loc, 0, include);
+				if (UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT) {
+					T->fixroot();
+				}
+				batch_trees[i] = T;
 
-			if (OUTGROUP != "") {
-				// TODO: write a function that will root the tree based on the
-				// outgroup
-				// TODO: do we simply skip the tree if the outgroup is seperate?
-				set<string>::iterator i;
-				if (!outgroup_root(T, outgroup)) {
-					skipped_no_outgroup++;
+				if (T->is_leaf() && T->is_rho()) {
+					batch_status[i] = GENE_TREE_INVALID;
 					continue;
 				}
-				else {
-					T->preorder_number();
+				int T_size = T->size();
+				if (!INVALID_TREES && ((T_size <= 4)
+						|| T_size == 5 && !SMALL_TREES)) {
+					batch_status[i] = GENE_TREE_SMALL;
+					continue;
+				}
+				if (!IGNORE_MULTI && !INVALID_TREES) {
+					int T_depth = T->max_depth();
+					if (T_depth <= 1 ||
+							((UNROOTED || SIMPLE_UNROOTED) && T_depth <= 2)) {
+						batch_status[i] = GENE_TREE_STAR;
+						continue;
+					}
 				}
+				if (UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT)
+					T->preorder_number();
 
-				
+				if (OUTGROUP != "") {
+					// TODO: write a function that will root the tree based on the
+					// outgroup
+					// TODO: do we simply skip the tree if the outgroup is seperate?
+					if (!outgroup_root(T, outgroup)) {
+						batch_status[i] = GENE_TREE_NO_OUTGROUP;
+						continue;
+					}
+					else {
+						T->preorder_number();
+					}
+				}
+			}
+			for(int i = 0; i < end; i++) {
+				const char *line_start = lines[i].first;
+				const char *line_end = lines[i].second;
+				const char *loc = (const char *)memchr(line_start, '(',
+						line_end - line_start);
+				switch (batch_status[i]) {
+					case GENE_TREE_NO_BRACKET:
+						skipped_no_bracket++;
+						break;
+					case GENE_TREE_INVALID:
+						if (MULTI_TREES) {
+							cout << string(line_start, loc - line_start);
+							if ((UNROOTED || SIMPLE_UNROOTED || OUTGROUP_ROOT)
+									&& IGNORE_MULTI)
+								cout << root(string(loc, line_end - loc)) << endl;
+							else
+								cout << string(loc, line_end - loc) << endl;
+						}
+						skipped_multifurcating++;
+						break;
+					case GENE_TREE_SMALL:
+						skipped_small++;
+						break;
+					case GENE_TREE_STAR:
+						skipped_star++;
+						break;
+					case GENE_TREE_NO_OUTGROUP:
+						skipped_no_outgroup++;
+						break;
+					default:
+						gene_tree_names.push_back(
+								string(line_start, loc - line_start));
+						gene_trees.push_back(batch_trees[i]);
+						//gene_tree_map.insert(make_pair(T->size(), make_pair(T, name)));
+				}
 			}
-
-			gene_tree_names.push_back(name);
-			gene_trees.push_back(T);
-			//gene_tree_map.insert(make_pair(T->size(), make_pair(T, name)));
 		}
-		else
-			skipped_no_bracket++;
-	}
 
-	cout << "skipped " << skipped_no_bracket << " lines with no opening bracket " << endl;
-	if (IGNORE_MULTI)
-		cout << "skipped " << skipped_multifurcating << " multifurcating or invalid trees" << endl;
-	else
-	cout << "skipped " << skipped_multifurcating << " invalid trees" << endl;
-	if (SMALL_TREES) {
-		cout << "skipped " << skipped_small << " trees with less than 3 leaves" << endl;
-	}
-	else {
-		cout << "skipped " << skipped_small << " trees with less than 4 leaves" << endl;
-		if (!IGNORE_MULTI)
-		cout << "skipped " << skipped_star << " star trees" << endl;
+		cout << "skipped " << skipped_no_bracket << " lines with no opening bracket " << endl;
+		if (IGNORE_MULTI)
+			cout << "skipped " << skipped_multifurcating << " multifurcating or invalid trees" << endl;
+		else
+		cout << "skipped " << skipped_multifurcating << " invalid trees" << endl;
+		if (SMALL_TREES) {
+			cout << "skipped " << skipped_small << " trees with less than 3 leaves" << endl;
+		}
+		else {
+			cout << "skipped " << skipped_small << " trees with less than 4 leaves" << endl;
+			if (!IGNORE_MULTI)
+			cout << "skipped " << skipped_star << " star trees" << endl;
+		}
+		if (OUTGROUP_ROOT)
+			cout << "skipped " << skipped_no_outgroup << " trees with no outgroup or an unresolved outgroup" << endl;
 	}
-	if (OUTGROUP_ROOT)
-		cout << "skipped " << skipped_no_outgroup << " trees with no outgroup or an unresolved outgroup" << endl;
 
 /*	int end = gene_tree_map.size();
 	for(int i = 0; i < end; i++) {
@@ -1255,20 +1605,65 @@ int main(int argc, char *argv[]) {
 	for(int i = 0; i < gene_trees.size(); i++) {
 		if (VALID_TREES) {
 			cout << gene_tree_names[i];
-			cout << gene_trees[i]->str_subtree() << endl;
+			if (read_corpus)
+				cout << gene_trees[i]->str_subtree(&reverse_label_map) << endl;
+			else
+				cout << gene_trees[i]->str_subtree() << endl;
 		}
 		if (FIND_MAX_DEGREE) {
 			cout << gene_tree_names[i];
 			cout << gene_trees[i]->max_degree() << endl;
 		}
 
-		gene_trees[i]->labels_to_numbers(&label_map, &reverse_label_map);
+		if (!read_corpus)
+			gene_trees[i]->labels_to_numbers(&label_map, &reverse_label_map);
 //		cout << gene_tree_names[i] << gene_trees[i]->str_subtree() << endl;
 
 		gene_trees[i]->count_numbered_labels(&label_counts);
 	}
 	if (VALID_TREES || MULTI_TREES)
 		exit(0);
+	if (WRITE_CORPUS != "") {
+		if (!write_tree_corpus(WRITE_CORPUS, gene_trees, gene_tree_names,
+				&reverse_label_map, corpus_flags, REQUIRED_SUPPORT)) {
+			cout << "could not write corpus " << WRITE_CORPUS << endl;
+			return -1;
+		}
+		cout << "wrote " << gene_trees.size() << " trees to corpus "
+				<< WRITE_CORPUS << endl;
+		exit(0);
+	}
+	if (DEDUP) {
+		if (NODE_GLOM_CONSTRUCTION || ONE_TREE_AT_A_TIME || SIMPLE_UNROOTED
+				|| FIND_SUPPORT || FIND_CLADE_TRANSFERS || VALID_TREES_ROOTED
+				|| LGT_VISUALIZATION || LGT_EVALUATION)
+			cout << "-dedup is not supported with these options, ignoring"
+					<< endl;
+		else {
+			// rooted topologies even with -unrooted, as some searches and
+			// tie breaks use the rooted distances. The approximation and
+			// the MAF picked for LGT analysis can depend on the child
+			// order, so these only merge trees that print the same
+			bool ordered = APPROX || APPROX_ROOTING || UNROOTED_MIN_APPROX
+					|| GREEDY || GREEDY_REFINED || LGT_ANALYSIS;
+			int removed = dedup_trees(&gene_trees, &gene_tree_names, NULL,
+					false, ordered);
+			cout << "merged " << removed << " duplicate gene trees, "
+					<< gene_trees.size() << " unique" << endl;
+		}
+	}
+	DISTANCE_CACHE.set_max_entries(DISTANCE_CACHE_SIZE);
+	DISTANCE_CACHE.add_trees(gene_trees);
+	GENE_TREE_LCAS.add_trees(gene_trees);
+	GENE_TREE_TAXA.add_trees(gene_trees);
+	if (WORKERS != "") {
+		WORKER_POOL = new WorkerPool();
+		string failed = "";
+		if (!WORKER_POOL->connect_workers(WORKERS, failed)) {
+			cout << "The parameter -workers was set but a worker could not be reached. Please check: " << failed << endl;
+			return -1;
+		}
+	}
 
 
 	// iterate over the taxa by number of occurences
@@ -1301,7 +1696,20 @@ int main(int argc, char *argv[]) {
 	if (TIMING)
 		time = clock()/(double)CLOCKS_PER_SEC;
 
-	if (NODE_GLOM_CONSTRUCTION) {
+	SearchCheckpoint checkpoint = SearchCheckpoint();
+	// labels of the gene trees, before the supertree adds its own
+	int num_gene_tree_labels = reverse_label_map.size();
+	if (RESUME != "") {
+		if (!read_checkpoint(RESUME, &checkpoint, &taboo_trees,
+				&DISTANCE_CACHE, gene_trees, num_gene_tree_labels)) {
+			cout << "The parameter -resume was set but the checkpoint could not be read or was written for different gene trees. Please check: " << RESUME << endl;
+			return -1;
+		}
+		if (CHECKPOINT == "")
+			CHECKPOINT = RESUME;
+		super_tree = checkpoint_tree(checkpoint.super_tree);
+	}
+	else if (NODE_GLOM_CONSTRUCTION) {
 
 		// copy the gene trees
 		vector<Node *> gene_trees_copy = vector<Node *>(gene_trees.size());
@@ -1313,7 +1721,8 @@ int main(int argc, char *argv[]) {
 		// vector of partially joined trees
 		vector<Node *> super_forest = vector<Node *>(label_counts.size());
 		for (int i = 0; i < label_counts.size(); i++) {
-			super_forest[i] = new Node(itos(i));
+			super_forest[i] = new Node();
+			super_forest[i]->set_label(i);
 		}
 
 		// partition neighbour counts as a sparse matrix (vector of maps)
@@ -1402,9 +1811,7 @@ int main(int argc, char *argv[]) {
 					cout << "*";
 				}
 				else {
-					super_forest[j]->numbers_to_labels(&reverse_label_map);
-					cout << super_forest[j]->str_subtree();
-					super_forest[j]->labels_to_numbers(&label_map, &reverse_label_map);
+					cout << super_forest[j]->str_subtree(&reverse_label_map);
 				}
 				cout << "   ";
 			}
@@ -1696,9 +2103,10 @@ TODO:
 								acc = find_best_root_acc(super_tree, current_gene_trees[i]);
 			//					cout <<  j << "\t" << i << "\t" << acc << endl;
 								if (acc > -1) {
-									root_avg_acc += acc;
+									int weight = tree_weight(current_gene_trees[i]);
+									root_avg_acc += acc * weight;
 									//root_avg_acc += (acc - root_avg_acc) / count;
-									count++;
+									count += weight;
 								}
 							}
 							if (count > 0)
@@ -1746,9 +2154,11 @@ TODO:
 						new_root = find_best_root(super_tree, current_gene_trees[i]);
 					if (new_root != NULL) {
 						current_gene_trees[i]->reroot(new_root);
+						DISTANCE_CACHE.clear(current_gene_trees[i]);
 						current_gene_trees[i]->set_depth(0);
 						current_gene_trees[i]->fix_depths();
 						current_gene_trees[i]->preorder_number();
+						GENE_TREE_LCAS.update(current_gene_trees[i]);
 					}
 				}
 			}
@@ -1772,20 +2182,36 @@ TODO:
 			Node *node = best_sibling->expand_parent_edge(best_sibling);
 	
 			node->add_child(new Node(itos(label->second)));
-			super_tree->numbers_to_labels(&reverse_label_map);
-			cout << super_tree->str_subtree() << endl;
-			super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+			cout << super_tree->str_subtree(&reverse_label_map) << endl;
 		}
 
 	}
 
 	cout << endl;
-	super_tree->numbers_to_labels(&reverse_label_map);
-	cout << "Initial Supertree: " <<  super_tree->str_subtree() << endl;
-	super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+	cout << "Initial Supertree: " <<  super_tree->str_subtree(&reverse_label_map) << endl;
 	Node *best_supertree = new Node(*super_tree);
 
-	if (!LGT_ANALYSIS && !LGT_EVALUATION) {
+	// continue from the state of the checkpoint instead of rooting
+	// and scoring the initial supertree
+	if (RESUME != "") {
+		if (UNROOTED_MIN_APPROX)
+			APPROX_ROOTING=true;
+		best_supertree->delete_tree();
+		best_supertree = checkpoint_tree(checkpoint.best_supertree);
+		for(int i = 0; i < checkpoint.gene_tree_roots.size(); i++) {
+			restore_root(gene_trees[i], checkpoint.gene_tree_roots[i]);
+			GENE_TREE_LCAS.update(gene_trees[i]);
+		}
+		best_distance = checkpoint.best_distance;
+		best_tie_distance = checkpoint.best_tie_distance;
+		best_rooted_distance = checkpoint.best_rooted_distance;
+		R_DISTANCE = checkpoint.r_distance;
+		SIMPLE_UNROOTED_NUM = checkpoint.simple_unrooted_num;
+		srand(checkpoint.seed);
+		cout << "Resuming at iteration " << checkpoint.iteration + 1 << endl;
+		cout << "Best Distance: " << best_distance << endl;
+	}
+	else if (!LGT_ANALYSIS && !LGT_EVALUATION) {
 
 			if (UNROOTED_MIN_APPROX)
 				APPROX_ROOTING=true;
@@ -1831,9 +2257,10 @@ TODO:
 								find_best_root_acc(super_tree, gene_trees[i]);
 		//					cout <<  j << "\t" << i << "\t" << acc << endl;
 							if (acc > -1) {
-								root_avg_acc += acc;
+								int weight = tree_weight(gene_trees[i]);
+								root_avg_acc += acc * weight;
 								//root_avg_acc += (acc - root_avg_acc) / count;
-								count++;
+								count += weight;
 							}
 						}
 						if (count > 0)
@@ -1863,9 +2290,7 @@ TODO:
 				super_tree->set_depth(0);
 				super_tree->fix_depths();
 				super_tree->preorder_number();
-				super_tree->numbers_to_labels(&reverse_label_map);
-				cout << "Rerooted Supertree: " <<  super_tree->str_subtree() << endl;
-				super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+				cout << "Rerooted Supertree: " <<  super_tree->str_subtree(&reverse_label_map) << endl;
 			}
 	if (SIMPLE_UNROOTED) {
 		cout << "rerooting gene trees" << endl;
@@ -1885,9 +2310,11 @@ TODO:
 				//find_best_root(super_tree, gene_trees[i]);
 			if (new_root != NULL) {
 				gene_trees[i]->reroot(new_root);
+				DISTANCE_CACHE.clear(gene_trees[i]);
 				gene_trees[i]->set_depth(0);
 				gene_trees[i]->fix_depths();
 				gene_trees[i]->preorder_number();
+				GENE_TREE_LCAS.update(gene_trees[i]);
 			}
 		}
 	}
@@ -1924,8 +2351,8 @@ TODO:
 	//super_tree->numbers_to_labels(&reverse_label_map);
 		if (FIND_SUPPORT) {
 			get_support(super_tree, &gene_trees);
-			super_tree->numbers_to_labels(&reverse_label_map);
-			cout << super_tree->str_support_subtree() << endl;
+			cout << super_tree->str_support_subtree(false, &reverse_label_map)
+					<< endl;
 			cleanup = true;
 		}
 		else if (FIND_BIPARTITION_SUPPORT) {
@@ -1939,14 +2366,14 @@ TODO:
 			get_bipartition_support(super_tree, &gene_trees,
 					RELAXED_BIPARTITION_SUPPORT);
 			super_tree->normalize_support();
-			super_tree->numbers_to_labels(&reverse_label_map);
-			cout << super_tree->str_support_subtree(true) << endl;
+			cout << super_tree->str_support_subtree(true, &reverse_label_map)
+					<< endl;
 			cleanup = true;
 		}
 		else if (FIND_CLADE_TRANSFERS) {
 			get_transfer_support(super_tree, &gene_trees);
-			super_tree->numbers_to_labels(&reverse_label_map);
-			cout << super_tree->str_support_subtree() << endl;
+			cout << super_tree->str_support_subtree(false, &reverse_label_map)
+					<< endl;
 			cleanup = true;
 		}
 
@@ -1954,9 +2381,7 @@ TODO:
 			cout << "Rerooted Gene Trees: " <<  endl;
 			for(int i = 0; i < gene_trees.size(); i++) {
 				cout << gene_tree_names[i];
-				gene_trees[i]->numbers_to_labels(&reverse_label_map);
-				cout << gene_trees[i]->str_subtree() << endl;
-				gene_trees[i]->labels_to_numbers(&label_map, &reverse_label_map);
+				cout << gene_trees[i]->str_subtree(&reverse_label_map) << endl;
 			}
 			cleanup = true;
 		}
@@ -2001,17 +2426,30 @@ TODO:
 			vector<set<int>> genes_union = vector<set<int>>(num_nodes, set<int>());
 
 			vector<Node *> super_tree_leaves = super_tree->find_leaves();
+			// supertree leaf of each taxon
+			vector<Node *> leaf_of_taxon = vector<Node *>();
+			for(int k = 0; k < super_tree_leaves.size(); k++) {
+				int label = super_tree_leaves[k]->get_name_num();
+				if (label < 0)
+					continue;
+				if (label >= leaf_of_taxon.size())
+					leaf_of_taxon.resize(label + 1, NULL);
+				leaf_of_taxon[label] = super_tree_leaves[k];
+			}
 
 			for(int i = 0; i < gene_trees.size(); i++) {
-				vector<Node *> leaves = gene_trees[i]->find_leaves();
+				TaxonSet *taxa = GENE_TREE_TAXA.lookup(gene_trees[i]);
+				vector<int> labels;
+				if (taxa != NULL)
+					labels = taxa->get_labels();
+				else
+					labels = TaxonSet(gene_trees[i]).get_labels();
 
-				for(int j = 0; j < leaves.size(); j++) {
-					Node * leaf;
-					for(int k = 0; k < super_tree_leaves.size(); k++){
-						if (leaves[j]->get_name_num() == super_tree_leaves[k]->get_name_num()){
-							leaf = super_tree_leaves[k];
-						}
-					}
+				for(int j = 0; j < labels.size(); j++) {
+					if (labels[j] >= leaf_of_taxon.size()
+							|| leaf_of_taxon[labels[j]] == NULL)
+						continue;
+					Node *leaf = leaf_of_taxon[labels[j]];
 					genes_from_leaf[leaf->get_preorder_number()].insert(i);
 				}
 			}
@@ -2105,9 +2543,8 @@ TODO:
 				ifstream lgt_group_file;
 				lgt_group_file.open(LGT_GROUPS.c_str());								
 				map<string, int> name_to_pre = map<string, int>();
-				super_tree->numbers_to_labels(&reverse_label_map);
-				super_tree->build_name_to_pre_map(&name_to_pre);
-				super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+				super_tree->build_name_to_pre_map(&name_to_pre,
+						&reverse_label_map);
 				group_names.push_back("Mixed");
 				if (lgt_group_file.is_open()) {
 					string line;
@@ -2304,8 +2741,7 @@ TODO:
 								json << ","<< endl <<"{";
 							}														
 								json << "\"newick\":";
-								gene_trees[i]->numbers_to_labels(&reverse_label_map);					json << "\""<< gene_trees[i]->str_subtree() << "\"," << endl;
-								gene_trees[i]->labels_to_numbers(&label_map, &reverse_label_map);
+								json << "\""<< gene_trees[i]->str_subtree(&reverse_label_map) << "\"," << endl;
 								json << "\"groups_distribution\":[";
 							
 								if (LGT_GROUPS != ""){									
@@ -2349,9 +2785,7 @@ TODO:
 
 					json << "\"supertree\":{";
 
-						super_tree->numbers_to_labels(&reverse_label_map);	
-						json << "\"newick\":\"" << super_tree->str_subtree() << "\",";
-						super_tree->labels_to_numbers(&label_map, &reverse_label_map);	
+						json << "\"newick\":\"" << super_tree->str_subtree(&reverse_label_map) << "\",";
 					
 
 						json << "\"groups_distribution\":[";
@@ -2383,14 +2817,12 @@ TODO:
 								}
 								
 								Node* node = super_tree->find_by_prenum(i);
-								super_tree->numbers_to_labels(&reverse_label_map);	
 								vector<Node *>  node_leaves = node->find_leaves();
 								vector<string> names;
 								for (int j = 0; j < node_leaves.size(); j++){
-									names.push_back(node_leaves[j]->get_name());
+									names.push_back(node_leaves[j]->label_name(&reverse_label_map));
 								}
 								sort(names.begin(), names.end());
-								super_tree->labels_to_numbers(&label_map, &reverse_label_map);	
 								
 								string node_id;
 								node_id.append(names[0]);
@@ -2640,9 +3072,8 @@ TODO:
 				vector<int> pre_to_group = vector<int>(num_nodes, 0);
 				vector<string> group_names = vector<string>();
 				map<string, int> name_to_pre = map<string, int>();
-				super_tree->numbers_to_labels(&reverse_label_map);
-				super_tree->build_name_to_pre_map(&name_to_pre);
-				super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+				super_tree->build_name_to_pre_map(&name_to_pre,
+						&reverse_label_map);
 				group_names.push_back("Mixed");
 				if (lgt_group_file.is_open()) {
 					string line;
@@ -2834,17 +3265,55 @@ TODO:
 	int num_zeros=0;
 	int edges_cut = 0;
 	int current_distance = 0;
+	int first_iteration = 0;
 	if (NUM_ITERATIONS < 0)
 		NUM_ITERATIONS=labels.size(); 
+	if (RESUME != "") {
+		num_zeros = checkpoint.num_zeros;
+		edges_cut = checkpoint.edges_cut;
+		current_distance = checkpoint.current_distance;
+		first_iteration = checkpoint.iteration;
+	}
+
+	if (WORKER_POOL != NULL)
+		distribute_gene_trees(gene_trees);
 
 	// SUPERTREE IMPROVEMENT STEP
-	for(int i = 0; i < NUM_ITERATIONS; i++) {
-/*		if (TABOO_SEARCH) {
-			cout << "TABOO " << taboo_trees.size() << endl;
-			list<Node>::iterator t;
-			for(t = taboo_trees.begin(); t != taboo_trees.end(); t++) {
-				cout << (*t).str_subtree() << endl;
+	for(int i = first_iteration; i < NUM_ITERATIONS; i++) {
+		// save the search state before each iteration. The random number
+		// generator is reseeded with the saved seed so that a resumed
+		// search continues exactly as this one does
+		if (CHECKPOINT != "" && (i > first_iteration || RESUME == "")) {
+			checkpoint.num_gene_trees = gene_trees.size();
+			checkpoint.num_labels = num_gene_tree_labels;
+			checkpoint.iteration = i;
+			checkpoint.seed = rand();
+			srand(checkpoint.seed);
+			checkpoint.best_distance = best_distance;
+			checkpoint.best_tie_distance = best_tie_distance;
+			checkpoint.best_rooted_distance = best_rooted_distance;
+			checkpoint.current_distance = current_distance;
+			checkpoint.r_distance = R_DISTANCE;
+			checkpoint.simple_unrooted_num = SIMPLE_UNROOTED_NUM;
+			checkpoint.num_zeros = num_zeros;
+			checkpoint.edges_cut = edges_cut;
+			checkpoint.super_tree = super_tree->str_subtree(&reverse_label_map);
+			checkpoint.best_supertree =
+					best_supertree->str_subtree(&reverse_label_map);
+			checkpoint.gene_tree_roots.clear();
+			if (SIMPLE_UNROOTED) {
+				for(int j = 0; j < gene_trees.size(); j++) {
+					checkpoint.gene_tree_roots.push_back(
+							root_side(gene_trees[j]));
+				}
 			}
+			if (!write_checkpoint(CHECKPOINT, checkpoint, &taboo_trees,
+					&DISTANCE_CACHE, gene_trees))
+				cout << "could not write checkpoint " << CHECKPOINT << endl;
+		}
+/*		if (TABOO_SEARCH) {
+			cout << "TABOO" << endl;
+			taboo_trees.write(cout);
 			cout << endl;
 		}
 */
@@ -2891,9 +3360,10 @@ TODO:
 								find_best_root_acc(super_tree, gene_trees[i]);
 		//					cout <<  j << "\t" << i << "\t" << acc << endl;
 							if (acc > -1) {
-								root_avg_acc += acc;
+								int weight = tree_weight(gene_trees[i]);
+								root_avg_acc += acc * weight;
 								//root_avg_acc += (acc - root_avg_acc) / count;
-								count++;
+								count += weight;
 							}
 						}
 						if (count > 0)
@@ -2924,11 +3394,9 @@ TODO:
 				super_tree->set_depth(0);
 				super_tree->fix_depths();
 				super_tree->preorder_number();
-				super_tree->numbers_to_labels(&reverse_label_map);
-				cout << "Rerooted Supertree: " <<  super_tree->str_subtree() << endl;
-				super_tree->labels_to_numbers(&label_map, &reverse_label_map);
-				if (TABOO_SEARCH && !is_taboo(taboo_trees, super_tree))
-						taboo_trees.push_back(Node(*super_tree));
+				cout << "Rerooted Supertree: " <<  super_tree->str_subtree(&reverse_label_map) << endl;
+				if (TABOO_SEARCH)
+						taboo_trees.insert(super_tree);
 			}
 		if (SIMPLE_UNROOTED && SIMPLE_UNROOTED_NUM > 0) {
 			SIMPLE_UNROOTED_NUM--;
@@ -2948,11 +3416,15 @@ TODO:
 					new_root = find_best_root(super_tree, gene_trees[i]);
 				if (new_root != NULL) {
 					gene_trees[i]->reroot(new_root);
+					DISTANCE_CACHE.clear(gene_trees[i]);
 					gene_trees[i]->set_depth(0);
 					gene_trees[i]->fix_depths();
 					gene_trees[i]->preorder_number();
+					GENE_TREE_LCAS.update(gene_trees[i]);
 				}
 			}
+			if (WORKER_POOL != NULL)
+				distribute_gene_trees(gene_trees);
 		}
 		if (BIPARTITION_CLUSTER) {
 			cout << "finding bipartition support" << endl;
@@ -2971,6 +3443,12 @@ TODO:
 		Node *best_subtree_root;
 		Node *best_sibling;
 
+		// the move searches only renumber the part of the tree that
+		// each spr changes, so start from current numbers
+		super_tree->set_depth(0);
+		super_tree->fix_depths();
+		super_tree->preorder_number();
+
 		// SUPERTREE IMPROVEMENT METHOD
 
 		/* one-tree-at-a-time method
@@ -3115,12 +3593,10 @@ TODO:
 					#ifdef DEBUG_ONE_TREE
 						 cout << endl;
 							cout << "SPR Move:" << endl;
-							super_tree->numbers_to_labels(&reverse_label_map);
 							cout << "Previous Super Tree: "
-							<< super_tree->str_subtree() << endl;
-							cout << "Subtree: " << F1_source->str_subtree() << endl;
-							cout << "New Sibling: " << F1_target->str_subtree() << endl;
-							super_tree->labels_to_numbers(&label_map, &reverse_label_map);	
+							<< super_tree->str_subtree(&reverse_label_map) << endl;
+							cout << "Subtree: " << F1_source->str_subtree(&reverse_label_map) << endl;
+							cout << "New Sibling: " << F1_target->str_subtree(&reverse_label_map) << endl;
 					#endif
 					
 					//		cout << endl;
@@ -3140,9 +3616,7 @@ TODO:
 					//		<< super_tree->str_support_subtree(true) << endl;
 //					/*
 					#ifdef DEBUG_ONE_TREE
-							super_tree->numbers_to_labels(&reverse_label_map);
-							cout << "Proposed Super Tree: " << super_tree->str_subtree() << endl;
-							super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+							cout << "Proposed Super Tree: " << super_tree->str_subtree(&reverse_label_map) << endl;
 					#endif
 					// test the new supertree
 //					*/	
@@ -3215,9 +3689,7 @@ TODO:
 						RELAXED_BIPARTITION_SUPPORT);
 						super_tree->normalize_support();
 						cout << endl;
-						super_tree->numbers_to_labels(&reverse_label_map);
-						cout << super_tree->str_subtree() << endl;
-						super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+						cout << super_tree->str_subtree(&reverse_label_map) << endl;
 						for(int i = 0; i < gene_trees.size(); i++) {
 							original_scores[i] = original_scores_temp[i];
 						}
@@ -3271,6 +3743,9 @@ TODO:
 			int r = find_r();
 			int min_distance = INT_MAX;
 			int num_ties = 0;
+			SprMoveScreen screen = SprMoveScreen();
+			screen.tie_rules = true;
+			MOVE_SCREEN = &screen;
 			for(vector<pair<Node *, int> >::const_iterator i = best_scores.begin(); i != best_scores.end(); i++){
 				Node *source = i->first;
 				if(!R_CONTROL && R_RAND)
@@ -3282,6 +3757,8 @@ TODO:
 				else
 					find_best_spr_r_helper(source, source->parent(), super_tree, gene_trees, best_subtree_root, best_sibling, min_distance, num_ties, r+1, 3);
 			}
+			MOVE_SCREEN = NULL;
+			screen_best_spr(super_tree, screen, best_subtree_root, best_sibling);
 
 		}
 /*Limiting SPR Radius*/		
@@ -3318,10 +3795,14 @@ TODO:
 		else if(S_LIMIT && !R_LIMIT){
 			int min_distance = INT_MAX;
 			int num_ties = 0;
+			SprMoveScreen screen = SprMoveScreen();
+			MOVE_SCREEN = &screen;
 			for(vector<pair<Node *, int> >::const_iterator i = best_scores.begin(); i!= best_scores.end(); i++){
 				Node *source = i->first;
 				find_best_spr_helper(source, super_tree, gene_trees, best_subtree_root, best_sibling, min_distance, num_ties);
 			}
+			MOVE_SCREEN = NULL;
+			screen_best_spr(super_tree, screen, best_subtree_root, best_sibling);
 
 		}
 /*Greedy search*/
@@ -3333,10 +3814,7 @@ TODO:
 			int current_distance;
 			for(int i = 0; i < approx_moves.size() && !check ; i++){
 				int which_sibling = 0;
-				Node *undo = approx_moves[i].first.first->spr(approx_moves[i].first.second, which_sibling);
-				super_tree->set_depth(0);
-				super_tree->fix_depths();
-				super_tree->preorder_number();
+				Node *undo = approx_moves[i].first.first->spr_renumber(approx_moves[i].first.second, which_sibling);
 	
 
 				if (APPROX)
@@ -3353,15 +3831,10 @@ TODO:
 					check = true;
 
 				else {
-					approx_moves[i].first.first->spr(undo, which_sibling);
-					super_tree->set_depth(0);
-					super_tree->fix_depths();
-					super_tree->preorder_number();
+					approx_moves[i].first.first->spr_renumber(undo, which_sibling);
 				}
 			}
-			super_tree->numbers_to_labels(&reverse_label_map);
-			cout << "Current Supertree: " << super_tree->str_subtree() << endl;
-			super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+			cout << "Current Supertree: " << super_tree->str_subtree(&reverse_label_map) << endl;
 			if (current_distance < best_distance) {
 				best_supertree->delete_tree();
 				best_supertree = new Node(*super_tree);
@@ -3385,6 +3858,8 @@ TODO:
 			int min_distance = INT_MAX;
 			int num_ties = 0;
 			approx_moves = vector<pair <pair<Node*,Node*>, int> >();
+			SprMoveScreen screen = SprMoveScreen();
+			MOVE_SCREEN = &screen;
 			for(vector<pair<Node *, int> >::const_iterator i = best_scores.begin(); i != best_scores.end(); i++){
 				Node *source = i->first;
 				if(!R_CONTROL && R_RAND)
@@ -3396,15 +3871,14 @@ TODO:
 				else
 					find_best_spr_r_helper(source, source->parent(), super_tree, gene_trees, best_subtree_root, best_sibling, min_distance, num_ties, r+1, 3, approx_moves);
 			}
+			MOVE_SCREEN = NULL;
+			find_approx_moves(super_tree, screen, approx_moves);
 			std::sort(approx_moves.begin(), approx_moves.end(), sort_approx_moves);
 			bool check = false;
 			int current_distance;
 			for(int i = 0; i < approx_moves.size() && !check ; i++){
 				int which_sibling = 0;
-				Node *undo = approx_moves[i].first.first->spr(approx_moves[i].first.second, which_sibling);
-				super_tree->set_depth(0);
-				super_tree->fix_depths();
-				super_tree->preorder_number();
+				Node *undo = approx_moves[i].first.first->spr_renumber(approx_moves[i].first.second, which_sibling);
 	
 
 				if (APPROX)
@@ -3421,15 +3895,10 @@ TODO:
 					check = true;
 
 				else {
-					approx_moves[i].first.first->spr(undo, which_sibling);
-					super_tree->set_depth(0);
-					super_tree->fix_depths();
-					super_tree->preorder_number();
+					approx_moves[i].first.first->spr_renumber(undo, which_sibling);
 				}
 			}
-			super_tree->numbers_to_labels(&reverse_label_map);
-			cout << "Current Supertree: " << super_tree->str_subtree() << endl;
-			super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+			cout << "Current Supertree: " << super_tree->str_subtree(&reverse_label_map) << endl;
 			if (current_distance < best_distance) {
 				best_supertree->delete_tree();
 				best_supertree = new Node(*super_tree);
@@ -3454,11 +3923,9 @@ TODO:
 				super_tree->fix_depths();
 				super_tree->preorder_number();
 			}
-			if (TABOO_SEARCH && !is_taboo(taboo_trees, super_tree))
-				taboo_trees.push_back(Node(*super_tree));
-			super_tree->numbers_to_labels(&reverse_label_map);
-			cout << "Current Supertree: " <<  super_tree->str_subtree() << endl;
-			super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+			if (TABOO_SEARCH)
+				taboo_trees.insert(super_tree);
+			cout << "Current Supertree: " <<  super_tree->str_subtree(&reverse_label_map) << endl;
 //			super_tree->labels_to_numbers(&label_map, &reverse_label_map);
 			int current_distance;
 			if (APPROX)
@@ -3521,6 +3988,13 @@ TODO:
 			time = clock()/(double)CLOCKS_PER_SEC;
 			current_time = time - current_time;
 			cout << "\t" << current_time << "\t" << time << endl;
+			DISTANCE_CACHE.print_stats();
+			if (screening()) {
+				cout << "move screen: " << SCREEN_EXACT_MOVES
+						<< " exact scores / " << SCREEN_MOVES << " moves" << endl;
+				SCREEN_EXACT_MOVES = 0;
+				SCREEN_MOVES = 0;
+			}
 		}
 
 		scores.clear();
@@ -3533,8 +4007,7 @@ TODO:
 
 	super_tree->delete_tree();
 	super_tree=best_supertree;
-	super_tree->numbers_to_labels(&reverse_label_map);
-	cout << "Final Supertree: " <<  super_tree->str_subtree() << endl;
+	cout << "Final Supertree: " <<  super_tree->str_subtree(&reverse_label_map) << endl;
 	cout << "Final Distance: " << best_distance << endl;
 	if (RF_TIES) {
 		cout << "Final RF Distance: " << best_tie_distance << endl;
@@ -3546,64 +4019,153 @@ TODO:
 		gene_trees[i]->delete_tree();
 	}
 	super_tree->delete_tree();
+	if (WORKER_POOL != NULL)
+		delete WORKER_POOL;
 
 	return 0;
 
 }
 
 
+/* find_best_sibling
+ * Choose the node of the supertree whose parent edge is the best place
+ * to add the leaf label, see best_insertion
+ */
 Node *find_best_sibling(Node *super_tree, vector<Node *> &gene_trees, int label) {
-	Node *best_sibling;
-	Node *new_leaf = new Node(itos(label));
-	int min_distance = INT_MAX;
-	int min_tie_distance = INT_MAX;
-	int num_ties = 0;
-	find_best_sibling_helper(super_tree, new_leaf, super_tree, gene_trees,
-			min_distance, min_tie_distance, num_ties, &best_sibling);
-	delete new_leaf;
-	return best_sibling;
+	vector<Node *> candidates = vector<Node *>();
+	find_spr_move_nodes(super_tree, candidates);
+	return best_insertion(super_tree, gene_trees, candidates, label);
 }
 
-void find_best_sibling_helper(Node *n, Node *new_leaf, Node *super_tree,
-		vector<Node *> &gene_trees, int &min_distance, int &min_tie_distance,
-		int &num_ties,
-		Node **best_sibling) {
+Node *find_best_sibling(Node *super_tree, vector<Node *> &gene_trees,
+		vector<Node *> *best_siblings, int label) {
+	return best_insertion(super_tree, gene_trees, *best_siblings, label);
+}
 
-	if (n->lchild() != NULL) {
-		find_best_sibling_helper(n->lchild(), new_leaf, super_tree,
-				gene_trees, min_distance, min_tie_distance, num_ties, best_sibling);
+/* best_insertion
+ * Choose the candidate whose parent edge gives the smallest total
+ * distance when the leaf label is added to it. Unless the distances
+ * are approximate, each insertion first gets a lower bound from the
+ * 3-approximation and the insertions are then scored exactly in order
+ * of their bounds. An insertion whose bound is larger than the best
+ * exact score so far can not be chosen and is skipped. Each thread
+ * adds and removes the leaf on its own copy of the supertree.
+ * Ties are broken with RF_TIES and then by a key drawn from one rand()
+ * per call, so the candidate chosen does not depend on the number of
+ * threads.
+ */
+Node *best_insertion(Node *super_tree, vector<Node *> &gene_trees,
+		vector<Node *> &candidates, int label) {
+	int end = candidates.size();
+	vector<Node *> nodes = vector<Node *>();
+	find_spr_move_nodes(super_tree, nodes);
+	map<Node *, int> index = map<Node *, int>();
+	for(int i = 0; i < nodes.size(); i++) {
+		index[nodes[i]] = i;
 	}
-	if (n->rchild() != NULL) {
-		find_best_sibling_helper(n->rchild(), new_leaf, super_tree,
-				gene_trees, min_distance, min_tie_distance, num_ties, best_sibling);
+	vector<int> positions = vector<int>(end);
+	for(int j = 0; j < end; j++) {
+		positions[j] = index[candidates[j]];
 	}
-	test_sibling_helper(n, new_leaf, super_tree,
-			gene_trees, min_distance, min_tie_distance, num_ties, best_sibling);
-}
-
-Node *find_best_sibling(Node *super_tree, vector<Node *> &gene_trees,
-		vector<Node *> *best_siblings, int label) {
-	Node *best_sibling;
-	Node *new_leaf = new Node(itos(label));
+	vector<int> lower_bounds = vector<int>(end, 0);
+	vector<int> distances = vector<int>(end, INT_MAX);
+	vector<int> order = vector<int>(end);
+	bool bounded = !RANDOM_TREE && !APPROX;
 	int min_distance = INT_MAX;
-	int min_tie_distance = INT_MAX;
-	int num_ties = 0;
-	for(int i = 0; i < best_siblings->size(); i++) {
-		test_sibling_helper((*best_siblings)[i], new_leaf, super_tree, gene_trees,
-				min_distance, min_tie_distance, num_ties, &best_sibling);
+	#pragma omp parallel
+	{
+		Node *T = new Node(*super_tree);
+		vector<Node *> T_nodes = vector<Node *>();
+		find_spr_move_nodes(T, T_nodes);
+		Node *new_leaf = new Node();
+		new_leaf->set_label(label);
+		if (bounded) {
+			#pragma omp for schedule(dynamic)
+			for(int j = 0; j < end; j++) {
+				Node *n = T_nodes[positions[j]];
+				int status;
+				Node *new_node = insert_leaf(n, new_leaf, status);
+				lower_bounds[j] = supertree_lower_bound(T, gene_trees);
+				remove_leaf(n, new_leaf, new_node, status);
+			}
+		}
+		#pragma omp single
+		{
+			vector<pair<int, int> > by_bound = vector<pair<int, int> >();
+			for(int j = 0; j < end; j++) {
+				by_bound.push_back(make_pair(lower_bounds[j], j));
+			}
+			sort(by_bound.begin(), by_bound.end());
+			for(int j = 0; j < end; j++) {
+				order[j] = by_bound[j].second;
+			}
+		}
+		#pragma omp for schedule(dynamic)
+		for(int k = 0; k < end; k++) {
+			int j = order[k];
+			int threshold;
+			#pragma omp atomic read
+			threshold = min_distance;
+			if (lower_bounds[j] > threshold)
+				continue;
+			if (RANDOM_TREE) {
+				distances[j] = 0;
+				continue;
+			}
+			Node *n = T_nodes[positions[j]];
+			int status;
+			Node *new_node = insert_leaf(n, new_leaf, status);
+			int distance = supertree_distance(T, gene_trees, threshold);
+			remove_leaf(n, new_leaf, new_node, status);
+			distances[j] = distance;
+			// see score_spr_moves
+			#pragma omp critical (best_insertion)
+			{
+				if (distance < min_distance) {
+					#pragma omp atomic write
+					min_distance = distance;
+				}
+			}
+		}
+		delete new_leaf;
+		T->delete_tree();
+	}
+	if (RANDOM_TREE)
+		min_distance = 0;
+
+	unsigned int seed = rand();
+	int best = -1;
+	int best_tie_distance = INT_MAX;
+	Node *new_leaf = new Node();
+	new_leaf->set_label(label);
+	for(int j = 0; j < end; j++) {
+		if (distances[j] != min_distance)
+			continue;
+		int tie_distance = 0;
+		if (RF_TIES) {
+			int status;
+			Node *new_node = insert_leaf(candidates[j], new_leaf, status);
+			tie_distance = rf_total_distance(super_tree, gene_trees);
+			remove_leaf(candidates[j], new_leaf, new_node, status);
+		}
+		if (best == -1 || tie_distance < best_tie_distance
+				|| (tie_distance == best_tie_distance
+				&& tie_key(seed, j) < tie_key(seed, best))) {
+			best = j;
+			best_tie_distance = tie_distance;
+		}
 	}
 	delete new_leaf;
-	return best_sibling;
+	return candidates[best];
 }
 
-void test_sibling_helper(Node *n, Node *new_leaf, Node *super_tree,
-		vector<Node *> &gene_trees, int &min_distance, int &min_tie_distance,
-		int &num_ties, Node **best_sibling) {
-
-	// TODO: modify this to keep a single intermediate node rather
-	//than recreating and destroying it
-//	cout << "Previous Super Tree" << super_tree->str_subtree() << endl;
-	int status = -1;
+/* insert_leaf
+ * Add new_leaf as the sibling of n and renumber the tree. status is set
+ * to 1 or 2 if n was the left or right child of its parent
+ * RETURN the new parent of new_leaf, for remove_leaf
+ */
+Node *insert_leaf(Node *n, Node *new_leaf, int &status) {
+	status = -1;
 	if (n->parent() != NULL)
 		if (n->parent()->lchild() == n)
 			status = 1;
@@ -3611,66 +4173,18 @@ void test_sibling_helper(Node *n, Node *new_leaf, Node *super_tree,
 			status = 2;
 	Node *new_node = n->expand_parent_edge(n);
 	new_node->add_child(new_leaf);
-//	cout << "New Super Tree" << super_tree->str_subtree() << endl;
+	Node *root = new_node;
+	while (root->parent() != NULL)
+		root = root->parent();
+	root->set_depth(0);
+	root->fix_depths();
+	root->preorder_number();
+	return new_node;
+}
 
-	super_tree->set_depth(0);
-	super_tree->fix_depths();
-	super_tree->preorder_number();
-	int distance;
-	if (RANDOM_TREE)
-		distance = 0;
-	else {
-		if (APPROX) {
-			if (UNROOTED)
-				distance = rSPR_total_approx_distance_unrooted(super_tree, gene_trees);
-			else
-				distance = rSPR_total_approx_distance(super_tree, gene_trees);
-		}
-		else {
-			if (UNROOTED)
-				distance = rSPR_total_distance_unrooted(super_tree, gene_trees,
-						min_distance);
-			else
-				distance = rSPR_total_distance(super_tree, gene_trees, min_distance);
-		}
-	}
-	if (distance < min_distance) {
-		min_distance = distance;
-		if (RF_TIES)
-			min_tie_distance = rf_total_distance(super_tree, gene_trees);
-		*best_sibling = n;
-		num_ties = 2;
-	}
-	else if (distance == min_distance) {
-		bool check_tie = true;
-		bool tie = false;
-		if (RF_TIES) {
-			int rf_distance = rf_total_distance(super_tree, gene_trees);
-			if (rf_distance < min_tie_distance) {
-				min_tie_distance = rf_distance;
-				*best_sibling = n;
-				num_ties = 2;
-				check_tie = false;
-			}
-			else if (rf_distance == min_tie_distance)
-				tie = true;
-			else
-				check_tie = false;
-		}
-		if (check_tie) {
-			int r = rand();
-			if (r < RAND_MAX/num_ties) {
-				*best_sibling = n;
-			}
-			num_ties++;
-		}
-	}
-//	cout << "distance: " << distance;
-//	cout << endl;
-
-//	cout << super_tree->str_subtree() << endl;
+// undo insert_leaf
+void remove_leaf(Node *n, Node *new_leaf, Node *new_node, int status) {
 	new_leaf->cut_parent();
-//	cout << super_tree->str_subtree() << endl;
 	new_node = new_node->undo_expand_parent_edge();
 	delete new_node;
 
@@ -3681,15 +4195,17 @@ void test_sibling_helper(Node *n, Node *new_leaf, Node *super_tree,
 			rc->cut_parent();
 			n->parent()->add_child(rc);
 		}
-	super_tree->set_depth(0);
-	super_tree->fix_depths();
-	super_tree->preorder_number();
-//	cout << "Reverted: " << super_tree->str_subtree() << endl;
-
+	Node *root = n;
+	while (root->parent() != NULL)
+		root = root->parent();
+	root->set_depth(0);
+	root->fix_depths();
+	root->preorder_number();
 }
 
 vector<Node *> *find_best_siblings(Node *super_tree, vector<Node *> &gene_trees, int label, int num_siblings) {
-	Node *new_leaf = new Node(itos(label));
+	Node *new_leaf = new Node();
+	new_leaf->set_label(label);
 	int min_distance = INT_MAX;
 	int min_tie_distance = INT_MAX;
 	int num_ties = 0;
@@ -3794,11 +4310,447 @@ void find_best_siblings_helper(Node *n, Node *new_leaf, Node *super_tree,
 }
 
 
+/* find_best_spr
+ * Score every spr move of the supertree and choose the one with the
+ * smallest total distance, see screen_best_spr
+ */
 void find_best_spr(Node *super_tree, vector<Node *> &gene_trees, Node *&best_spr_move, Node *&best_sibling) {
 	int min_distance = INT_MAX;
 	int num_ties = 0;
+	SprMoveScreen screen = SprMoveScreen();
+	MOVE_SCREEN = &screen;
 	find_best_spr_helper(super_tree, super_tree, gene_trees,
 			best_spr_move, best_sibling, min_distance, num_ties);
+	MOVE_SCREEN = NULL;
+	screen_best_spr(super_tree, screen, best_spr_move, best_sibling);
+}
+
+/* screen_best_spr
+ * Choose the move of the screen with the smallest total distance.
+ * Without screening every move is scored exactly. Otherwise each move
+ * first gets a lower bound from the 3-approximation and only the
+ * SCREEN_TOP_K moves with the smallest bounds, and those within
+ * SCREEN_MARGIN of the smallest bound, are scored exactly. With
+ * SCREEN_VERIFY every other move whose bound is at most the best exact
+ * score is then scored too, so the same move is chosen as without
+ * screening.
+ * Ties are broken by a key drawn from one rand() per call, so the move
+ * chosen does not depend on the number of threads.
+ * RETURN false if no move could be chosen
+ */
+bool screen_best_spr(Node *super_tree, SprMoveScreen &screen,
+		Node *&best_spr_move, Node *&best_sibling) {
+	int end = screen.size();
+	vector<int> distances = vector<int>(end, INT_MAX);
+	vector<bool> scored = vector<bool>(end, false);
+	vector<int> lower_bounds = vector<int>();
+	vector<int> selected = vector<int>();
+	for(int i = 0; i < end; i++) {
+		selected.push_back(i);
+	}
+	if (screening()) {
+		lower_bounds = vector<int>(end, 0);
+		score_spr_moves(super_tree, screen, selected, lower_bounds, false,
+				INT_MAX);
+		vector<pair<int, int> > by_bound = vector<pair<int, int> >();
+		for(int i = 0; i < end; i++) {
+			by_bound.push_back(make_pair(lower_bounds[i], i));
+		}
+		sort(by_bound.begin(), by_bound.end());
+		selected.clear();
+		for(int j = 0; j < end; j++) {
+			if (j == 0 || j < SCREEN_TOP_K || (SCREEN_MARGIN >= 0
+					&& by_bound[j].first <= by_bound[0].first + SCREEN_MARGIN))
+				selected.push_back(by_bound[j].second);
+		}
+	}
+
+	int min_distance = INT_MAX;
+	while (!selected.empty()) {
+		score_spr_moves(super_tree, screen, selected, distances, true,
+				min_distance);
+		for(int j = 0; j < selected.size(); j++) {
+			int i = selected[j];
+			scored[i] = true;
+			if (distances[i] < min_distance)
+				min_distance = distances[i];
+		}
+		SCREEN_EXACT_MOVES += selected.size();
+		selected.clear();
+		if (screening() && SCREEN_VERIFY) {
+			for(int i = 0; i < end; i++) {
+				if (!scored[i] && lower_bounds[i] <= min_distance)
+					selected.push_back(i);
+			}
+		}
+	}
+	SCREEN_MOVES += end;
+
+	unsigned int seed = rand();
+	int best = -1;
+	int best_tie_distance = INT_MAX;
+	for(int i = 0; i < end; i++) {
+		if (!scored[i] || distances[i] == INT_MAX
+				|| distances[i] > min_distance)
+			continue;
+		int tie_distance = 0;
+		if (screen.tie_rules && RF_TIES) {
+			Node *n = screen.moves[i].first;
+			int which_sibling = 0;
+			Node *undo = n->spr_renumber(screen.moves[i].second, which_sibling);
+			tie_distance = rf_total_distance(super_tree,
+					screen.gene_tree_sets[screen.gene_tree_set[i]]);
+			n->spr_renumber(undo, which_sibling);
+		}
+		if (best == -1 || tie_distance < best_tie_distance
+				|| (tie_distance == best_tie_distance
+				&& tie_key(seed, i) < tie_key(seed, best))) {
+			best = i;
+			best_tie_distance = tie_distance;
+		}
+	}
+	if (best == -1)
+		return false;
+	best_spr_move = screen.moves[best].first;
+	best_sibling = screen.moves[best].second;
+	return true;
+}
+
+/* score_spr_moves
+ * Set scores[i] for each move i in selected. Each thread applies and
+ * undoes its moves on its own copy of the supertree. Exact scores are
+ * only exact up to the best exact score found so far, starting from
+ * min_distance, and larger otherwise. Scores that are not exact are
+ * lower bounds from the 3-approximation. Exact scores are computed by
+ * the workers when there are any.
+ */
+void score_spr_moves(Node *super_tree, SprMoveScreen &screen,
+		vector<int> &selected, vector<int> &scores, bool exact,
+		int min_distance) {
+	if (exact && WORKER_POOL != NULL && !APPROX) {
+		if (score_spr_moves_remote(super_tree, screen, selected, scores,
+				min_distance))
+			return;
+		cout << "lost the connection to a worker, scoring locally" << endl;
+		delete WORKER_POOL;
+		WORKER_POOL = NULL;
+	}
+	vector<Node *> nodes = vector<Node *>();
+	find_spr_move_nodes(super_tree, nodes);
+	map<Node *, int> index = map<Node *, int>();
+	for(int i = 0; i < nodes.size(); i++) {
+		index[nodes[i]] = i;
+	}
+	int end = selected.size();
+	vector<pair<int, int> > moves = vector<pair<int, int> >(end);
+	for(int j = 0; j < end; j++) {
+		pair<Node *, Node *> &move = screen.moves[selected[j]];
+		moves[j] = make_pair(index[move.first], index[move.second]);
+	}
+	#pragma omp parallel
+	{
+		Node *T = new Node(*super_tree);
+		vector<Node *> T_nodes = vector<Node *>();
+		find_spr_move_nodes(T, T_nodes);
+		#pragma omp for schedule(dynamic)
+		for(int j = 0; j < end; j++) {
+			int i = selected[j];
+			Node *n = T_nodes[moves[j].first];
+			Node *new_sibling = T_nodes[moves[j].second];
+			vector<Node *> &gene_trees =
+					screen.gene_tree_sets[screen.gene_tree_set[i]];
+			int offset = screen.offsets[i];
+			int which_sibling = 0;
+			Node *undo = n->spr_renumber(new_sibling, which_sibling);
+			int score;
+			if (!exact)
+				score = supertree_lower_bound(T, gene_trees) + offset;
+			else if (screen.tie_rules && TABOO_SEARCH
+					&& is_taboo(taboo_trees, T))
+				score = INT_MAX;
+			else {
+				int threshold;
+				#pragma omp atomic read
+				threshold = min_distance;
+				if (threshold < INT_MAX)
+					threshold -= offset;
+				score = supertree_distance(T, gene_trees, threshold) + offset;
+				// writes are atomic as other threads read min_distance
+				// without entering the critical section
+				#pragma omp critical (score_spr_moves)
+				{
+					if (score < min_distance) {
+						#pragma omp atomic write
+						min_distance = score;
+					}
+				}
+			}
+			n->spr_renumber(undo, which_sibling);
+			scores[i] = score;
+		}
+		T->delete_tree();
+	}
+}
+
+/* score_spr_moves_remote
+ * Score moves exactly with the workers of WORKER_POOL. Each candidate
+ * supertree is scored against its gene tree set and given its offset,
+ * as in score_spr_moves. The moves are sent in batches of at most
+ * WORKER_BATCH that share a gene tree set, with the best total so far
+ * as the threshold.
+ * RETURN false if a worker could not be reached
+ */
+bool score_spr_moves_remote(Node *super_tree, SprMoveScreen &screen,
+		vector<int> &selected, vector<int> &scores, int min_distance) {
+	int end;
+	for(int start = 0; start < selected.size(); start = end) {
+		int set = screen.gene_tree_set[selected[start]];
+		int offset = screen.offsets[selected[start]];
+		vector<string> trees = vector<string>();
+		vector<int> batch = vector<int>();
+		for(end = start; end < selected.size()
+				&& end < start + WORKER_BATCH
+				&& screen.gene_tree_set[selected[end]] == set
+				&& screen.offsets[selected[end]] == offset; end++) {
+			int i = selected[end];
+			Node *n = screen.moves[i].first;
+			int which_sibling = 0;
+			Node *undo = n->spr_renumber(screen.moves[i].second,
+					which_sibling);
+			if (screen.tie_rules && TABOO_SEARCH
+					&& is_taboo(taboo_trees, super_tree))
+				scores[i] = INT_MAX;
+			else {
+				trees.push_back(super_tree->str_subtree());
+				batch.push_back(i);
+			}
+			n->spr_renumber(undo, which_sibling);
+		}
+		vector<int> totals = vector<int>(batch.size(), 0);
+		if (screen.gene_tree_sets[set].empty())
+			;
+		else if (!WORKER_POOL->set_subset(screen.gene_tree_sets[set])
+				|| !WORKER_POOL->score(trees, min_distance - offset, totals))
+			return false;
+		for(int j = 0; j < batch.size(); j++) {
+			int score = INT_MAX;
+			if (totals[j] < INT_MAX - offset)
+				score = totals[j] + offset;
+			scores[batch[j]] = score;
+			if (score < min_distance)
+				min_distance = score;
+		}
+	}
+	return true;
+}
+
+// the options that change the distances a worker computes
+string worker_mode() {
+	stringstream mode;
+	mode << "unrooted=" << UNROOTED
+			<< " unrooted_min_approx=" << UNROOTED_MIN_APPROX
+			<< " count_losses=" << COUNT_LOSSES
+			<< " cut_lost=" << CUT_LOST
+			<< " max=" << MAX_SPR
+			<< " cluster_max=" << CLUSTER_MAX_SPR
+			<< " min=" << MIN_SPR;
+	return mode.str();
+}
+
+// send the gene trees to the workers, or stop using them if that fails
+bool distribute_gene_trees(vector<Node *> &gene_trees) {
+	vector<int> weights = vector<int>();
+	for(int i = 0; i < gene_trees.size(); i++) {
+		weights.push_back(tree_weight(gene_trees[i]));
+	}
+	string failed = "";
+	if (WORKER_POOL->distribute(gene_trees, weights, worker_mode(), failed))
+		return true;
+	if (failed.find(": mode ") != string::npos)
+		cout << "worker " << failed << " does not match " << worker_mode()
+				<< ", scoring locally" << endl;
+	else
+		cout << "could not send the gene trees to the workers, scoring locally"
+				<< endl;
+	delete WORKER_POOL;
+	WORKER_POOL = NULL;
+	return false;
+}
+
+/* run_worker
+ * Wait for a coordinator to connect on port and score its candidate
+ * supertrees against the gene trees it sends, see WorkerPool.h
+ */
+int run_worker(int port) {
+	int listener = listen_for_coordinator(port, WORKER_LISTEN_ALL);
+	if (listener < 0) {
+		cout << "could not listen on port " << port << endl;
+		return -1;
+	}
+	cout << "waiting for a coordinator on port " << port << endl;
+	int fd = accept_coordinator(listener);
+	if (fd < 0) {
+		cout << "could not accept a coordinator on port " << port << endl;
+		return -1;
+	}
+	LineChannel coordinator = LineChannel(fd);
+	vector<Node *> gene_trees = vector<Node *>();
+	// the coordinator's position of each gene tree
+	map<int, Node *> gene_tree_at = map<int, Node *>();
+	// the gene trees to score
+	vector<Node *> subset = vector<Node *>();
+	DISTANCE_CACHE.set_max_entries(DISTANCE_CACHE_SIZE);
+	string line;
+	while (coordinator.read_line(line)) {
+		if (line == "clear") {
+			for(int i = 0; i < gene_trees.size(); i++) {
+				DISTANCE_CACHE.clear(gene_trees[i]);
+				GENE_TREE_LCAS.remove(gene_trees[i]);
+				GENE_TREE_TAXA.remove(gene_trees[i]);
+				gene_trees[i]->delete_tree();
+			}
+			gene_trees.clear();
+			gene_tree_at.clear();
+			subset.clear();
+		}
+		else if (line.compare(0, 5, "tree ") == 0) {
+			stringstream ss(line.substr(5));
+			int position;
+			int weight;
+			string tree;
+			ss >> position >> weight >> ws;
+			getline(ss, tree);
+			Node *T = build_tree(tree);
+			T->set_depth(0);
+			T->fix_depths();
+			T->preorder_number();
+			T->set_weight(weight);
+			DISTANCE_CACHE.add_tree(T);
+			GENE_TREE_LCAS.add_tree(T);
+			GENE_TREE_TAXA.add_tree(T);
+			gene_trees.push_back(T);
+			gene_tree_at[position] = T;
+			subset = gene_trees;
+		}
+		else if (line.compare(0, 7, "subset ") == 0) {
+			if (line == "subset all")
+				subset = gene_trees;
+			else {
+				stringstream ss(line.substr(7));
+				int n;
+				ss >> n;
+				subset.clear();
+				for(int i = 0; i < n; i++) {
+					int position;
+					ss >> position;
+					map<int, Node *>::iterator j = gene_tree_at.find(position);
+					if (j != gene_tree_at.end())
+						subset.push_back(j->second);
+				}
+			}
+		}
+		else if (line.compare(0, 5, "ready") == 0) {
+			// refuse to score with other options than the coordinator
+			string mode = "";
+			if (line.size() > 6)
+				mode = line.substr(6);
+			if (mode != worker_mode()) {
+				coordinator.send_line("mode " + worker_mode());
+				cout << "the coordinator uses " << mode
+						<< " but this worker uses " << worker_mode() << endl;
+				continue;
+			}
+			stringstream reply;
+			reply << "ok " << gene_trees.size();
+			coordinator.send_line(reply.str());
+			cout << "scoring " << gene_trees.size() << " gene trees" << endl;
+		}
+		else if (line.compare(0, 6, "score ") == 0) {
+			stringstream ss(line.substr(6));
+			int threshold;
+			int k;
+			ss >> threshold >> k;
+			stringstream reply;
+			int i;
+			for(i = 0; i < k; i++) {
+				string tree;
+				if (!coordinator.read_line(tree))
+					break;
+				Node *T = build_tree(tree);
+				T->set_depth(0);
+				T->fix_depths();
+				T->preorder_number();
+				reply << supertree_distance(T, subset, threshold) << "\n";
+				T->delete_tree();
+			}
+			// never send part of a batch
+			if (i < k)
+				break;
+			coordinator.send_all(reply.str().c_str(), reply.str().size());
+		}
+		else if (line == "quit") {
+			break;
+		}
+	}
+	coordinator.close_channel();
+	for(int i = 0; i < gene_trees.size(); i++) {
+		gene_trees[i]->delete_tree();
+	}
+	return 0;
+}
+
+// true if moves get lower bounds before they are scored exactly
+bool screening() {
+	return !APPROX && (SCREEN_TOP_K > 0 || SCREEN_MARGIN >= 0
+			|| SCREEN_VERIFY);
+}
+
+/* total distance of the gene trees to the supertree
+ * exact distances may stop early once they are larger than min_distance
+ */
+int supertree_distance(Node *super_tree, vector<Node *> &gene_trees,
+		int min_distance) {
+	if (APPROX) {
+		if (UNROOTED)
+			return rSPR_total_approx_distance_unrooted(super_tree, gene_trees);
+		else
+			return rSPR_total_approx_distance(super_tree, gene_trees);
+	}
+	else {
+		if (UNROOTED)
+			return rSPR_total_distance_unrooted(super_tree, gene_trees,
+					min_distance);
+		else
+			return rSPR_total_distance(super_tree, gene_trees, min_distance);
+	}
+}
+
+// lower bound on supertree_distance from the 3-approximation
+int supertree_lower_bound(Node *super_tree, vector<Node *> &gene_trees) {
+	if (UNROOTED)
+		return rSPR_total_lower_bound_unrooted(super_tree, gene_trees);
+	else
+		return rSPR_total_lower_bound(super_tree, gene_trees);
+}
+
+// the nodes of n's subtree in postorder
+void find_spr_move_nodes(Node *n, vector<Node *> &nodes) {
+	if (n->lchild() != NULL)
+		find_spr_move_nodes(n->lchild(), nodes);
+	if (n->rchild() != NULL)
+		find_spr_move_nodes(n->rchild(), nodes);
+	nodes.push_back(n);
+}
+
+// hash a move number with a seed to order tied moves
+unsigned int tie_key(unsigned int seed, unsigned int move) {
+	unsigned int x = seed ^ (move * 0x9e3779b9u);
+	x ^= x >> 16;
+	x *= 0x85ebca6bu;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35u;
+	x ^= x >> 16;
+	return x;
 }
 
 void find_best_spr_helper(Node *n, Node *super_tree,
@@ -3858,77 +4810,8 @@ void find_best_spr_helper(Node *n, Node *new_sibling, Node *super_tree,
 	}
 //		cout << "foo3" << endl;
 //	cout << "foo4" << endl;
-	if (n != super_tree && new_sibling != n) {
-		Node *old_sibling = n->get_sibling();
-		//if (new_sibling != old_sibling)
-
-
-/*
-		cout << "SPR Move:" << endl;
-		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Previous Super Tree: "
-		<< super_tree->str_subtree() << endl;
-		cout << "Subtree: " << n->str_subtree() << endl;
-		cout << "New Sibling: " << new_sibling->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
-*/
-	
-
-		int which_sibling = 0;
-		Node *undo = n->spr(new_sibling, which_sibling);
-
-
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-
-/*
-		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Proposed Super Tree: " << super_tree->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
-*/
-
-
-		int distance;
-		if (APPROX) {
-			if (UNROOTED)
-				distance = rSPR_total_approx_distance_unrooted(super_tree, gene_trees);
-			else
-				distance = rSPR_total_approx_distance(super_tree, gene_trees);
-		}
-		else {
-			if (UNROOTED)
-				distance = rSPR_total_distance_unrooted(super_tree, gene_trees,
-						min_distance);
-			else
-				distance = rSPR_total_distance(super_tree, gene_trees, min_distance);
-		}
-//		cout << "\t" << distance << endl;
-
-		if (distance < min_distance) {
-			min_distance = distance;
-			best_spr_move = n;
-			best_sibling = new_sibling;
-			num_ties = 2;
-		}
-		else if (distance == min_distance) {
-			int r = rand();
-			if (r < RAND_MAX/num_ties) {
-				min_distance = distance;
-				best_spr_move = n;
-				best_sibling = new_sibling;
-			}
-			num_ties++;
-		}
-		// restore the previous tree
-
-
-		n->spr(undo, which_sibling);
-
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-	}
+	if (n != super_tree && new_sibling != n)
+		MOVE_SCREEN->add_move(n, new_sibling, gene_trees, 0);
 
 }
 
@@ -3959,8 +4842,9 @@ void get_support(Node *n, Node *super_tree, vector<Node *> *gene_trees) {
 				(*gene_trees)[i]->preorder_number();
 				double acc = find_best_root_acc(temp_tree, (*gene_trees)[i]);
 				if (acc > -1) {
-					root_avg_acc += acc;
-					count++;
+					int weight = tree_weight((*gene_trees)[i]);
+					root_avg_acc += acc * weight;
+					count += weight;
 				}
 			}
 			if (count > 0)
@@ -3994,30 +4878,131 @@ void get_transfer_support(Node *n, Node *super_tree, vector<Node *> *gene_trees)
 	}
 }
 
+/* get_bipartition_support
+ * Set the support of each supertree edge to the weighted number of gene
+ * trees that contain its bipartition, see count_bipartition_support. Each
+ * thread counts its gene trees in its own table and the tables are
+ * added up at the end.
+ */
 void get_bipartition_support(Node *super_tree, vector<Node *> *gene_trees,
 		enum RELAXATION relaxed) {
 	vector<Node *> descendants = super_tree->find_descendants();
 	descendants.push_back(super_tree);
+	int num_nodes = 0;
+	for(int i = 0; i < descendants.size(); i++) {
+		if (descendants[i]->get_preorder_number() >= num_nodes)
+			num_nodes = descendants[i]->get_preorder_number() + 1;
+	}
+	vector<Node *> nodes = vector<Node *>(num_nodes, (Node *)NULL);
 	for(int i = 0; i < descendants.size(); i++) {
-		descendants[i]->set_support(0);
-		descendants[i]->set_support_normalization(0);
+		nodes[descendants[i]->get_preorder_number()] = descendants[i];
 	}
+	vector<int> support = vector<int>(num_nodes, 0);
+	vector<int> normalization = vector<int>(num_nodes, 0);
 	int end = gene_trees->size();
-	#pragma omp parallel for
-	for(int i = 0; i < end; i++) {
-		modify_bipartition_support(super_tree, (*gene_trees)[i], relaxed);
+	#pragma omp parallel
+	{
+		vector<int> local_support = vector<int>(num_nodes, 0);
+		vector<int> local_normalization = vector<int>(num_nodes, 0);
+		#pragma omp for
+		for(int i = 0; i < end; i++) {
+			count_bipartition_support(super_tree, (*gene_trees)[i], nodes,
+					local_support, local_normalization, relaxed);
+		}
+		#pragma omp critical (get_bipartition_support)
+		{
+			for(int i = 0; i < num_nodes; i++) {
+				support[i] += local_support[i];
+				normalization[i] += local_normalization[i];
+			}
+		}
+	}
+	for(int i = 0; i < descendants.size(); i++) {
+		int pre = descendants[i]->get_preorder_number();
+		descendants[i]->set_support(support[pre]);
+		descendants[i]->set_support_normalization(normalization[pre]);
 	}
 }
 
-bool is_taboo(list<Node> taboo_trees, Node *super_tree) {
-	list<Node>::iterator i;
-	Forest F1 = Forest(super_tree);
-	for(i = taboo_trees.begin(); i != taboo_trees.end(); i++) {
-		Forest F2 = Forest(&(*i));
-		if (rSPR_branch_and_bound(&F1, &F2, 0) >= 0)
-			return true;
+// a tree is taboo if it is at rSPR distance 0 from a visited tree,
+// i.e. it has the same canonical_str
+bool is_taboo(TabooList &taboo_trees, Node *super_tree) {
+	return taboo_trees.contains(super_tree);
+}
+
+// build a tree written to a checkpoint with str_subtree
+Node *checkpoint_tree(string s) {
+	Node *T = build_tree(s);
+	T->labels_to_numbers(&label_map, &reverse_label_map);
+	T->set_depth(0);
+	T->fix_depths();
+	T->preorder_number();
+	return T;
+}
+
+// the labels of the leaves on one side of the root of T
+vector<int> root_side(Node *T) {
+	vector<int> side = vector<int>();
+	if (T->lchild() == NULL)
+		return side;
+	vector<Node *> leaves = T->lchild()->find_leaves();
+	for(int i = 0; i < leaves.size(); i++) {
+		side.push_back(leaves[i]->get_label());
 	}
-	return false;
+	return side;
+}
+
+/* restore_root
+ * reroot T on the edge that separates the leaves in side from
+ * the other leaves, as given by root_side
+ */
+void restore_root(Node *T, vector<int> &side) {
+	vector<Node *> leaves = T->find_leaves();
+	vector<bool> in_side = vector<bool>();
+	for(int i = 0; i < side.size(); i++) {
+		if (side[i] >= in_side.size())
+			in_side.resize(side[i] + 1, false);
+		in_side[side[i]] = true;
+	}
+	int num_in_side = 0;
+	Node *new_lc = NULL;
+	restore_root_hlpr(T, in_side, side.size(), leaves.size(), num_in_side,
+			new_lc);
+	if (new_lc != NULL) {
+		T->reroot(new_lc);
+		T->set_depth(0);
+		T->fix_depths();
+		T->preorder_number();
+	}
+}
+
+// returns the number of leaves below n and sets num_in_side to the
+// number of them in side
+int restore_root_hlpr(Node *n, vector<bool> &in_side, int side_size,
+		int num_leaves, int &num_in_side, Node *&new_lc) {
+	int size = 0;
+	num_in_side = 0;
+	if (n->is_leaf()) {
+		size = 1;
+		int l = n->get_label();
+		if (l >= 0 && l < in_side.size() && in_side[l])
+			num_in_side = 1;
+	}
+	else {
+		list<Node *>::iterator c;
+		for(c = n->get_children().begin(); c != n->get_children().end();
+				c++) {
+			int child_in_side;
+			size += restore_root_hlpr(*c, in_side, side_size, num_leaves,
+					child_in_side, new_lc);
+			num_in_side += child_in_side;
+		}
+	}
+	if (new_lc == NULL && n->parent() != NULL
+			&& ((num_in_side == side_size && size == side_size)
+			|| (num_in_side == 0 && size == num_leaves - side_size)))
+		new_lc = n;
+	return size;
 }
 
 /*Joel: Limiting starting point*/
@@ -4032,7 +5017,7 @@ void find_best_distance(Node * n, Node * super_tree, vector<Node *> &gene_trees,
 		UndoMachine um = UndoMachine();
 		vector<Node *> components = vector<Node *>();
 		Node *n_parent = n->parent();
-		um.add_event(new CutParent(n));
+		um.add_event(CutParent(n));
 		n->cut_parent();
 		ContractEvent(&um, n_parent);
 		Node *post_contract = n_parent->contract();
@@ -4143,23 +5128,16 @@ void find_best_spr_helper(Node *n, Node *new_sibling, Node *super_tree,
 		//if (new_sibling != old_sibling)
 /*
 		cout << "SPR Move:" << endl;
-		super_tree->numbers_to_labels(&reverse_label_map);
 		cout << "Previous Super Tree: "
-		<< super_tree->str_subtree() << endl;
-		cout << "Subtree: " << n->str_subtree() << endl;
-		cout << "New Sibling: " << new_sibling->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+		<< super_tree->str_subtree(&reverse_label_map) << endl;
+		cout << "Subtree: " << n->str_subtree(&reverse_label_map) << endl;
+		cout << "New Sibling: " << new_sibling->str_subtree(&reverse_label_map) << endl;
 */
 
 		int which_sibling = 0;
-		Node *undo = n->spr(new_sibling, which_sibling);
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
+		Node *undo = n->spr_renumber(new_sibling, which_sibling);
 /*
-		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Proposed Super Tree: " << super_tree->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
+		cout << "Proposed Super Tree: " << super_tree->str_subtree(&reverse_label_map) << endl;
 */
 
 		int distance;
@@ -4197,10 +5175,7 @@ void find_best_spr_helper(Node *n, Node *new_sibling, Node *super_tree,
 			num_ties++;
 		}
 		// restore the previous tree
-		n->spr(undo, which_sibling);
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
+		n->spr_renumber(undo, which_sibling);
 //		cout << "Reverted Super Tree: "
 //	<< super_tree->str_subtree() << endl;
 	}
@@ -4212,9 +5187,26 @@ void find_best_spr_helper(Node *n, Node *new_sibling, Node *super_tree,
 void find_best_spr(Node *super_tree, vector<Node *> &gene_trees, Node *&best_spr_move, Node *&best_sibling, vector<pair <pair<Node*,Node*>, int> > &approx_moves) {
 	int min_distance = INT_MAX;
 	int num_ties = 0;
+	SprMoveScreen screen = SprMoveScreen();
+	MOVE_SCREEN = &screen;
 	find_best_spr_helper(super_tree, super_tree, gene_trees,
 			best_spr_move, best_sibling, min_distance, num_ties, approx_moves);
+	MOVE_SCREEN = NULL;
+	find_approx_moves(super_tree, screen, approx_moves);
+}
 
+// score the moves of the screen with lower bounds in parallel
+void find_approx_moves(Node *super_tree, SprMoveScreen &screen,
+		vector<pair <pair<Node*,Node*>, int> > &approx_moves) {
+	vector<int> all = vector<int>();
+	for(int i = 0; i < screen.size(); i++) {
+		all.push_back(i);
+	}
+	vector<int> lower_bounds = vector<int>(screen.size(), 0);
+	score_spr_moves(super_tree, screen, all, lower_bounds, false, INT_MAX);
+	for(int i = 0; i < screen.size(); i++) {
+		approx_moves.push_back(make_pair(screen.moves[i], lower_bounds[i]));
+	}
 }
 
 void find_best_spr_helper(Node *n, Node *super_tree,
@@ -4241,7 +5233,7 @@ void find_best_spr_helper(Node *n, Node *super_tree,
 	for(int i = 0; i < gene_trees.size(); i++) {
 		bool include = false;
 		for(int j = 0; j < leaves.size(); j++) {
-			if (gene_trees[i]->contains_leaf(atoi(leaves[j]->get_name().c_str()))) {
+			if (gene_trees[i]->contains_leaf(leaves[j]->get_name_num())) {
 				include = true;
 				break;
 			}
@@ -4260,6 +5252,7 @@ void find_best_spr_helper(Node *n, Node *super_tree,
 //	cout << current_gene_trees.size() << endl;
 //	cout << offset << endl;
 
+		MOVE_SCREEN->new_gene_tree_set();
 		find_best_spr_helper(n, super_tree, super_tree,
 				current_gene_trees, best_spr_move, best_sibling, min_distance, num_ties, approx_moves, offset);
 
@@ -4309,60 +5302,8 @@ void find_best_spr_helper(Node *n, Node *new_sibling, Node *super_tree,
 	}
 //		cout << "foo3" << endl;
 //	cout << "foo4" << endl;
-	if (n != super_tree && new_sibling != n) {
-		Node *old_sibling = n->get_sibling();
-		//if (new_sibling != old_sibling)
-/*
-		cout << "SPR Move:" << endl;
-		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Previous Super Tree: "
-		<< super_tree->str_subtree() << endl;
-		cout << "Subtree: " << n->str_subtree() << endl;
-		cout << "New Sibling: " << new_sibling->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
-*/
-
-		int which_sibling = 0;
-		Node *undo = n->spr(new_sibling, which_sibling);
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-/*
-		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Proposed Super Tree: " << super_tree->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
-*/
-
-		int distance;
-		distance = rSPR_total_approx_distance(super_tree, gene_trees);
-		distance += offset;
-		approx_moves.push_back(make_pair(make_pair(n,new_sibling), distance));
-
-
-
-		/*if (distance < min_distance) {
-			min_distance = distance;
-			best_spr_move = n;
-			best_sibling = new_sibling;
-			num_ties = 2;
-		}
-		else if (distance == min_distance) {
-			int r = rand();
-			if (r < RAND_MAX/num_ties) {
-				min_distance = distance;
-				best_spr_move = n;
-				best_sibling = new_sibling;
-			}
-			num_ties++;
-		}*/
-		// restore the previous tree
-		n->spr(undo, which_sibling);
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-//		cout << "Reverted Super Tree: "
-//	<< super_tree->str_subtree() << endl;
-	}
+	if (n != super_tree && new_sibling != n)
+		MOVE_SCREEN->add_move(n, new_sibling, gene_trees, offset);
 
 }
 
@@ -4381,9 +5322,14 @@ void find_best_spr_r(Node *super_tree, vector<Node *> &gene_trees, Node *&best_s
 	int min_distance = INT_MAX;
 	int min_tie_distance = INT_MAX;
 	int num_ties = 0;
+	SprMoveScreen screen = SprMoveScreen();
+	screen.tie_rules = true;
+	MOVE_SCREEN = &screen;
 	find_best_spr_r_helper(super_tree, super_tree, gene_trees,
 			best_spr_move, best_sibling, min_distance, min_tie_distance,
 			num_ties, r, original_scores);
+	MOVE_SCREEN = NULL;
+	screen_best_spr(super_tree, screen, best_spr_move, best_sibling);
 }
 
 void find_best_spr_r_helper(Node *n, Node *super_tree,
@@ -4426,7 +5372,7 @@ void find_best_spr_r_helper(Node *n, Node *super_tree,
 		for(int i = 0; i < gene_trees.size(); i++) {
 			bool include = false;
 			for(int j = 0; j < leaves.size(); j++) {
-				if (gene_trees[i]->contains_leaf(atoi(leaves[j]->get_name().c_str()))) {
+				if (gene_trees[i]->contains_leaf(leaves[j]->get_name_num())) {
 					include = true;
 					break;
 				}
@@ -4438,6 +5384,7 @@ void find_best_spr_r_helper(Node *n, Node *super_tree,
 			}
 		}
 		gene_trees_p = &current_gene_trees;
+		MOVE_SCREEN->new_gene_tree_set();
 //		cout << "gene_trees: " << gene_trees.size() << endl;
 //		cout << "c_gene_trees: " << current_gene_trees.size() << endl;
 	}
@@ -4590,107 +5537,8 @@ void find_best_spr_r_helper(Node *n, Node *new_sibling, Node *super_tree,
 	}
 //		cout << "foo3" << endl;
 //		cout << "foo4" << endl;
-	if (n != super_tree && new_sibling != n) {
-		Node *old_sibling = n->get_sibling();
-		//if (new_sibling != old_sibling)
-
-/*		cout << endl;
-		cout << "SPR Move:" << endl;
-//		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Previous Super Tree: "
-		<< super_tree->str_subtree() << endl;
-		cout << "Subtree: " << n->str_subtree() << endl;
-		cout << "New Sibling: " << new_sibling->str_subtree() << endl;
-//		super_tree->labels_to_numbers(&label_map, &reverse_label_map);	
-*/
-
-//		cout << endl;
-//		cout << "Previous Super Tree: "
-//		<< super_tree->str_support_subtree(true) << endl;
-		int which_sibling = 0;
-		Node *undo = n->spr(new_sibling, which_sibling);
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-//		cout << "Proposed Super Tree: "
-//		<< super_tree->str_support_subtree(true) << endl;
-/*
-		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Proposed Super Tree: " << super_tree->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
-*/	
-		int distance;
-		if (APPROX) {
-			if (UNROOTED)
-				distance = rSPR_total_approx_distance_unrooted(super_tree, gene_trees);
-			else
-				distance = rSPR_total_approx_distance(super_tree, gene_trees);
-		}
-		else {
-			if (UNROOTED)
-				distance = rSPR_total_distance_unrooted(super_tree, gene_trees);
-			else
-				distance = rSPR_total_distance(super_tree, gene_trees);
-		}
-//		cout << "\t" << distance << endl;
-
-//		cout << "After SPR Distance Super Tree: "
-//		<< super_tree->str_support_subtree(true) << endl;
-		distance += offset;
-		if (distance < min_distance) {
-			if (!TABOO_SEARCH || !is_taboo(taboo_trees, super_tree)) {
-				min_distance = distance;
-				if (RF_TIES)
-					min_tie_distance = rf_total_distance(super_tree, gene_trees);
-				best_spr_move = n;
-				best_sibling = new_sibling;
-				num_ties = 2;
-			}
-		}
-		else if (distance == min_distance) {
-			bool check_tie = true;
-			bool tie = false;
-			if (RF_TIES) {
-				int rf_distance = rf_total_distance(super_tree, gene_trees);
-				if (rf_distance < min_tie_distance) {
-					if (!TABOO_SEARCH || !is_taboo(taboo_trees, super_tree)) {
-						min_tie_distance = rf_distance;
-						best_spr_move = n;
-						best_sibling = new_sibling;
-						num_ties = 2;
-					}
-					check_tie = false;
-				}
-				else if (rf_distance == min_tie_distance)
-					tie = true;
-				else
-					check_tie = false;
-			}
-			if (check_tie) {
-				int r = rand();
-				if (r < RAND_MAX/num_ties) {
-					if (!TABOO_SEARCH || !is_taboo(taboo_trees, super_tree)) {
-						min_distance = distance;
-						best_spr_move = n;
-						best_sibling = new_sibling;
-					}
-				}
-				num_ties++;
-			}
-		}
-		// restore the previous tree
-		n->spr(undo, which_sibling);
-
-//		cout << "Reverted Super Tree: "
-//		<< super_tree->str_support_subtree(true) << endl;
-
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-//		cout << "Reverted Super Tree: "
-//		<< super_tree->str_subtree() << endl;
-
-	}
+	if (n != super_tree && new_sibling != n)
+		MOVE_SCREEN->add_move(n, new_sibling, gene_trees, offset);
 }
 /*End*/
 
@@ -4779,32 +5627,8 @@ void find_best_spr_r_helper(Node *n, Node *new_sibling, Node *super_tree,
 	}
 //		cout << "foo3" << endl;
 //		cout << "foo4" << endl;
-	if (n != super_tree && new_sibling != n) {
-		Node *old_sibling = n->get_sibling();
-
-		int which_sibling = 0;
-		Node *undo = n->spr(new_sibling, which_sibling);
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-/*
-		super_tree->numbers_to_labels(&reverse_label_map);
-		cout << "Proposed Super Tree: " << super_tree->str_subtree() << endl;
-		super_tree->labels_to_numbers(&label_map, &reverse_label_map);
-*/	
-		int distance;
-		distance = rSPR_total_approx_distance(super_tree, gene_trees);
-		approx_moves.push_back(make_pair(make_pair(n,new_sibling), distance));
-
-		// restore the previous tree
-		n->spr(undo, which_sibling);
-		super_tree->set_depth(0);
-		super_tree->fix_depths();
-		super_tree->preorder_number();
-//		cout << "Reverted Super Tree: "
-//		<< super_tree->str_subtree() << endl;
-
-	}
+	if (n != super_tree && new_sibling != n)
+		MOVE_SCREEN->add_move(n, new_sibling, gene_trees, 0);
 }
 /*end*/
 